@@ -0,0 +1,218 @@
+#include "OnnxTranslationEngine.h"
+#include "CpuTopology.h"
+#include "TranslationMetrics.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Finds the fastest configuration for this machine that still translates well enough and
+// writes it into translationConfig.json. The decoding settings of the current config and of
+// evaluationConfig.json are scored first, then the fastest one that meets the BLEU floor is
+// timed across session layouts and batch sizes.
+//
+// Usage: Autotune [sample file from buildTuningSample.py] [--max-bleu-drop X] [--min-bleu X] [--limit N] [--dry-run]
+
+struct TuningSample {
+    std::vector<TranslationSegment> segments;
+    std::vector<std::string> references;
+};
+
+struct TuningResult {
+    nlohmann::json params;
+    size_t batchSize = 0;
+    size_t sessionCount = 0;
+    size_t threadsPerSession = 0;
+    double tokensPerSecond = 0.0;
+    double bleu = 0.0;
+    double chrf = 0.0;
+};
+
+static TuningSample loadSample(const std::string& path, size_t limit) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open tuning sample: " + path + ", run buildTuningSample.py first");
+    }
+
+    TuningSample sample;
+    std::string line;
+    while (std::getline(file, line) && sample.segments.size() < limit) {
+        if (line.empty()) continue;
+        nlohmann::json pair = nlohmann::json::parse(line);
+        sample.segments.push_back({0, static_cast<int>(sample.segments.size()), pair.at("source").get<std::string>()});
+        sample.references.push_back(pair.at("reference").get<std::string>());
+    }
+    if (sample.segments.empty()) {
+        throw std::runtime_error("The tuning sample is empty: " + path);
+    }
+    return sample;
+}
+
+// The evaluationConfig.json entries the engine can run, it has no sampling and ignores
+// temperature and length_penalty
+static std::vector<nlohmann::json> candidateParams(const nlohmann::json& currentParams) {
+    std::vector<nlohmann::json> candidates;
+    auto add = [&candidates](const nlohmann::json& entry) {
+        if (entry.value("do_sample", false)) return;
+
+        nlohmann::json params = nlohmann::json::object();
+        for (const char* key : {"max_new_tokens", "num_beams", "no_repeat_ngram_size", "repetition_penalty", "early_stopping"}) {
+            if (entry.contains(key)) params[key] = entry[key];
+        }
+        if (std::find(candidates.begin(), candidates.end(), params) == candidates.end()) {
+            candidates.push_back(params);
+        }
+    };
+
+    add(currentParams);
+    std::ifstream evaluationFile("evaluationConfig.json");
+    if (evaluationFile.is_open()) {
+        for (const auto& entry : nlohmann::json::parse(evaluationFile)) {
+            add(entry);
+        }
+    } else {
+        std::cerr << "No evaluationConfig.json found, only the current decoding settings are tuned." << "\n";
+    }
+    return candidates;
+}
+
+static TuningResult measure(const nlohmann::json& baseConfig, const TuningSample& sample, const nlohmann::json& params, size_t batchSize, size_t sessionCount, size_t threadsPerSession) {
+    // The engine reads everything from its config, so each run gets a copy with the candidate settings
+    nlohmann::json config = baseConfig;
+    for (const auto& [key, value] : params.items()) {
+        config["params"][key] = value;
+    }
+    config["batching"]["batch_size"] = batchSize;
+    config["sessions"]["count"] = sessionCount;
+    config["sessions"]["threads_per_session"] = threadsPerSession;
+
+    std::filesystem::path configPath = std::filesystem::temp_directory_path() / "AutotuneConfig.json";
+    std::ofstream(configPath) << config.dump(4);
+
+    OnnxTranslationEngine engine("onnx-model-dir", configPath);
+    std::filesystem::remove(configPath);
+
+    EngineStats before = engine.stats();
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<TranslationResult> results = engine.translate(sample.segments);
+    auto end = std::chrono::high_resolution_clock::now();
+    EngineStats after = engine.stats();
+
+    // Segments that failed count as empty translations
+    std::vector<std::string> hypotheses(sample.segments.size());
+    for (const auto& result : results) {
+        hypotheses[result.position] = result.text;
+    }
+
+    TuningResult result;
+    result.params = params;
+    result.batchSize = batchSize;
+    result.sessionCount = sessionCount;
+    result.threadsPerSession = threadsPerSession;
+    result.tokensPerSecond = (after.generatedTokens - before.generatedTokens) / std::chrono::duration<double>(end - start).count();
+    result.bleu = TranslationMetrics::corpusBleu(hypotheses, sample.references);
+    result.chrf = TranslationMetrics::corpusChrf(hypotheses, sample.references);
+
+    std::cout << "AUTOTUNE " << params.dump() << " batch " << batchSize << ", " << sessionCount << "x" << threadsPerSession << " threads: "
+              << result.tokensPerSecond << " tokens/s, BLEU " << result.bleu << ", chrF " << result.chrf << "\n";
+    return result;
+}
+
+int main(int argc, char** argv) {
+    std::string samplePath = "tuning_sample.jsonl";
+    double maxBleuDrop = 1.0;
+    double minBleu = -1.0;
+    size_t limit = 300;
+    bool dryRun = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--max-bleu-drop" && i + 1 < argc) {
+            maxBleuDrop = std::stod(argv[++i]);
+        } else if (arg == "--min-bleu" && i + 1 < argc) {
+            minBleu = std::stod(argv[++i]);
+        } else if (arg == "--limit" && i + 1 < argc) {
+            limit = std::stoul(argv[++i]);
+        } else if (arg == "--dry-run") {
+            dryRun = true;
+        } else {
+            samplePath = arg;
+        }
+    }
+
+    try {
+        TuningSample sample = loadSample(samplePath, limit);
+
+        nlohmann::json baseConfig = nlohmann::json::object();
+        std::ifstream configFile("translationConfig.json");
+        if (configFile.is_open()) {
+            baseConfig = nlohmann::json::parse(configFile);
+        }
+        size_t defaultBatchSize = baseConfig.value("batching", nlohmann::json::object()).value("batch_size", BatchingParams().batchSize);
+
+        // Decoding settings decide the quality, they are compared on the automatic session layout
+        std::vector<nlohmann::json> candidates = candidateParams(baseConfig.value("params", nlohmann::json::object()));
+        std::vector<TuningResult> scored;
+        for (const auto& params : candidates) {
+            scored.push_back(measure(baseConfig, sample, params, defaultBatchSize, 0, 0));
+        }
+
+        // The floor is relative to the current settings unless an absolute one is given
+        double floor = minBleu >= 0.0 ? minBleu : scored.front().bleu - maxBleuDrop;
+        const TuningResult* fastest = nullptr;
+        for (const auto& result : scored) {
+            if (result.bleu >= floor && (!fastest || result.tokensPerSecond > fastest->tokensPerSecond)) {
+                fastest = &result;
+            }
+        }
+        if (!fastest) {
+            std::cerr << "No decoding settings reach BLEU " << floor << ", translationConfig.json is left unchanged." << "\n";
+            return 1;
+        }
+
+        // The layout and batch size only change the speed, every one is timed with the chosen settings
+        size_t coreCount = CpuTopology::physicalCores().size();
+        TuningResult best = *fastest;
+        for (size_t sessionCount = 1; sessionCount <= coreCount; sessionCount *= 2) {
+            size_t threadsPerSession = std::max<size_t>(1, coreCount / sessionCount);
+            for (size_t batchSize : {8, 16, 32}) {
+                TuningResult result = measure(baseConfig, sample, best.params, batchSize, sessionCount, threadsPerSession);
+                if (result.bleu >= floor && result.tokensPerSecond > best.tokensPerSecond) {
+                    best = result;
+                }
+            }
+        }
+
+        std::cout << "\n";
+        std::cout << "Fastest profile above BLEU " << floor << " on " << coreCount << " physical cores:" << "\n";
+        std::cout << "params " << best.params.dump() << ", batch " << best.batchSize << ", " << best.sessionCount << " sessions of " << best.threadsPerSession << " threads" << "\n";
+        std::cout << best.tokensPerSecond << " tokens/s, BLEU " << best.bleu << ", chrF " << best.chrf << "\n";
+        if (dryRun) {
+            return 0;
+        }
+
+        nlohmann::json config = baseConfig;
+        for (const auto& [key, value] : best.params.items()) {
+            config["params"][key] = value;
+        }
+        config["batching"]["batch_size"] = best.batchSize;
+        config["sessions"]["count"] = best.sessionCount;
+        config["sessions"]["threads_per_session"] = best.threadsPerSession;
+        config["autotune"] = {
+            {"physical_cores", coreCount},
+            {"sample_segments", sample.segments.size()},
+            {"bleu_floor", floor},
+            {"tokens_per_second", best.tokensPerSecond},
+            {"bleu", best.bleu},
+            {"chrf", best.chrf}
+        };
+        std::ofstream("translationConfig.json") << config.dump(4) << "\n";
+        std::cout << "Updated translationConfig.json" << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Autotune failed, Details: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "BeamSearch.h"
+#include "LogitsKernels.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Times the logits processing of a decoder step outside the ONNX graph, with the scalar kernels
+// and with AVX2, on the Marian vocabulary. The last rows time whole beam search steps, where the
+// reference also scans every hypothesis for repeated n-grams.
+//
+// Usage: LogitsBenchmark [beams] [iterations]
+
+// Microseconds per call, the scores are refreshed from a copy outside the timed part
+template <typename Run>
+static double timeCalls(const std::vector<float>& source, int iterations, Run run) {
+    std::vector<float> scores = source;
+    double seconds = 0.0;
+    for (int i = 0; i < iterations; ++i) {
+        scores = source;
+        auto start = std::chrono::high_resolution_clock::now();
+        run(scores.data());
+        auto end = std::chrono::high_resolution_clock::now();
+        seconds += std::chrono::duration<double>(end - start).count();
+    }
+    return 1e6 * seconds / iterations;
+}
+
+class ReferenceBeamSearch : public BeamSearch {
+public:
+    using BeamSearch::BeamSearch;
+    using BeamSearch::useReference;
+};
+
+// Decodes maxNewTokens steps of random logits and returns the microseconds per step
+static double timeSteps(const GenerationParams& params, int64_t vocabSize, bool reference) {
+    ReferenceBeamSearch search(params, vocabSize);
+    if (reference) search.useReference();
+    search.start();
+
+    std::mt19937 random(1);
+    std::normal_distribution<float> noise(0.0f, 2.0f);
+    std::vector<float> source(params.numBeams * vocabSize);
+    for (float& score : source) {
+        score = noise(random);
+    }
+    source[MARIAN_EOS_ID] = -100.0f;
+
+    std::vector<float> logits;
+    double seconds = 0.0;
+    int steps = 0;
+    while (!search.isDone()) {
+        // A different window of the random scores every step, so the beams keep changing
+        logits.assign(source.begin(), source.end());
+        std::rotate(logits.begin(), logits.begin() + (steps * 7919) % logits.size(), logits.end());
+        auto start = std::chrono::high_resolution_clock::now();
+        search.advance(logits.data());
+        auto end = std::chrono::high_resolution_clock::now();
+        seconds += std::chrono::duration<double>(end - start).count();
+        ++steps;
+    }
+    return 1e6 * seconds / steps;
+}
+
+int main(int argc, char** argv) {
+    const int64_t vocabSize = MARIAN_PAD_ID + 1;
+    size_t beams = argc > 1 ? std::stoul(argv[1]) : 4;
+    int iterations = argc > 2 ? std::stoi(argv[2]) : 200;
+
+    std::mt19937 random(42);
+    std::normal_distribution<float> noise(0.0f, 2.0f);
+    std::vector<float> logits(beams * vocabSize);
+    for (float& score : logits) {
+        score = noise(random);
+    }
+
+    std::cout << "CPU: " << CpuFeatures::featureString() << ", " << beams << " beams of " << vocabSize << " logits, " << iterations << " iterations" << "\n";
+    if (!CpuFeatures::hasAvx2()) {
+        std::cout << "No AVX2 on this CPU, both columns use the scalar kernels." << "\n";
+    }
+
+    LogitsKernels scalar(false);
+    LogitsKernels avx2(CpuFeatures::hasAvx2());
+    auto report = [](const std::string& name, double scalarMicros, double avx2Micros) {
+        std::cout << name << ": scalar " << scalarMicros << " us, AVX2 " << avx2Micros << " us (" << scalarMicros / avx2Micros << "x)" << "\n";
+    };
+
+    auto logSoftmax = [&](const LogitsKernels& kernels) {
+        return timeCalls(logits, iterations, [&](float* scores) {
+            for (size_t beam = 0; beam < beams; ++beam) {
+                kernels.logSoftmax(scores + beam * vocabSize, vocabSize);
+            }
+        });
+    };
+    report("log-softmax", logSoftmax(scalar), logSoftmax(avx2));
+
+    auto addScalar = [&](const LogitsKernels& kernels) {
+        return timeCalls(logits, iterations, [&](float* scores) {
+            kernels.addScalar(scores, beams * vocabSize, -1.5f);
+        });
+    };
+    report("beam score add", addScalar(scalar), addScalar(avx2));
+
+    std::vector<std::pair<float, size_t>> best;
+    auto topK = [&](const LogitsKernels& kernels) {
+        return timeCalls(logits, iterations, [&](float* scores) {
+            kernels.topK(scores, beams * vocabSize, 2 * beams, best);
+        });
+    };
+    report("top-k", topK(scalar), topK(avx2));
+
+    // The step also copies the beams, the n-gram index grows with the hypotheses
+    for (int maxNewTokens : {64, 256}) {
+        GenerationParams params;
+        params.numBeams = static_cast<int>(beams);
+        params.maxNewTokens = maxNewTokens;
+        params.noRepeatNgramSize = 3;
+        params.repetitionPenalty = 1.3f;
+        report("beam search step, " + std::to_string(maxNewTokens) + " tokens", timeSteps(params, vocabSize, true), timeSteps(params, vocabSize, false));
+    }
+    return 0;
+}
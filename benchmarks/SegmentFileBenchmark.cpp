@@ -0,0 +1,92 @@
+#include "SegmentFile.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Writes and parses the segments of a book as the old comma separated rawTags.txt lines and as a
+// segment file. The texts contain no commas or newlines here, otherwise the CSV could not
+// be parsed back at all.
+//
+// Usage: SegmentFileBenchmark [segments] [iterations]
+
+template <typename Run>
+static double timeRuns(int iterations, Run run) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        run();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return 1e3 * std::chrono::duration<double>(end - start).count() / iterations;
+}
+
+int main(int argc, char** argv) {
+    size_t segmentCount = argc > 1 ? std::stoul(argv[1]) : 10000;
+    int iterations = argc > 2 ? std::stoi(argv[2]) : 20;
+
+    // Paragraph lengths of a light novel, 3 byte UTF-8 characters
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> length(5, 120);
+    const std::string characters[] = {"猫", "は", "の", "を", "に", "が", "と", "た", "し", "て", "。"};
+    std::vector<SegmentRecord> records;
+    records.reserve(segmentCount);
+    for (size_t i = 0; i < segmentCount; ++i) {
+        std::string text = ">>jpn<< ";
+        for (int c = length(random); c > 0; --c) {
+            text += characters[random() % std::size(characters)];
+        }
+        records.push_back({static_cast<uint32_t>(i), static_cast<int32_t>(i / 200), static_cast<int32_t>(i % 200), "jpn", text});
+    }
+
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    std::filesystem::path csvPath = directory / "SegmentFileBenchmark.txt";
+    std::filesystem::path binaryPath = directory / "SegmentFileBenchmark.bin";
+
+    double csvWrite = timeRuns(iterations, [&]() {
+        std::ofstream file(csvPath);
+        for (const auto& record : records) {
+            file << "0," << record.chapterNum << "," << record.position << "," << record.text << "\n";
+        }
+    });
+    double binaryWrite = timeRuns(iterations, [&]() { SegmentFile::write(binaryPath, records); });
+
+    // Both parses produce the same records, the checksum keeps them from being optimized away
+    size_t checksum = 0;
+    double csvParse = timeRuns(iterations, [&]() {
+        std::ifstream file(csvPath);
+        std::string line;
+        std::vector<SegmentRecord> parsed;
+        while (std::getline(file, line)) {
+            size_t first = line.find(',');
+            size_t second = line.find(',', first + 1);
+            size_t third = line.find(',', second + 1);
+            SegmentRecord record;
+            record.id = static_cast<uint32_t>(parsed.size());
+            record.chapterNum = std::stoi(line.substr(first + 1, second - first - 1));
+            record.position = std::stoi(line.substr(second + 1, third - second - 1));
+            record.text = line.substr(third + 1);
+            parsed.push_back(std::move(record));
+        }
+        checksum += parsed.size();
+    });
+    double binaryParse = timeRuns(iterations, [&]() { checksum += SegmentFile(binaryPath).records().size(); });
+    double binaryViews = timeRuns(iterations, [&]() {
+        SegmentFile segments(binaryPath);
+        for (size_t i = 0; i < segments.size(); ++i) {
+            checksum += segments.text(i).size();
+        }
+    });
+
+    std::cout << segmentCount << " segments, " << iterations << " iterations, CSV " << std::filesystem::file_size(csvPath) << " bytes, segment file " << std::filesystem::file_size(binaryPath) << " bytes" << "\n";
+    std::cout << "write: CSV " << csvWrite << " ms, segment file " << binaryWrite << " ms (" << csvWrite / binaryWrite << "x)" << "\n";
+    std::cout << "parse: CSV " << csvParse << " ms, segment file " << binaryParse << " ms (" << csvParse / binaryParse << "x)" << "\n";
+    std::cout << "parse to views: segment file " << binaryViews << " ms (" << csvParse / binaryViews << "x)" << "\n";
+    std::cout << "(checksum " << checksum << ")" << "\n";
+
+    std::filesystem::remove(csvPath);
+    std::filesystem::remove(binaryPath);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "OnnxTranslationEngine.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Translates the same segments with the full vocabulary and with the lexical shortlist and
+// reports the mean latency of a decoder step, including the projection onto the candidates.
+// Run buildShortlist.py first.
+//
+// Usage: ShortlistBenchmark [segments file, one per line] [--json]
+
+struct StepTiming {
+    double stepMilliseconds = 0.0;
+    double logitsPerStep = 0.0;
+};
+
+static std::vector<TranslationSegment> loadSegments(const std::string& path) {
+    std::vector<std::string> lines = {
+        ">>jpn<< 吾輩は猫である。名前はまだ無い。",
+        ">>jpn<< どこで生れたかとんと見当がつかぬ。",
+        ">>jpn<< 何でも薄暗いじめじめした所でニャーニャー泣いていた事だけは記憶している。",
+        ">>jpn<< 吾輩はここで始めて人間というものを見た。"
+    };
+    if (!path.empty()) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open segments file: " + path);
+        }
+        lines.clear();
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty()) lines.push_back(line);
+        }
+    }
+
+    std::vector<TranslationSegment> segments;
+    for (size_t position = 0; position < lines.size(); ++position) {
+        segments.push_back({0, static_cast<int>(position), lines[position]});
+    }
+    return segments;
+}
+
+static StepTiming timeSteps(const std::vector<TranslationSegment>& segments, bool useShortlist) {
+    nlohmann::json config = nlohmann::json::object();
+    std::ifstream configFile("translationConfig.json");
+    if (configFile.is_open()) {
+        config = nlohmann::json::parse(configFile);
+    }
+    config["shortlist"]["enabled"] = useShortlist;
+
+    std::filesystem::path configPath = std::filesystem::temp_directory_path() / "ShortlistBenchmarkConfig.json";
+    std::ofstream(configPath) << config.dump(4);
+
+    OnnxTranslationEngine engine("onnx-model-dir", configPath);
+    std::filesystem::remove(configPath);
+
+    EngineStats before = engine.stats();
+    engine.translate(segments);
+    EngineStats after = engine.stats();
+
+    StepTiming timing;
+    size_t steps = after.decodeSteps - before.decodeSteps;
+    if (steps == 0) {
+        throw std::runtime_error("No decoder steps ran");
+    }
+    timing.stepMilliseconds = 1000.0 * (after.decodeSeconds - before.decodeSeconds) / steps;
+    timing.logitsPerStep = static_cast<double>(after.projectedLogits - before.projectedLogits) / steps;
+    return timing;
+}
+
+int main(int argc, char** argv) {
+    std::string segmentsPath;
+    bool json = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--json") {
+            json = true;
+        } else {
+            segmentsPath = argv[i];
+        }
+    }
+
+    try {
+        std::vector<TranslationSegment> segments = loadSegments(segmentsPath);
+        StepTiming full = timeSteps(segments, false);
+        StepTiming shortlisted = timeSteps(segments, true);
+
+        if (json) {
+            nlohmann::json report = {
+                {"full_vocabulary", {{"step_ms", full.stepMilliseconds}}},
+                {"shortlist", {{"step_ms", shortlisted.stepMilliseconds}, {"logits_per_step", shortlisted.logitsPerStep}}}
+            };
+            std::cout << report.dump(4) << "\n";
+        } else {
+            std::cout << "\n";
+            std::cout << "                   step latency    logits per step" << "\n";
+            std::cout << "full vocabulary    " << full.stepMilliseconds << "ms" << "\n";
+            std::cout << "shortlist          " << shortlisted.stepMilliseconds << "ms    " << shortlisted.logitsPerStep << "\n";
+            std::cout << "speedup            " << full.stepMilliseconds / shortlisted.stepMilliseconds << "x" << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Shortlist benchmark failed, Details: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "OnnxTranslationEngine.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Measures the time from constructing the engine to the first translated segment, once with an
+// empty graph cache (cold) and once with the graphs the first run cached (warm).
+//
+// Usage: StartupBenchmark [segment text] [--json]
+
+struct StartupTiming {
+    double loadSeconds = 0.0;
+    double firstSegmentSeconds = 0.0;
+};
+
+static StartupTiming timeStartup(const std::string& text) {
+    StartupTiming timing;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    OnnxTranslationEngine engine;
+    auto loaded = std::chrono::high_resolution_clock::now();
+
+    std::vector<TranslationResult> results = engine.translate({{0, 1, text}});
+    auto translated = std::chrono::high_resolution_clock::now();
+
+    if (results.empty()) {
+        throw std::runtime_error("The benchmark segment failed to translate");
+    }
+
+    timing.loadSeconds = std::chrono::duration<double>(loaded - start).count();
+    timing.firstSegmentSeconds = std::chrono::duration<double>(translated - start).count();
+    return timing;
+}
+
+int main(int argc, char** argv) {
+    std::string text = ">>jpn<< 吾輩は猫である。名前はまだ無い。";
+    bool json = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--json") {
+            json = true;
+        } else {
+            text = argv[i];
+        }
+    }
+
+    // The cache directory comes from translationConfig.json like it does for the engine
+    std::string cacheDirectory = "ort-cache";
+    std::ifstream configFile("translationConfig.json");
+    if (configFile.is_open()) {
+        nlohmann::json config = nlohmann::json::parse(configFile);
+        nlohmann::json graphCache = config.value("graph_cache", nlohmann::json::object());
+        if (!graphCache.value("enabled", true)) {
+            std::cerr << "graph_cache is disabled in translationConfig.json, warm starts would not differ." << "\n";
+            return 1;
+        }
+        cacheDirectory = graphCache.value("directory", cacheDirectory);
+    }
+
+    std::filesystem::remove_all(cacheDirectory);
+
+    try {
+        StartupTiming cold = timeStartup(text);
+        StartupTiming warm = timeStartup(text);
+
+        if (json) {
+            nlohmann::json report = {
+                {"cold", {{"load_seconds", cold.loadSeconds}, {"first_segment_seconds", cold.firstSegmentSeconds}}},
+                {"warm", {{"load_seconds", warm.loadSeconds}, {"first_segment_seconds", warm.firstSegmentSeconds}}}
+            };
+            std::cout << report.dump(4) << "\n";
+        } else {
+            std::cout << "\n";
+            std::cout << "        model load    first segment" << "\n";
+            std::cout << "cold    " << cold.loadSeconds << "s    " << cold.firstSegmentSeconds << "s" << "\n";
+            std::cout << "warm    " << warm.loadSeconds << "s    " << warm.firstSegmentSeconds << "s" << "\n";
+            std::cout << "speedup " << cold.firstSegmentSeconds / warm.firstSegmentSeconds << "x" << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Startup benchmark failed, Details: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "OnnxTranslationEngine.h"
+#include "CpuTopology.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Translates the same workload with 1, 2, 4, ... sessions of a fixed thread count to check that
+// throughput grows with the cores the sessions get.
+//
+// Usage: ThroughputBenchmark [segments file, one per line] [--threads N] [--json]
+
+static std::vector<TranslationSegment> loadSegments(const std::string& path) {
+    std::vector<std::string> lines;
+    if (!path.empty()) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open segments file: " + path);
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty()) lines.push_back(line);
+        }
+    } else {
+        lines = {
+            ">>jpn<< 吾輩は猫である。名前はまだ無い。",
+            ">>jpn<< どこで生れたかとんと見当がつかぬ。",
+            ">>jpn<< 何でも薄暗いじめじめした所でニャーニャー泣いていた事だけは記憶している。",
+            ">>jpn<< 吾輩はここで始めて人間というものを見た。"
+        };
+    }
+
+    // A chapter's worth of segments so every session layout stays busy
+    std::vector<TranslationSegment> segments;
+    for (int position = 0; segments.size() < 256; ++position) {
+        segments.push_back({0, position, lines[position % lines.size()]});
+    }
+    return segments;
+}
+
+static double timeLayout(const std::vector<TranslationSegment>& segments, size_t sessionCount, size_t threadsPerSession) {
+    // The engine reads its layout from the config, so each run gets a copy with the sessions replaced
+    nlohmann::json config = nlohmann::json::object();
+    std::ifstream configFile("translationConfig.json");
+    if (configFile.is_open()) {
+        config = nlohmann::json::parse(configFile);
+    }
+    config["sessions"] = {{"count", sessionCount}, {"threads_per_session", threadsPerSession}, {"pin_threads", true}};
+
+    std::filesystem::path configPath = std::filesystem::temp_directory_path() / "ThroughputBenchmarkConfig.json";
+    std::ofstream(configPath) << config.dump(4);
+
+    OnnxTranslationEngine engine("onnx-model-dir", configPath);
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<TranslationResult> results = engine.translate(segments);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::filesystem::remove(configPath);
+    if (results.size() != segments.size()) {
+        throw std::runtime_error("Only " + std::to_string(results.size()) + " of " + std::to_string(segments.size()) + " segments translated");
+    }
+    return results.size() / std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+    std::string segmentsPath;
+    size_t threadsPerSession = 0;
+    bool json = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") {
+            json = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threadsPerSession = std::stoul(argv[++i]);
+        } else {
+            segmentsPath = arg;
+        }
+    }
+
+    size_t coreCount = CpuTopology::physicalCores().size();
+    size_t maxSessions = 0;
+    CpuTopology::autoLayout(coreCount, maxSessions, threadsPerSession);
+
+    try {
+        std::vector<TranslationSegment> segments = loadSegments(segmentsPath);
+
+        nlohmann::json report = nlohmann::json::array();
+        double baseline = 0.0;
+        for (size_t sessionCount = 1; sessionCount <= maxSessions; sessionCount *= 2) {
+            double throughput = timeLayout(segments, sessionCount, threadsPerSession);
+            if (sessionCount == 1) baseline = throughput;
+            report.push_back({{"sessions", sessionCount}, {"threads_per_session", threadsPerSession}, {"segments_per_second", throughput}, {"speedup", throughput / baseline}});
+        }
+
+        if (json) {
+            std::cout << report.dump(4) << "\n";
+        } else {
+            std::cout << "\n";
+            std::cout << coreCount << " physical cores, " << threadsPerSession << " threads per session" << "\n";
+            std::cout << "sessions    segments/s    speedup" << "\n";
+            for (const auto& entry : report) {
+                std::cout << entry["sessions"].get<size_t>() << "           " << entry["segments_per_second"].get<double>() << "        " << entry["speedup"].get<double>() << "x" << "\n";
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Throughput benchmark failed, Details: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "MarianTokenizer.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Measures encode and decode throughput of MarianTokenizer on a whole book.
+// The input is a UTF-8 text file with one segment per line, e.g. the <p> text of a novel.
+//
+// Usage: TokenizerBenchmark <novel.txt> [langcode] [iterations] [--json]
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: TokenizerBenchmark <novel.txt> [langcode] [iterations] [--json]" << "\n";
+        return 1;
+    }
+
+    std::string inputPath = argv[1];
+    std::string langcode = argc > 2 ? argv[2] : "jpn";
+    int iterations = argc > 3 ? std::stoi(argv[3]) : 5;
+    bool json = argc > 4 && std::string(argv[4]) == "--json";
+
+    std::ifstream inputFile(inputPath);
+    if (!inputFile.is_open()) {
+        std::cerr << "Failed to open input file: " << inputPath << "\n";
+        return 1;
+    }
+
+    std::vector<std::string> segments;
+    std::string line;
+    while (std::getline(inputFile, line)) {
+        if (line.find_first_not_of(" \t\r\n") == std::string::npos) continue;
+        segments.push_back(">>" + langcode + "<< " + line);
+    }
+
+    MarianTokenizer tokenizer("onnx-model-dir");
+
+    // Warm up once so the first iteration does not pay for page faults
+    std::vector<std::vector<int64_t>> encoded = tokenizer.encodeBatch(segments);
+
+    size_t tokenCount = 0;
+    for (const auto& ids : encoded) {
+        tokenCount += ids.size();
+    }
+
+    double encodeSeconds = 0.0;
+    double decodeSeconds = 0.0;
+    for (int i = 0; i < iterations; ++i) {
+        auto start = std::chrono::high_resolution_clock::now();
+        encoded = tokenizer.encodeBatch(segments);
+        auto middle = std::chrono::high_resolution_clock::now();
+        std::vector<std::string> decoded = tokenizer.decodeBatch(encoded);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        encodeSeconds += std::chrono::duration<double>(middle - start).count();
+        decodeSeconds += std::chrono::duration<double>(end - middle).count();
+    }
+
+    double encodeTokensPerSecond = tokenCount * iterations / encodeSeconds;
+    double decodeTokensPerSecond = tokenCount * iterations / decodeSeconds;
+
+    if (json) {
+        std::cout << "{\"segments\": " << segments.size()
+                  << ", \"tokens\": " << tokenCount
+                  << ", \"encode_tokens_per_s\": " << encodeTokensPerSecond
+                  << ", \"decode_tokens_per_s\": " << decodeTokensPerSecond << "}" << "\n";
+    } else {
+        std::cout << "Segments: " << segments.size() << "\n";
+        std::cout << "Tokens: " << tokenCount << "\n";
+        std::cout << "Encode: " << encodeTokensPerSecond << " tokens/s" << "\n";
+        std::cout << "Decode: " << decodeTokensPerSecond << " tokens/s" << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+# Compares the HF MarianTokenizer used by translation.py with the native MarianTokenizer.
+# The novel is a UTF-8 text file with one segment per line.
+#
+# Usage: python benchmarks/tokenizer_benchmark.py <novel.txt> [--langcode jpn] [--iterations 5] [--native ./build/TokenizerBenchmark]
+
+import argparse
+import json
+import subprocess
+import time
+from transformers import AutoTokenizer
+
+
+def load_segments(path, langcode):
+    with open(path, "r", encoding="utf-8") as infile:
+        return [f">>{langcode}<< {line.strip()}" for line in infile if line.strip()]
+
+
+def benchmark_hf(segments, iterations):
+    tokenizer = AutoTokenizer.from_pretrained("onnx-model-dir")
+
+    # Same call pattern as process_task: one segment at a time
+    encoded = [tokenizer(text)["input_ids"] for text in segments]
+    token_count = sum(len(ids) for ids in encoded)
+
+    encode_seconds = 0.0
+    decode_seconds = 0.0
+    for _ in range(iterations):
+        start = time.perf_counter()
+        encoded = [tokenizer(text)["input_ids"] for text in segments]
+        middle = time.perf_counter()
+        [tokenizer.decode(ids, skip_special_tokens=True) for ids in encoded]
+        end = time.perf_counter()
+
+        encode_seconds += middle - start
+        decode_seconds += end - middle
+
+    return {
+        "segments": len(segments),
+        "tokens": token_count,
+        "encode_tokens_per_s": token_count * iterations / encode_seconds,
+        "decode_tokens_per_s": token_count * iterations / decode_seconds,
+    }
+
+
+def benchmark_native(executable, novel, langcode, iterations):
+    output = subprocess.run([executable, novel, langcode, str(iterations), "--json"], capture_output=True, text=True, check=True)
+    return json.loads(output.stdout.strip().splitlines()[-1])
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("novel")
+    parser.add_argument("--langcode", default="jpn")
+    parser.add_argument("--iterations", type=int, default=5)
+    parser.add_argument("--native", default=None, help="Path to the TokenizerBenchmark executable")
+    args = parser.parse_args()
+
+    segments = load_segments(args.novel, args.langcode)
+    results = {"HF MarianTokenizer": benchmark_hf(segments, args.iterations)}
+    if args.native:
+        results["Native MarianTokenizer"] = benchmark_native(args.native, args.novel, args.langcode, args.iterations)
+
+    print(f"{'Tokenizer':<24}{'Tokens':>10}{'Encode tok/s':>16}{'Decode tok/s':>16}")
+    for name, result in results.items():
+        print(f"{name:<24}{result['tokens']:>10}{result['encode_tokens_per_s']:>16.0f}{result['decode_tokens_per_s']:>16.0f}")
+
+
+if __name__ == "__main__":
+    main()
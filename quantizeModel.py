@@ -0,0 +1,120 @@
+import argparse
+import json
+import os
+import shutil
+import sys
+
+from datasets import load_dataset
+from onnxruntime.quantization import QuantType, quantize_dynamic
+from optimum.onnxruntime import ORTModelForSeq2SeqLM
+from sacrebleu import corpus_bleu
+from transformers import AutoTokenizer
+
+# Quantizes the graphs in onnx-model-dir and records whether the result may be enabled.
+# The engine and translation.py only load a variant whose quantization_gate.json passed.
+
+onnx_model_path = 'onnx-model-dir'
+graph_files = ['encoder_model.onnx', 'decoder_model.onnx', 'decoder_with_past_model.onnx']
+variants = {
+    'int8': {'per_channel': False},
+    'int8-per-channel': {'per_channel': True},
+}
+
+
+def load_translation_config():
+    """Load the generation params and quantization settings from translationConfig.json."""
+    if not os.path.exists('translationConfig.json'):
+        return {}, {}
+    with open('translationConfig.json') as f:
+        data = json.load(f)
+    return data.get('params', {}), data.get('quantization', {})
+
+
+def quantize(variant, output_dir):
+    """Write dynamic INT8 MatMul weights for every graph into output_dir."""
+    os.makedirs(output_dir, exist_ok=True)
+
+    for graph_file in graph_files:
+        print(f"Quantizing {graph_file}...", flush=True)
+        quantize_dynamic(
+            os.path.join(onnx_model_path, graph_file),
+            os.path.join(output_dir, graph_file),
+            op_types_to_quantize=['MatMul'],
+            weight_type=QuantType.QInt8,
+            per_channel=variants[variant]['per_channel'],
+        )
+
+    # Everything that is not a graph is shared with the fp32 model
+    for file_name in os.listdir(onnx_model_path):
+        source = os.path.join(onnx_model_path, file_name)
+        if os.path.isfile(source) and not file_name.endswith('.onnx'):
+            shutil.copy(source, output_dir)
+
+
+def load_evaluation_sample(samples):
+    """The same 100 sentence sample evaluateModel.ipynb scores."""
+    data = load_dataset("NilanE/ParallelFiction-Ja_En-100k", split="train")
+    test_data = data.train_test_split(test_size=0.1, seed=42)['test']
+    test_data = test_data.shuffle(seed=42).select(range(samples))
+
+    sources = [">>jpn<< " + example['src'] for example in test_data]
+    references = [[example['trg'] for example in test_data]]
+    return sources, references
+
+
+def score_model(model_dir, tokenizer, sources, references, params):
+    """Translate the sample with the ONNX model in model_dir and return its BLEU score."""
+    model = ORTModelForSeq2SeqLM.from_pretrained(model_dir)
+
+    translations = []
+    for source in sources:
+        inputs = tokenizer(source, return_tensors="pt", truncation=True)
+        outputs = model.generate(**inputs, **params)
+        translations.append(tokenizer.decode(outputs[0], skip_special_tokens=True))
+
+    return corpus_bleu(translations, references).score
+
+
+def main():
+    params, quantization = load_translation_config()
+
+    parser = argparse.ArgumentParser(description="Quantize onnx-model-dir and gate the variant on BLEU.")
+    parser.add_argument('--variant', choices=list(variants), default='int8')
+    parser.add_argument('--max-bleu-drop', type=float, default=quantization.get('max_bleu_drop', 1.0))
+    parser.add_argument('--samples', type=int, default=100)
+    args = parser.parse_args()
+
+    output_dir = os.path.join(onnx_model_path, args.variant)
+    quantize(args.variant, output_dir)
+
+    tokenizer = AutoTokenizer.from_pretrained(onnx_model_path)
+    sources, references = load_evaluation_sample(args.samples)
+
+    print("Scoring the fp32 model...", flush=True)
+    baseline_bleu = score_model(onnx_model_path, tokenizer, sources, references, params)
+    print(f"Scoring the {args.variant} model...", flush=True)
+    quantized_bleu = score_model(output_dir, tokenizer, sources, references, params)
+
+    passed = baseline_bleu - quantized_bleu <= args.max_bleu_drop
+    gate = {
+        'variant': args.variant,
+        'samples': args.samples,
+        'baseline_bleu': baseline_bleu,
+        'quantized_bleu': quantized_bleu,
+        'max_bleu_drop': args.max_bleu_drop,
+        'passed': passed,
+    }
+    with open(os.path.join(output_dir, 'quantization_gate.json'), 'w') as f:
+        json.dump(gate, f, indent=4)
+
+    print(f"BLEU fp32: {baseline_bleu:.2f}, {args.variant}: {quantized_bleu:.2f}", flush=True)
+    if not passed:
+        print(f"BLEU dropped by more than {args.max_bleu_drop}, the {args.variant} variant stays disabled.", flush=True)
+        return 1
+
+    print(f"Set \"variant\": \"{args.variant}\" in the quantization section of translationConfig.json to use it.", flush=True)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,190 @@
+#include "BeamSearch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+BeamSearch::BeamSearch(const GenerationParams& params, int64_t vocabSize) : params(params), vocabSize(vocabSize) {
+    this->params.numBeams = std::max(1, params.numBeams);
+}
+
+void BeamSearch::start() {
+    const size_t numBeams = params.numBeams;
+    beams.assign(numBeams, std::vector<int64_t>{MARIAN_PAD_ID});
+    blockers.assign(numBeams, NgramBlocker(params.noRepeatNgramSize));
+    for (size_t beam = 0; beam < numBeams; ++beam) {
+        blockers[beam].extend(beams[beam]);
+    }
+
+    // Both sets of beams can hold the longest output, so advancing never grows them
+    nextBeams.resize(numBeams);
+    for (size_t beam = 0; beam < numBeams; ++beam) {
+        beams[beam].reserve(params.maxNewTokens + 2);
+        nextBeams[beam].reserve(params.maxNewTokens + 2);
+    }
+    nextBlockers.resize(numBeams, NgramBlocker(params.noRepeatNgramSize));
+    nextScores.resize(numBeams);
+    sources.resize(numBeams);
+
+    // Only the first beam is live at the start, otherwise every beam would pick the same tokens
+    beamScores.assign(numBeams, -1e9f);
+    beamScores[0] = 0.0f;
+
+    hypotheses.clear();
+    done = false;
+}
+
+void BeamSearch::useReference() {
+    kernels = LogitsKernels(false);
+    referenceNgrams = true;
+}
+
+void BeamSearch::logSoftmax(float* scores) const {
+    kernels.logSoftmax(scores, vocabSize);
+}
+
+void BeamSearch::applyRepetitionPenalty(float* scores, const std::vector<int64_t>& generated) const {
+    LogitsKernels::repetitionPenalty(scores, generated, params.repetitionPenalty, seenTokens);
+}
+
+// The linear scan the per-beam NgramBlockers replace, kept as their reference
+void BeamSearch::applyNoRepeatNgram(float* scores, const std::vector<int64_t>& generated) const {
+    const int n = params.noRepeatNgramSize;
+    if (n <= 0 || static_cast<int>(generated.size()) + 1 < n) return;
+
+    // Ban every token that would complete an n-gram already present in the output
+    const size_t prefixStart = generated.size() - (n - 1);
+    for (size_t start = 0; start + n <= generated.size(); ++start) {
+        if (std::equal(generated.begin() + start, generated.begin() + start + n - 1, generated.begin() + prefixStart)) {
+            scores[generated[start + n - 1]] = -std::numeric_limits<float>::infinity();
+        }
+    }
+}
+
+void BeamSearch::addHypothesis(std::vector<int64_t> tokens, float sumLogProbs) {
+    // Normalised by the generated length, which leaves out the decoder start token
+    float score = sumLogProbs / static_cast<float>(tokens.size() - 1);
+
+    if (static_cast<int>(hypotheses.size()) < params.numBeams) {
+        hypotheses.emplace_back(score, std::move(tokens));
+        return;
+    }
+
+    auto worst = std::min_element(hypotheses.begin(), hypotheses.end());
+    if (score > worst->first) {
+        *worst = {score, std::move(tokens)};
+    }
+}
+
+bool BeamSearch::isFinished(float bestRunningScore) const {
+    if (static_cast<int>(hypotheses.size()) < params.numBeams) return false;
+    if (params.earlyStopping) return true;
+
+    // Without early stopping we only stop once no running beam can beat the worst hypothesis
+    float worst = std::min_element(hypotheses.begin(), hypotheses.end())->first;
+    return worst >= bestRunningScore / static_cast<float>(beams[0].size());
+}
+
+const std::vector<size_t>& BeamSearch::advance(float* logits) {
+    const size_t numBeams = beams.size();
+    const float negativeInfinity = -std::numeric_limits<float>::infinity();
+    const bool lastStep = static_cast<int>(beams[0].size()) >= params.maxNewTokens;
+
+    for (size_t beamIndex = 0; beamIndex < numBeams; ++beamIndex) {
+        float* scores = logits + beamIndex * vocabSize;
+        logSoftmax(scores);
+        applyRepetitionPenalty(scores, beams[beamIndex]);
+        if (referenceNgrams) {
+            applyNoRepeatNgram(scores, beams[beamIndex]);
+        } else {
+            blockers[beamIndex].apply(scores, beams[beamIndex]);
+        }
+
+        // The pad token is listed in bad_words_ids of the generation config
+        if (MARIAN_PAD_ID < vocabSize) {
+            scores[MARIAN_PAD_ID] = negativeInfinity;
+        }
+
+        // forced_eos_token_id ends every beam at the length limit
+        if (lastStep) {
+            float eos = scores[MARIAN_EOS_ID];
+            std::fill(scores, scores + vocabSize, negativeInfinity);
+            scores[MARIAN_EOS_ID] = eos;
+        }
+
+        if (params.renormalizeLogits) {
+            logSoftmax(scores);
+        }
+
+        kernels.addScalar(scores, vocabSize, beamScores[beamIndex]);
+    }
+
+    // Twice the beam count guarantees numBeams candidates even if every beam proposes EOS.
+    // A small min-heap keeps the best ones without sorting numBeams * vocabSize scores.
+    const size_t candidateCount = std::min<size_t>(2 * numBeams, numBeams * vocabSize);
+    kernels.topK(logits, numBeams * vocabSize, candidateCount, candidates);
+
+    size_t kept = 0;
+    for (size_t rank = 0; rank < candidates.size() && kept < numBeams; ++rank) {
+        auto [score, candidate] = candidates[rank];
+        if (std::isinf(score)) break;
+
+        size_t source = candidate / vocabSize;
+        int64_t token = static_cast<int64_t>(candidate % vocabSize);
+
+        if (token == MARIAN_EOS_ID) {
+            // An EOS outside the top numBeams candidates is not allowed to finish a hypothesis
+            if (rank >= numBeams) continue;
+            std::vector<int64_t> hypothesis = beams[source];
+            hypothesis.push_back(MARIAN_EOS_ID);
+            addHypothesis(std::move(hypothesis), score);
+            continue;
+        }
+
+        // Copied into the spare beams, which keep their capacity from the steps before
+        std::vector<int64_t>& next = nextBeams[kept];
+        next.assign(beams[source].begin(), beams[source].end());
+        next.push_back(token);
+        nextBlockers[kept] = blockers[source];
+        nextBlockers[kept].extend(next);
+        nextScores[kept] = score;
+        sources[kept] = source;
+        ++kept;
+    }
+
+    done = lastStep || kept == 0 || isFinished(candidates.front().first);
+
+    // Keep the beam count fixed so the cache keeps numBeams rows per segment
+    for (; kept > 0 && kept < numBeams; ++kept) {
+        nextBeams[kept] = nextBeams[kept - 1];
+        nextBlockers[kept] = nextBlockers[kept - 1];
+        nextScores[kept] = negativeInfinity;
+        sources[kept] = sources[kept - 1];
+    }
+
+    if (kept > 0) {
+        beams.swap(nextBeams);
+        beamScores.swap(nextScores);
+        blockers.swap(nextBlockers);
+    } else {
+        sources.assign(numBeams, 0);
+    }
+    return sources;
+}
+
+std::vector<int64_t> BeamSearch::best() const {
+    if (!hypotheses.empty()) {
+        return std::max_element(hypotheses.begin(), hypotheses.end())->second;
+    }
+    size_t bestBeam = std::max_element(beamScores.begin(), beamScores.end()) - beamScores.begin();
+    return beams[bestBeam];
+}
+
+float BeamSearch::bestScore() const {
+    if (!hypotheses.empty()) {
+        return std::max_element(hypotheses.begin(), hypotheses.end())->first;
+    }
+    size_t bestBeam = std::max_element(beamScores.begin(), beamScores.end()) - beamScores.begin();
+    if (beams[bestBeam].size() < 2) return 0.0f;
+    return beamScores[bestBeam] / static_cast<float>(beams[bestBeam].size() - 1);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "MarianTokenizer.h"
+#include "LogitsKernels.h"
+
+// Mirrors the "params" object of translationConfig.json
+struct GenerationParams {
+    int maxNewTokens = 512;
+    int numBeams = 4;
+    int noRepeatNgramSize = 3;
+    float repetitionPenalty = 0.6f;
+    bool earlyStopping = true;
+
+    // From onnx-model-dir/generation_config.json
+    bool renormalizeLogits = false;
+};
+
+// Beam search state of a single segment, scored the same way as the HF BeamSearchScorer with a
+// length penalty of 1. The engine owns the decoder and its cache, this class only picks tokens.
+class BeamSearch {
+public:
+    BeamSearch() = default;
+    BeamSearch(const GenerationParams& params, int64_t vocabSize);
+
+    // Every beam starts from the decoder start token, which is the pad token for Marian
+    void start();
+
+    // Takes numBeams rows of raw decoder logits (modified in place) and moves the beams one token
+    // forward. Returns for each new beam the index of the beam it extends, the caller reorders
+    // its key/value cache rows with it. The vector is reused by the next call.
+    const std::vector<size_t>& advance(float* logits);
+
+    bool isDone() const { return done; }
+    size_t beamCount() const { return beams.size(); }
+    const std::vector<int64_t>& beam(size_t index) const { return beams[index]; }
+
+    // The best finished hypothesis, or the best running beam if none finished
+    std::vector<int64_t> best() const;
+
+    // Length normalised log probability of best(), the average over its generated tokens
+    float bestScore() const;
+
+protected:
+    void logSoftmax(float* scores) const;
+    void applyRepetitionPenalty(float* scores, const std::vector<int64_t>& generated) const;
+    void applyNoRepeatNgram(float* scores, const std::vector<int64_t>& generated) const;
+    void addHypothesis(std::vector<int64_t> tokens, float sumLogProbs);
+    bool isFinished(float bestRunningScore) const;
+
+    // The scalar kernels and the linear n-gram scan, the tests check that they pick the same tokens
+    void useReference();
+
+    GenerationParams params;
+    int64_t vocabSize = 0;
+    LogitsKernels kernels;
+    bool referenceNgrams = false;
+
+    std::vector<std::vector<int64_t>> beams;
+    std::vector<float> beamScores;
+    std::vector<NgramBlocker> blockers;
+
+    // Reused across steps, advance builds the next beams in the spare set and swaps them in
+    std::vector<std::pair<float, size_t>> candidates;
+    mutable std::vector<int64_t> seenTokens;
+    std::vector<std::vector<int64_t>> nextBeams;
+    std::vector<float> nextScores;
+    std::vector<NgramBlocker> nextBlockers;
+    std::vector<size_t> sources;
+
+    // Finished hypotheses with their length normalised scores, at most numBeams of them
+    std::vector<std::pair<float, std::vector<int64_t>>> hypotheses;
+    bool done = false;
+};
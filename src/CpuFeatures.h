@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+// Instruction set extensions of the host CPU. ORT's fully optimized graphs and the SIMD paths
+// of the engine depend on them, so anything cached on disk is keyed by featureString().
+class CpuFeatures {
+public:
+    static bool hasAvx2() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        __cpuid(info, 1);
+        bool fma = (info[2] & (1 << 12)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        return avx2 && fma && osxsave && (_xgetbv(0) & 0x6) == 0x6;
+#else
+        return false;
+#endif
+    }
+
+    static bool hasAvx512() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+        __cpuidex(info, 7, 0);
+        bool avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+        return avx512 && (_xgetbv(0) & 0xE6) == 0xE6;
+#else
+        return false;
+#endif
+    }
+
+    static std::string featureString() {
+#if defined(__aarch64__) || defined(_M_ARM64)
+        return "arm64";
+#else
+        std::string features = "x86";
+        if (hasAvx2()) features += "-avx2";
+        if (hasAvx512()) features += "-avx512";
+        return features;
+#endif
+    }
+};
@@ -0,0 +1,116 @@
+#include "CpuTopology.h"
+
+#include <algorithm>
+#include <set>
+#include <thread>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <fstream>
+#include <string>
+#endif
+
+std::vector<int> CpuTopology::physicalCores() {
+    std::vector<int> cores;
+    int logicalCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+#if defined(__linux__)
+    std::set<std::pair<int, int>> seenCores;
+    for (int cpu = 0; cpu < logicalCount; ++cpu) {
+        std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        std::ifstream packageFile(topology + "physical_package_id");
+        std::ifstream coreFile(topology + "core_id");
+        int package = 0;
+        int core = 0;
+        if (!(packageFile >> package) || !(coreFile >> core)) {
+            cores.clear();
+            break;
+        }
+        if (seenCores.insert({package, core}).second) {
+            cores.push_back(cpu);
+        }
+    }
+#elif defined(_WIN32)
+    DWORD length = 0;
+    GetLogicalProcessorInformation(nullptr, &length);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (!info.empty() && GetLogicalProcessorInformation(info.data(), &length)) {
+        for (const auto& entry : info) {
+            if (entry.Relationship != RelationProcessorCore) continue;
+            // The lowest logical processor of each core represents it
+            for (int bit = 0; bit < static_cast<int>(sizeof(ULONG_PTR) * 8); ++bit) {
+                if (entry.ProcessorMask & (static_cast<ULONG_PTR>(1) << bit)) {
+                    cores.push_back(bit);
+                    break;
+                }
+            }
+        }
+        std::sort(cores.begin(), cores.end());
+    }
+#endif
+
+    if (cores.empty()) {
+        for (int cpu = 0; cpu < logicalCount; ++cpu) {
+            cores.push_back(cpu);
+        }
+    }
+    return cores;
+}
+
+void CpuTopology::autoLayout(size_t coreCount, size_t& sessionCount, size_t& threadsPerSession) {
+    coreCount = std::max<size_t>(1, coreCount);
+
+    if (threadsPerSession == 0 && sessionCount == 0) {
+        threadsPerSession = std::min<size_t>(4, coreCount);
+    }
+    if (sessionCount == 0) {
+        sessionCount = std::max<size_t>(1, coreCount / threadsPerSession);
+    }
+    if (threadsPerSession == 0) {
+        threadsPerSession = std::max<size_t>(1, coreCount / sessionCount);
+    }
+}
+
+std::vector<std::vector<int>> CpuTopology::partition(const std::vector<int>& cores, size_t sessionCount, size_t threadsPerSession) {
+    std::vector<std::vector<int>> sets(sessionCount);
+    if (cores.empty()) return sets;
+
+    // Oversubscribed layouts wrap around, the sets then overlap instead of leaving sessions empty
+    size_t next = 0;
+    for (auto& set : sets) {
+        for (size_t thread = 0; thread < threadsPerSession; ++thread) {
+            set.push_back(cores[next % cores.size()]);
+            ++next;
+        }
+    }
+    return sets;
+}
+
+bool CpuTopology::pinCurrentThread(const std::vector<int>& cores) {
+    if (cores.empty()) return false;
+
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int core : cores) {
+        CPU_SET(core, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (int core : cores) {
+        if (core < static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+            mask |= static_cast<DWORD_PTR>(1) << core;
+        }
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    // macOS has no hard affinity, the scheduler already keeps busy threads apart
+    return false;
+#endif
+}
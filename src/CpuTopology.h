@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Which logical CPUs the engine can pin its sessions to
+class CpuTopology {
+public:
+    // One logical CPU per physical core, SMT siblings share the same GEMM units so they are
+    // left out. Falls back to every logical CPU when the topology can't be read.
+    static std::vector<int> physicalCores();
+
+    // Splits the cores into sessionCount disjoint sets of threadsPerSession cores
+    static std::vector<std::vector<int>> partition(const std::vector<int>& cores, size_t sessionCount, size_t threadsPerSession);
+
+    // Derives the session layout when the config leaves it at 0. Sessions of four threads keep
+    // GEMMs efficient on the small Marian matrices while more sessions use the remaining cores.
+    static void autoLayout(size_t coreCount, size_t& sessionCount, size_t& threadsPerSession);
+
+    // Pins the calling thread to the given logical CPUs, returns false where that's unsupported
+    static bool pinCurrentThread(const std::vector<int>& cores);
+};
@@ -0,0 +1,135 @@
+#include "DaemonTranslationEngine.h"
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+#include <algorithm>
+#include <map>
+
+DaemonTranslationEngine::DaemonTranslationEngine(const std::filesystem::path& socketPath) : socketPath(socketPath) {}
+
+bool DaemonTranslationEngine::isRunning(const std::filesystem::path& socketPath, std::chrono::milliseconds timeout) {
+    if (!std::filesystem::exists(socketPath)) {
+        return false;
+    }
+
+    try {
+        boost::asio::io_context ioContext;
+        boost::asio::local::stream_protocol::socket socket(ioContext);
+        socket.connect(boost::asio::local::stream_protocol::endpoint(socketPath.string()));
+
+        TranslationProtocol::writeFrame(socket, {{"type", "ping"}});
+        nlohmann::json reply = TranslationProtocol::readFrame(socket, ioContext, timeout);
+        return reply.value("type", "") == "pong";
+    } catch (const std::exception&) {
+        // A stale socket file from a crashed daemon refuses the connection, a hung one never answers
+        return false;
+    }
+}
+
+bool DaemonTranslationEngine::isListening(const std::filesystem::path& socketPath) {
+    if (!std::filesystem::exists(socketPath)) {
+        return false;
+    }
+
+    try {
+        boost::asio::io_context ioContext;
+        boost::asio::local::stream_protocol::socket socket(ioContext);
+        socket.connect(boost::asio::local::stream_protocol::endpoint(socketPath.string()));
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+void DaemonTranslationEngine::shutdown(const std::filesystem::path& socketPath) {
+    try {
+        boost::asio::io_context ioContext;
+        boost::asio::local::stream_protocol::socket socket(ioContext);
+        socket.connect(boost::asio::local::stream_protocol::endpoint(socketPath.string()));
+        TranslationProtocol::writeFrame(socket, {{"type", "shutdown"}});
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to stop translation daemon, Details: " << e.what() << "\n";
+    }
+}
+
+const nlohmann::json& DaemonTranslationEngine::description() const {
+    std::lock_guard<std::mutex> lock(descriptionMutex);
+    if (described) return pong;
+    described = true;
+
+    try {
+        boost::asio::io_context ioContext;
+        boost::asio::local::stream_protocol::socket socket(ioContext);
+        socket.connect(boost::asio::local::stream_protocol::endpoint(socketPath.string()));
+
+        TranslationProtocol::writeFrame(socket, {{"type", "ping"}});
+        pong = TranslationProtocol::readFrame(socket, ioContext, TranslationProtocol::pingTimeout);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to ask the translation daemon for its model, Details: " << e.what() << "\n";
+    }
+    return pong;
+}
+
+std::string DaemonTranslationEngine::modelId() const {
+    const nlohmann::json& reply = description();
+    return reply.is_object() ? reply.value("model", "") : "";
+}
+
+std::string DaemonTranslationEngine::decodingParams() const {
+    const nlohmann::json& reply = description();
+    return reply.is_object() ? reply.value("decodingParams", "") : "";
+}
+
+std::vector<TranslationResult> DaemonTranslationEngine::translate(const std::vector<TranslationSegment>& segments) {
+    return translateStreaming(segments, nullptr);
+}
+
+std::vector<TranslationResult> DaemonTranslationEngine::translateStreaming(const std::vector<TranslationSegment>& segments, const ResultCallback& onResult) {
+    std::vector<TranslationResult> results;
+    results.reserve(segments.size());
+
+    std::cout << "Sending " << segments.size() << " segments to the translation daemon." << "\n";
+
+    // Whatever arrived before a failure is kept, the remaining segments keep their original text
+    try {
+        boost::asio::io_context ioContext;
+        boost::asio::local::stream_protocol::socket socket(ioContext);
+        socket.connect(boost::asio::local::stream_protocol::endpoint(socketPath.string()));
+
+        TranslationProtocol::writeFrame(socket, TranslationProtocol::translateRequest(segments));
+
+        while (true) {
+            nlohmann::json message = TranslationProtocol::readFrame(socket);
+            std::string type = message.value("type", "");
+
+            if (type == "result") {
+                TranslationResult result = TranslationProtocol::resultFromMessage(message);
+                if (onResult) onResult(result);
+                results.push_back(std::move(result));
+            } else if (type == "done") {
+                break;
+            } else if (type == "error") {
+                std::cerr << "Translation daemon error, Details: " << message.value("message", "") << "\n";
+                break;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Lost connection to the translation daemon, Details: " << e.what() << "\n";
+    }
+
+    // The frames arrive in the order the daemon finished the segments, the results keep the input order
+    std::map<std::pair<int, int>, size_t> inputOrder;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        inputOrder.emplace(std::make_pair(segments[i].chapterNum, segments[i].position), i);
+    }
+    std::stable_sort(results.begin(), results.end(), [&](const TranslationResult& a, const TranslationResult& b) {
+        auto first = inputOrder.find({a.chapterNum, a.position});
+        auto second = inputOrder.find({b.chapterNum, b.position});
+        return (first == inputOrder.end() ? segments.size() : first->second) < (second == inputOrder.end() ? segments.size() : second->second);
+    });
+
+    std::cout << "Processed " << results.size() << " results." << "\n";
+    return results;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "TranslationEngine.h"
+#include "TranslationProtocol.h"
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+// Forwards translation requests to a running TranslationDaemon
+class DaemonTranslationEngine : public TranslationEngine {
+public:
+    explicit DaemonTranslationEngine(const std::filesystem::path& socketPath = TranslationProtocol::defaultSocketPath());
+
+    std::vector<TranslationResult> translate(const std::vector<TranslationSegment>& segments) override;
+
+    // Reports each result frame as it arrives, the daemon sends them as its segments finish
+    std::vector<TranslationResult> translateStreaming(const std::vector<TranslationSegment>& segments, const ResultCallback& onResult) override;
+
+    // Those of the daemon's engine, empty when it can't be reached
+    std::string modelId() const override;
+    std::string decodingParams() const override;
+
+    // True when a daemon answers a ping on the socket within timeout
+    static bool isRunning(const std::filesystem::path& socketPath = TranslationProtocol::defaultSocketPath(), std::chrono::milliseconds timeout = TranslationProtocol::pingTimeout);
+
+    // True when something accepts connections on the socket, like a daemon that is busy with
+    // another client and can't answer a ping yet
+    static bool isListening(const std::filesystem::path& socketPath = TranslationProtocol::defaultSocketPath());
+
+    // Asks the daemon to exit after the current client
+    static void shutdown(const std::filesystem::path& socketPath = TranslationProtocol::defaultSocketPath());
+
+protected:
+    // The pong of the daemon, asked for once
+    const nlohmann::json& description() const;
+
+    std::filesystem::path socketPath;
+    mutable std::mutex descriptionMutex;
+    mutable bool described = false;
+    mutable nlohmann::json pong;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "DecodeScheduler.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+DecodeScheduler::DecodeScheduler(size_t slotCount) : slots(std::max<size_t>(1, slotCount), emptySlot) {}
+
+void DecodeScheduler::enqueue(size_t segmentIndex) {
+    pending.push_back(segmentIndex);
+}
+
+std::vector<std::pair<size_t, size_t>> DecodeScheduler::refill() {
+    std::vector<std::pair<size_t, size_t>> assigned;
+    for (size_t slot = 0; slot < slots.size() && !pending.empty(); ++slot) {
+        if (slots[slot] != emptySlot) continue;
+
+        slots[slot] = pending.front();
+        pending.pop_front();
+        ++occupied;
+        assigned.emplace_back(slot, slots[slot]);
+    }
+    return assigned;
+}
+
+void DecodeScheduler::release(size_t slot) {
+    if (slot >= slots.size() || slots[slot] == emptySlot) {
+        throw std::logic_error("Released decode slot " + std::to_string(slot) + " is not in use");
+    }
+    slots[slot] = emptySlot;
+    --occupied;
+}
+
+std::vector<size_t> DecodeScheduler::activeSlots() const {
+    std::vector<size_t> active;
+    active.reserve(occupied);
+    for (size_t slot = 0; slot < slots.size(); ++slot) {
+        if (slots[slot] != emptySlot) {
+            active.push_back(slot);
+        }
+    }
+    return active;
+}
+
+size_t DecodeScheduler::slotsForMemory(uint64_t availableBytes, uint64_t bytesPerSlot, size_t maxSlots) {
+    maxSlots = std::max<size_t>(1, maxSlots);
+    if (availableBytes == 0 || bytesPerSlot == 0) {
+        return maxSlots;
+    }
+    return static_cast<size_t>(std::clamp<uint64_t>(availableBytes / bytesPerSlot, 1, maxSlots));
+}
+
+uint64_t DecodeScheduler::availableMemory() {
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status)) {
+        return status.ullAvailPhys;
+    }
+    return 0;
+#elif defined(__APPLE__)
+    // Free plus inactive pages is what macOS hands out without swapping
+    vm_statistics64_data_t stats;
+    mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+    if (host_statistics64(mach_host_self(), HOST_VM_INFO64, reinterpret_cast<host_info64_t>(&stats), &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return static_cast<uint64_t>(stats.free_count + stats.inactive_count) * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#else
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    uint64_t value = 0;
+    std::string unit;
+    while (meminfo >> key >> value >> unit) {
+        if (key == "MemAvailable:") {
+            return value * 1024;
+        }
+    }
+    return 0;
+#endif
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// Keeps a fixed number of decode slots busy. Segments wait in a FIFO until a slot frees up,
+// so a batch never keeps decoding only the long tail once its short sentences are done.
+class DecodeScheduler {
+public:
+    explicit DecodeScheduler(size_t slotCount);
+
+    void enqueue(size_t segmentIndex);
+
+    // Moves pending segments into every free slot and returns the (slot, segment) pairs it assigned
+    std::vector<std::pair<size_t, size_t>> refill();
+
+    // Frees a slot once its hypothesis emitted EOS or hit the token limit
+    void release(size_t slot);
+
+    // Occupied slots in ascending order, this is the row order of the next decoder batch
+    std::vector<size_t> activeSlots() const;
+
+    size_t segmentInSlot(size_t slot) const { return slots[slot]; }
+    size_t slotCount() const { return slots.size(); }
+    size_t freeSlotCount() const { return slots.size() - occupied; }
+    size_t pendingCount() const { return pending.size(); }
+    bool idle() const { return occupied == 0 && pending.empty(); }
+
+    // Number of slots that fit in the memory budget, at least one and never more than maxSlots
+    static size_t slotsForMemory(uint64_t availableBytes, uint64_t bytesPerSlot, size_t maxSlots);
+
+    // Physical memory the OS reports as available, 0 when it cannot be queried
+    static uint64_t availableMemory();
+
+    static constexpr size_t emptySlot = static_cast<size_t>(-1);
+
+protected:
+    std::vector<size_t> slots;
+    std::deque<size_t> pending;
+    size_t occupied = 0;
+};
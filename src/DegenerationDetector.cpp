@@ -0,0 +1,37 @@
+#include "DegenerationDetector.h"
+
+#include <algorithm>
+
+DegenerationDetector::DegenerationDetector(const DegenerationParams& params) : params(params) {}
+
+bool DegenerationDetector::isDegenerate(const std::vector<int64_t>& tokens) const {
+    if (!params.enabled) return false;
+    return hasLoop(tokens) || hasLowDiversity(tokens);
+}
+
+bool DegenerationDetector::hasLoop(const std::vector<int64_t>& tokens) const {
+    const size_t length = tokens.size() - 1;
+    const size_t repeats = static_cast<size_t>(std::max(2, params.minRepeats));
+
+    // Only loops that end at the newest token matter, older ones were already checked
+    for (size_t period = 1; period <= static_cast<size_t>(params.maxPeriod); ++period) {
+        if (period * repeats > length) break;
+
+        size_t matching = period;
+        while (matching < period * repeats && tokens[tokens.size() - 1 - matching] == tokens[tokens.size() - 1 - matching + period]) {
+            ++matching;
+        }
+        if (matching == period * repeats) return true;
+    }
+    return false;
+}
+
+bool DegenerationDetector::hasLowDiversity(const std::vector<int64_t>& tokens) const {
+    const size_t window = static_cast<size_t>(std::max(0, params.window));
+    if (window == 0 || tokens.size() - 1 < window) return false;
+
+    std::vector<int64_t> recent(tokens.end() - window, tokens.end());
+    std::sort(recent.begin(), recent.end());
+    size_t distinct = std::unique(recent.begin(), recent.end()) - recent.begin();
+    return static_cast<float>(distinct) < params.minDistinctRatio * static_cast<float>(window);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Mirrors the "degeneration" object of translationConfig.json
+struct DegenerationParams {
+    bool enabled = true;
+
+    // A tail that repeats a pattern of up to maxPeriod tokens minRepeats times in a row is a loop
+    int maxPeriod = 8;
+    int minRepeats = 3;
+
+    // no_repeat_ngram_size blocks exact loops, so near-loops are caught by their low diversity:
+    // fewer than minDistinctRatio * window distinct tokens among the last window tokens
+    int window = 32;
+    float minDistinctRatio = 0.25f;
+
+    // Settings of the second decode of a segment that degenerated
+    float retryRepetitionPenalty = 1.3f;
+    int retryNoRepeatNgramSize = 3;
+};
+
+// Watches hypotheses while they are generated so a looping segment stops long before
+// max_new_tokens instead of holding its decode slot
+class DegenerationDetector {
+public:
+    DegenerationDetector() = default;
+    explicit DegenerationDetector(const DegenerationParams& params);
+
+    // tokens starts with the decoder start token like the BeamSearch beams
+    bool isDegenerate(const std::vector<int64_t>& tokens) const;
+
+protected:
+    bool hasLoop(const std::vector<int64_t>& tokens) const;
+    bool hasLowDiversity(const std::vector<int64_t>& tokens) const;
+
+    DegenerationParams params;
+};
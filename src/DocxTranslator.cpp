@@ -87,92 +87,29 @@ int DocxTranslator::run(const std::string& inputPath, const std::string& outputP
     // Extract text nodes from the XML document
     std::vector<TextNode> textNodes = extractTextNodes(root);
 
-    // Save the extracted text to a file
-    std::string textFilePath = "extracted_text.txt";
-    std::string positionFilePath = "position_tags.txt";
-
-    saveTextToFile(textNodes, positionFilePath, textFilePath, langcode);
-
-    std::string chapterNumberMode = "1";
-    
-    //Start the multiprocessing translaton
-    std::filesystem::path translationExe;
-
-    #if defined(__APPLE__)
-        translationExe = "translation";
-
-    #elif defined(_WIN32)
-        translationExe = "translation.exe";
-    #else
-        std::cerr << "Unsupported platform!" << std::endl;
-        return 1; // Or some other error handling
-    #endif
-
-    if (!std::filesystem::exists(translationExe)) {
-        std::cerr << "Executable not found: " << translationExe << std::endl;
-        return 1;
+    // Translate the text nodes in document order, the position is the index of the node
+    std::vector<TranslationSegment> segments;
+    for (size_t i = 0; i < textNodes.size(); ++i) {
+        segments.push_back({0, static_cast<int>(i), ">>" + langcode + "<< " + textNodes[i].text});
     }
 
-    std::string translationExePath = translationExe.string();
-    
-
-    std::cout << "Before call to translation.exe" << '\n';
-
-    boost::process::ipstream pipe_stdout, pipe_stderr;
-
+    // Finished segments are journaled, a run that was interrupted continues where it stopped
+    TranslationJob job(inputDocxPath, "journals", TranslationMemory::shared());
+    std::unordered_multimap<std::string, std::string> translations;
     try {
-        #if defined(_WIN32)
-            boost::process::child c(
-                translationExePath,
-                textFilePath,
-                chapterNumberMode,
-                boost::process::std_out > pipe_stdout, 
-                boost::process::std_err > pipe_stderr,
-                boost::process::windows::hide
-            );
-        #else
-            boost::process::child c(
-                translationExePath,
-                textFilePath,
-                chapterNumberMode,
-                boost::process::std_out > pipe_stdout, 
-                boost::process::std_err > pipe_stderr
-            );
-        #endif
-
-        // Threads to handle asynchronous reading
-        std::thread stdout_thread([&pipe_stdout]() {
-            std::string line;
-            while (std::getline(pipe_stdout, line)) {
-                std::cout << line << "\n";
-            }
-        });
+        std::shared_ptr<TranslationEngine> engine = TranslationEngineFactory::getEngine();
+        std::vector<TranslationResult> results = job.translate(*engine, segments, TranslationEngine::progressReporter(segments.size()));
 
-        std::thread stderr_thread([&pipe_stderr]() {
-            std::string line;
-            while (std::getline(pipe_stderr, line)) {
-                std::cerr << "Python stderr: " << line << "\n";
-            }
-        });
-
-        c.wait(); // Wait for process completion
-
-        stdout_thread.join();
-        stderr_thread.join();
-
-        if (c.exit_code() == 0) {
-            std::cout << "Translation Python script executed successfully." << "\n";
-        } else {
-            std::cerr << "Translation Python script exited with code: " << c.exit_code() << "\n";
+        for (const auto& result : results) {
+            translations.insert({textNodes[result.position].path, result.text});
         }
     } catch (const std::exception& ex) {
-        std::cerr << "Exception: " << ex.what() << "\n";
+        std::cerr << "Translation engine error: " << ex.what() << "\n";
+        xmlFreeDoc(doc);
+        return 1;
     }
 
-    std::cout << "After call to translation.exe" << '\n';
-
-    // Load the translations
-    std::unordered_multimap<std::string, std::string> translations = loadTranslations(positionFilePath, "translatedTags.txt");
+    std::cout << "Loaded " << translations.size() << " translations.\n";
     
     escapeTranslations(translations);
 
@@ -199,6 +136,7 @@ int DocxTranslator::run(const std::string& inputPath, const std::string& outputP
     std::cout << "Modified XML document saved to: " << documentXmlPath << "\n";
 
     exportDocx(unzippedPath, outputPath);
+    job.finish();
 
     
     // End timer
@@ -208,9 +146,6 @@ int DocxTranslator::run(const std::string& inputPath, const std::string& outputP
 
     // // Cleanup
     std::filesystem::remove_all(unzippedPath);
-    std::filesystem::remove(positionFilePath);
-    std::filesystem::remove(textFilePath);
-    std::filesystem::remove("translatedTags.txt");
 
     return 0;
 }
@@ -330,77 +265,6 @@ std::vector<TextNode> DocxTranslator::extractTextNodes(xmlNode *root) {
 }
 
 
-void DocxTranslator::saveTextToFile(const std::vector<TextNode> &nodes, const std::string &positionFilename, const std::string &textFilename, const std::string &langcode) {
-    std::ofstream positionFile(positionFilename);
-    std::ofstream textFile(textFilename);
-
-    if (!positionFile.is_open() || !textFile.is_open()) {
-        std::cerr << "Error opening output files.\n";
-        return;
-    }
-
-    int counterNum = 1;
-    for (const auto &node : nodes) {
-        // Write to positionTags.txt: "counterNum,node.path"
-        positionFile << counterNum << "," << node.path << "\n";
-        // Write to extracted_text.txt: "counterNum,node.text"
-        textFile << counterNum << ",>>" << langcode << "<< " << node.text << "\n";
-        ++counterNum;
-    }
-
-    positionFile.close();
-    textFile.close();
-
-    std::cout << "Positions saved to " << positionFilename << std::endl;
-    std::cout << "Texts saved to " << textFilename << std::endl;
-}
-
-
-std::unordered_multimap<std::string, std::string> DocxTranslator::loadTranslations(const std::string &positionFilename, const std::string &textFilename) {
-
-    std::unordered_multimap<std::string, std::string> translations;
-
-    std::ifstream positionFile(positionFilename);
-    std::ifstream textFile(textFilename);
-
-    if (!positionFile.is_open() || !textFile.is_open()) {
-        std::cerr << "Error opening translation files.\n";
-        return translations;
-    }
-
-    std::string positionLine, textLine;
-
-    while (std::getline(positionFile, positionLine) && std::getline(textFile, textLine)) {
-        // Parse position line: "counterNum,node.path"
-        size_t posDelimiter = positionLine.find(',');
-        if (posDelimiter == std::string::npos) continue;
-
-        std::string posCounter = positionLine.substr(0, posDelimiter);
-        std::string nodePath = positionLine.substr(posDelimiter + 1);
-
-        // Parse text line: "counterNum,node.text"
-        size_t textDelimiter = textLine.find(',');
-        if (textDelimiter == std::string::npos) continue;
-
-        std::string textCounter = textLine.substr(0, textDelimiter);
-        std::string nodeText = textLine.substr(textDelimiter + 1);
-
-        // Match counterNum before inserting
-        if (posCounter == textCounter) {
-            translations.insert({nodePath, nodeText});
-        } else {
-            std::cerr << "Mismatched counters: Position " << posCounter 
-                      << " vs Text " << textCounter << "\n";
-        }
-    }
-
-    positionFile.close();
-    textFile.close();
-
-    std::cout << "Loaded " << translations.size() << " translations.\n";
-    return translations;
-}
-
 // Helper function to update text content and language attribute
 void DocxTranslator::updateNodeWithTranslation(xmlNode *node, const std::string &translation) {
     // Replace text content
@@ -16,19 +16,16 @@
 #include <condition_variable>
 #include <thread>
 #include <cstdlib>
-#include <boost/process.hpp>
 #include <boost/filesystem.hpp>
 #include <sstream>
 #include <iostream>
 #include <curl/curl.h>
 #include "Translator.h"
+#include "TranslationEngineFactory.h"
+#include "TranslationJob.h"
 #include <nlohmann/json.hpp>
 #include <unordered_set>
 
-#ifdef _WIN32
-#include <boost/process/windows.hpp>
-#endif
-
 
 struct TextNode {
     std::string path;
@@ -56,8 +53,6 @@ protected:
     std::string getNodePath(xmlNode *node);
     void extractTextNodesRecursive(xmlNode *node, std::vector<TextNode> &nodes);
     std::vector<TextNode> extractTextNodes(xmlNode *root);
-    void saveTextToFile(const std::vector<TextNode> &nodes, const std::string &positionFilename, const std::string &textFilename, const std::string &langcode);
-    std::unordered_multimap<std::string, std::string> loadTranslations(const std::string &positionFilename, const std::string &textFilename);
     void updateNodeWithTranslation(xmlNode *node, const std::string &translation);
     void traverseAndReinsert(xmlNode *node, std::unordered_multimap<std::string, std::string> &translations, std::unordered_map<std::string, std::unordered_multimap<std::string, std::string>::iterator> &lastUsed);
     void reinsertTranslations(xmlNode *root, std::unordered_multimap<std::string, std::string> &translations);
@@ -1287,25 +1287,14 @@ int EpubTranslator::handleDeepLRequest(const std::vector<tagData>& bookTags, con
 
     std::cout << "Running local model translation for Japanese text" << "\n";
 
-    std::string rawTagsPathString = "rawTags.txt";
-    std::string translatedTagsPathString = "translatedTags.txt";
-
-    // Write out a file of the raw tags
-    std::filesystem::path rawTagsPath = rawTagsPathString;
-    std::ofstream rawTagsFile(rawTagsPath);
-    if (!rawTagsFile.is_open()) {
-        std::cerr << "Failed to open file for writing: " << rawTagsPath << "\n";
-        return 1;
-    }
-
-    std::cout << "Writing raw tags to file: " << rawTagsPath << "\n";
+    // Send the original text of the untranslated tags to the local model
+    std::vector<TranslationSegment> segments;
     for (const auto& tag : notTranslatedTags) {
         auto chapterIt = positionMap.find(tag.chapterNum);
         if (chapterIt != positionMap.end()) {  // Check if chapter exists
             auto positionIt = chapterIt->second.find(tag.position);
             if (positionIt != chapterIt->second.end() && positionIt->second != nullptr) {  // Check if position exists
-                std::string originalText = positionIt->second->text;
-                rawTagsFile << tag.tagId << "," << tag.chapterNum << "," << tag.position << "," << originalText << "\n";
+                segments.push_back({tag.chapterNum, tag.position, positionIt->second->text});
             } else {
                 std::cerr << "Warning: Missing position in positionMap for Chapter: " 
                           << tag.chapterNum << ", Position: " << tag.position << "\n";
@@ -1314,124 +1303,23 @@ int EpubTranslator::handleDeepLRequest(const std::vector<tagData>& bookTags, con
             std::cerr << "Warning: Missing chapter in positionMap for Chapter: " << tag.chapterNum << "\n";
         }
     }
-    
-    std::cout << "Raw tags written to file: " << rawTagsPath << "\n";
-
-    rawTagsFile.close();
-
-
-
-
-    //Start the multiprocessing translaton
-    std::filesystem::path translationExe;
-    std::string chapterNumberMode = "0";
-    #if defined(__APPLE__)
-        translationExe = "translation";
-
-    #elif defined(_WIN32)
-        translationExe = "translation.exe";
-    #else
-        std::cerr << "Unsupported platform!" << std::endl;
-        return 1; // Or some other error handling
-    #endif
-
-    if (!std::filesystem::exists(translationExe)) {
-        std::cerr << "Executable not found: " << translationExe << std::endl;
-        return 1;
-    }
-
-    std::string translationExePath = translationExe.string();
-    
-
-    std::cout << "Before call to translation.py" << '\n';
-
-    boost::process::ipstream pipe_stdout, pipe_stderr;
-
-    try {
-        #if defined(_WIN32)
-            boost::process::child c(
-                translationExePath,
-                rawTagsPathString,
-                chapterNumberMode,
-                boost::process::std_out > pipe_stdout, 
-                boost::process::std_err > pipe_stderr,
-                boost::process::windows::hide
-            );
-        #else
-            boost::process::child c(
-                translationExePath,
-                rawTagsPathString,
-                chapterNumberMode,
-                boost::process::std_out > pipe_stdout, 
-                boost::process::std_err > pipe_stderr
-            );
-        #endif
-
-        // Threads to handle asynchronous reading
-        std::thread stdout_thread([&pipe_stdout]() {
-            std::string line;
-            while (std::getline(pipe_stdout, line)) {
-                std::cout << line << "\n";
-            }
-        });
-
-        std::thread stderr_thread([&pipe_stderr]() {
-            std::string line;
-            while (std::getline(pipe_stderr, line)) {
-                std::cerr << "Python stderr: " << line << "\n";
-            }
-        });
-
-        c.wait(); // Wait for process completion
-
-        stdout_thread.join();
-        stderr_thread.join();
-
-        if (c.exit_code() == 0) {
-            std::cout << "Translation Python script executed successfully." << "\n";
-        } else {
-            std::cerr << "Translation Python script exited with code: " << c.exit_code() << "\n";
-        }
-    } catch (const std::exception& ex) {
-        std::cerr << "Exception: " << ex.what() << "\n";
-    }
-
-    std::cout << "After call to translation.py" << '\n';
 
     std::vector<decodedData> decodedDataVector;
-    std::ifstream file(translatedTagsPathString);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open file: " << translatedTagsPathString << "\n";
-        return 1;
-    }
-
-    std::string line;
-    while (std::getline(file, line)) {
-        std::istringstream lineStream(line);
-        std::string chapterNumStr, positionStr, text;
-
-        // Extract chapterNum (first value)
-        if (!std::getline(lineStream, chapterNumStr, ',')) continue;
-
-        // Extract position (second value)
-        if (!std::getline(lineStream, positionStr, ',')) continue;
-
-        // The rest of the line is text
-        std::getline(lineStream, text);
+    try {
+        std::shared_ptr<TranslationEngine> engine = TranslationEngineFactory::getEngine();
+        std::vector<TranslationResult> results = engine->translateStreaming(segments, TranslationEngine::progressReporter(segments.size()));
 
-        // Convert chapterNum and position to integers
-        try {
+        for (const auto& result : results) {
             decodedData data;
-            data.chapterNum = std::stoi(chapterNumStr);
-            data.position = std::stoi(positionStr);
-            data.output = text;
-            // Store the extracted data
+            data.chapterNum = result.chapterNum;
+            data.position = result.position;
+            data.output = result.text;
             decodedDataVector.push_back(data);
-        } catch (const std::exception& e) {
-            std::cerr << "Error parsing line: " << line << " - " << e.what() << "\n";
         }
+    } catch (const std::exception& ex) {
+        std::cerr << "Translation engine error: " << ex.what() << "\n";
+        return 1;
     }
-    file.close();
 
     // Create translatedPositionsMap out of translatedTags
     std::vector<std::vector<tagData>> translatedChapterTags;
@@ -1584,7 +1472,6 @@ void EpubTranslator::addTitleAndAuthor(const char* filename, const std::string&
 int EpubTranslator::run(const std::string& epubToConvert, const std::string& outputEpubPath, int localModel, const std::string& deepLKey, std::string langcode) {
     std::cout << "langcode: " << langcode << "\n";
     std::cout << "localModel: " << localModel << "\n";
-    std::filesystem::path currentDirPath = std::filesystem::current_path();
 
     std::cout << "Running the EPUB conversion process..." << "\n";
     std::cout << "epubToConvert: " << epubToConvert << "\n";
@@ -1593,8 +1480,6 @@ int EpubTranslator::run(const std::string& epubToConvert, const std::string& out
     std::string unzippedPath = "unzipped";
     std::string templatePath = "export";
     std::string templateEpub = "rawEpub/template.epub";
-    std::string rawTagsPathString = "rawTags.txt";
-    std::string translatedTagsPathString = "translatedTags.txt";
 
     // Check if the unzipped directory already exists
     if (std::filesystem::exists(unzippedPath)) {
@@ -1848,8 +1733,6 @@ int EpubTranslator::run(const std::string& epubToConvert, const std::string& out
         std::filesystem::remove_all(templatePath);
         std::filesystem::remove_all("translatedHTML");
         std::filesystem::remove_all("testHTML");
-        std::filesystem::remove(rawTagsPathString);
-        std::filesystem::remove(translatedTagsPathString);
         std::filesystem::remove(bookDetailsPath);
 
         auto end = std::chrono::high_resolution_clock::now();
@@ -1862,135 +1745,34 @@ int EpubTranslator::run(const std::string& epubToConvert, const std::string& out
 
 
 
-    // Write out a file of the raw tags
-    std::filesystem::path rawTagsPath = rawTagsPathString;
-    std::ofstream rawTagsFile(rawTagsPath);
-    if (!rawTagsFile.is_open()) {
-        std::cerr << "Failed to open file for writing: " << rawTagsPath << "\n";
-        return 1;
-    }
-
-    for (auto& tag : bookTags) {
-        if (tag.tagId == IMG_TAG) {
-            rawTagsFile <<  tag.tagId << "," << tag.chapterNum << "," << tag.position << "," << tag.text << "\n";
-        } else if (tag.tagId == P_TAG) {
-            rawTagsFile <<  tag.tagId << "," << tag.chapterNum << "," << tag.position << "," << ">>" << langcode << "<< " << tag.text << "\n";
+    // Collect the text of the <p> tags for the translation engine, image tags are kept as they are
+    std::vector<TranslationSegment> segments;
+    for (const auto& tag : bookTags) {
+        if (tag.tagId == P_TAG) {
+            segments.push_back({tag.chapterNum, tag.position, ">>" + langcode + "<< " + tag.text});
         }
     }
-    rawTagsFile.close();
-    
-    std::string chapterNumberMode = "0";
-    
-    //Start the multiprocessing translaton
-    std::filesystem::path translationExe;
-
-    #if defined(__APPLE__)
-        translationExe = currentDirPath / "translation";
-
-    #elif defined(_WIN32)
-        translationExe = currentDirPath / "translation.exe";
-    #else
-        std::cerr << "Unsupported platform!" << std::endl;
-        return 1; // Or some other error handling
-    #endif
-
-    if (!std::filesystem::exists(translationExe)) {
-        std::cerr << "Executable not found: " << translationExe << std::endl;
-        return 1;
-    }
-
-    std::string translationExePath = translationExe.string();
-    
-
-    std::cout << "Before call to translation.exe" << '\n';
-
-    boost::process::ipstream pipe_stdout, pipe_stderr;
 
+    // Finished segments are journaled, a run that was interrupted continues where it stopped
+    TranslationJob job(std::filesystem::u8path(epubToConvert), "journals", TranslationMemory::shared());
+    std::vector<decodedData> decodedDataVector;
     try {
-        #if defined(_WIN32)
-            boost::process::child c(
-                translationExePath,
-                rawTagsPathString,
-                chapterNumberMode,
-                boost::process::std_out > pipe_stdout, 
-                boost::process::std_err > pipe_stderr,
-                boost::process::windows::hide
-            );
-        #else
-            boost::process::child c(
-                translationExePath,
-                rawTagsPathString,
-                chapterNumberMode,
-                boost::process::std_out > pipe_stdout, 
-                boost::process::std_err > pipe_stderr
-            );
-        #endif
-
-        // Threads to handle asynchronous reading
-        std::thread stdout_thread([&pipe_stdout]() {
-            std::string line;
-            while (std::getline(pipe_stdout, line)) {
-                std::cout <<  line << "\n";
-            }
-        });
-
-        std::thread stderr_thread([&pipe_stderr]() {
-            std::string line;
-            while (std::getline(pipe_stderr, line)) {
-                std::cerr << "Python stderr: " << line << "\n";
-            }
-        });
-
-        c.wait(); // Wait for process completion
-
-        stdout_thread.join();
-        stderr_thread.join();
+        std::shared_ptr<TranslationEngine> engine = TranslationEngineFactory::getEngine();
+        std::vector<TranslationResult> results = job.translate(*engine, segments, TranslationEngine::progressReporter(segments.size()));
 
-        if (c.exit_code() == 0) {
-            std::cout << "Translation Python script executed successfully." << "\n";
-        } else {
-            std::cerr << "Translation Python script exited with code: " << c.exit_code() << "\n";
+        for (const auto& result : results) {
+            decodedData data;
+            data.chapterNum = result.chapterNum;
+            data.position = result.position;
+            data.output = result.text;
+            decodedDataVector.push_back(data);
         }
     } catch (const std::exception& ex) {
-        std::cerr << "Exception: " << ex.what() << "\n";
-    }
-
-    std::cout << "After call to translation.exe" << '\n';
-
-    std::vector<decodedData> decodedDataVector;
-    std::ifstream file(translatedTagsPathString);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open file: " << translatedTagsPathString << "\n";
+        std::cerr << "Translation engine error: " << ex.what() << "\n";
         return 1;
     }
 
-    std::string line;
-    while (std::getline(file, line)) {
-        std::istringstream lineStream(line);
-        std::string chapterNumStr, positionStr, text;
-
-        // Extract chapterNum (first value)
-        if (!std::getline(lineStream, chapterNumStr, ',')) continue;
-
-        // Extract position (second value)
-        if (!std::getline(lineStream, positionStr, ',')) continue;
-
-        // The rest of the line is text
-        std::getline(lineStream, text);
-
-        // Convert chapterNum and position to integers
-        try {
-            decodedData data;
-            data.chapterNum = std::stoi(chapterNumStr);
-            data.position = std::stoi(positionStr);
-            data.output = text;
-            // Store the extracted data
-            decodedDataVector.push_back(data);
-        } catch (const std::exception& e) {
-            std::cerr << "Error parsing line: " << line << " - " << e.what() << "\n";
-        }
-    }
-    file.close();
+    std::cout << "Translated " << decodedDataVector.size() << " of " << segments.size() << " segments" << "\n";
 
 
 
@@ -2073,6 +1855,7 @@ int EpubTranslator::run(const std::string& epubToConvert, const std::string& out
 
     // Zip export directory to create the final EPUB file
     exportEpub(templatePath, outputEpubPath);
+    job.finish();
 
     // // Remove the unzipped and export directories
     std::filesystem::remove_all(unzippedPath);
@@ -2081,14 +1864,6 @@ int EpubTranslator::run(const std::string& epubToConvert, const std::string& out
 
     // // Remove the temp text files
     try {
-        if (std::filesystem::exists(translatedTagsPathString)) {
-            std::filesystem::remove(translatedTagsPathString);
-            std::cout << "Deleted file: " << translatedTagsPathString << "\n";
-        }
-        if (std::filesystem::exists(rawTagsPathString)) {
-            std::filesystem::remove(rawTagsPathString);
-            std::cout << "Deleted file: " << rawTagsPathString << "\n";
-        }
         if (std::filesystem::exists(bookDetailsPath)) {
             std::filesystem::remove(bookDetailsPath);
             std::cout << "Deleted file: " << bookDetailsPath << "\n";
@@ -16,19 +16,16 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <cstdlib>
-#include <boost/process.hpp>
 #include <boost/filesystem.hpp>
 #include <sstream>
 #include <iostream>
 #include <curl/curl.h>
 #include "Translator.h"
+#include "TranslationEngineFactory.h"
+#include "TranslationJob.h"
 #include <nlohmann/json.hpp>
 #include <unordered_set>
 
-#ifdef _WIN32
-#include <boost/process/windows.hpp>
-#endif
-
 
 #define P_TAG 0
 #define IMG_TAG 1
@@ -0,0 +1,90 @@
+#include "GraphCache.h"
+
+GraphCache::GraphCache(const std::filesystem::path& directory) : directory(directory) {}
+
+uint64_t GraphCache::modelHash(const std::filesystem::path& modelPath) {
+    std::filesystem::path hashesPath = directory / "model-hashes.json";
+    std::string key = std::filesystem::absolute(modelPath).string();
+    uintmax_t size = std::filesystem::file_size(modelPath);
+    long long modified = static_cast<long long>(std::filesystem::last_write_time(modelPath).time_since_epoch().count());
+
+    nlohmann::json hashes = nlohmann::json::object();
+    std::ifstream hashesFile(hashesPath);
+    if (hashesFile.is_open()) {
+        hashes = nlohmann::json::parse(hashesFile, nullptr, false);
+        if (hashes.is_discarded() || !hashes.is_object()) {
+            hashes = nlohmann::json::object();
+        }
+        hashesFile.close();
+    }
+
+    if (hashes.contains(key)) {
+        const nlohmann::json& entry = hashes[key];
+        if (entry.value("size", uintmax_t(0)) == size && entry.value("modified", 0LL) == modified) {
+            return std::stoull(entry.value("hash", "0"), nullptr, 16);
+        }
+    }
+
+    uint64_t hash = Hashing::hashFile(modelPath);
+    hashes[key] = {{"size", size}, {"modified", modified}, {"hash", Hashing::toHex(hash)}};
+
+    std::filesystem::create_directories(directory);
+    std::ofstream(hashesPath) << hashes.dump(4);
+    return hash;
+}
+
+std::string GraphCache::cacheKey(const std::filesystem::path& modelPath) {
+    return Hashing::toHex(modelHash(modelPath)) + "-ort" + Ort::GetVersionString() + "-" + CpuFeatures::featureString();
+}
+
+std::filesystem::path GraphCache::cachedGraphPath(const std::filesystem::path& modelPath) {
+    return directory / cacheKey(modelPath) / (modelPath.stem().string() + ".ort");
+}
+
+std::unique_ptr<Ort::Session> GraphCache::createSession(Ort::Env& env, const std::filesystem::path& modelPath, const Ort::SessionOptions& options) {
+    std::filesystem::path cachedPath = cachedGraphPath(modelPath);
+
+    if (std::filesystem::exists(cachedPath)) {
+        try {
+            // The cached graph already went through ORT_ENABLE_ALL
+            Ort::SessionOptions cachedOptions = options.Clone();
+            cachedOptions.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+            auto session = std::make_unique<Ort::Session>(env, cachedPath.c_str(), cachedOptions);
+            std::cout << "Loaded cached graph " << cachedPath.string() << "\n";
+            return session;
+        } catch (const Ort::Exception& e) {
+            std::cerr << "Discarding unreadable cached graph " << cachedPath.string() << ", Details: " << e.what() << "\n";
+            std::error_code ec;
+            std::filesystem::remove(cachedPath, ec);
+        }
+    }
+
+    std::filesystem::create_directories(cachedPath.parent_path());
+
+    // ORT writes the graph while it builds the session, a crash mid-write must not leave a
+    // truncated file under the final name
+    std::filesystem::path temporaryPath = cachedPath;
+    temporaryPath += ".tmp";
+
+    try {
+        Ort::SessionOptions saveOptions = options.Clone();
+        saveOptions.SetOptimizedModelFilePath(temporaryPath.c_str());
+        saveOptions.AddConfigEntry("session.save_model_format", "ORT");
+        auto session = std::make_unique<Ort::Session>(env, modelPath.c_str(), saveOptions);
+
+        std::error_code ec;
+        std::filesystem::rename(temporaryPath, cachedPath, ec);
+        if (ec) {
+            std::cerr << "Failed to cache optimized graph " << cachedPath.string() << ", Details: " << ec.message() << "\n";
+        } else {
+            std::cout << "Cached optimized graph " << cachedPath.string() << "\n";
+        }
+        return session;
+    } catch (const Ort::Exception& e) {
+        std::cerr << "Failed to cache optimized graph " << cachedPath.string() << ", Details: " << e.what() << "\n";
+        std::error_code ec;
+        std::filesystem::remove(temporaryPath, ec);
+    }
+
+    return std::make_unique<Ort::Session>(env, modelPath.c_str(), options);
+}
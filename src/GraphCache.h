@@ -0,0 +1,32 @@
+#pragma once
+
+#include <onnxruntime_cxx_api.h>
+#include <nlohmann/json.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "CpuFeatures.h"
+#include "Hashing.h"
+
+// Stores ORT_ENABLE_ALL optimized graphs in ORT format so later starts skip the optimizer.
+// Entries live in <directory>/<model hash>-ort<version>-<cpu features>/, the optimized graph
+// is hardware specific so a different CPU or ORT build never picks up a stale entry.
+class GraphCache {
+public:
+    explicit GraphCache(const std::filesystem::path& directory = "ort-cache");
+
+    // Loads the cached graph of modelPath or creates the session from the model and caches it
+    std::unique_ptr<Ort::Session> createSession(Ort::Env& env, const std::filesystem::path& modelPath, const Ort::SessionOptions& options);
+
+    std::string cacheKey(const std::filesystem::path& modelPath);
+    std::filesystem::path cachedGraphPath(const std::filesystem::path& modelPath);
+
+protected:
+    // Hashing a few hundred MB of weights costs more than the cache saves, so the content hash
+    // is remembered per file size and modification time
+    uint64_t modelHash(const std::filesystem::path& modelPath);
+
+    std::filesystem::path directory;
+};
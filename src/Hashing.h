@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// 64-bit FNV-1a, stable across platforms and runs so it can key files on disk
+class Hashing {
+public:
+    static constexpr uint64_t fnvOffset = 14695981039346656037ULL;
+    static constexpr uint64_t fnvPrime = 1099511628211ULL;
+
+    static uint64_t fnv1a64(const void* data, size_t size, uint64_t hash = fnvOffset) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= fnvPrime;
+        }
+        return hash;
+    }
+
+    static uint64_t fnv1a64(const std::string& text, uint64_t hash = fnvOffset) {
+        return fnv1a64(text.data(), text.size(), hash);
+    }
+
+    static uint64_t hashFile(const std::filesystem::path& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open file for hashing: " + path.string());
+        }
+
+        uint64_t hash = fnvOffset;
+        std::vector<char> buffer(1 << 20);
+        while (file) {
+            file.read(buffer.data(), buffer.size());
+            hash = fnv1a64(buffer.data(), static_cast<size_t>(file.gcount()), hash);
+        }
+        return hash;
+    }
+
+    static std::string toHex(uint64_t hash) {
+        std::ostringstream stream;
+        stream << std::hex << std::setw(16) << std::setfill('0') << hash;
+        return stream.str();
+    }
+};
@@ -0,0 +1,131 @@
+#include "LexicalShortlist.h"
+#include "MarianTokenizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+// Reads little endian values, both files are written by buildShortlist.py with struct '<'
+template <typename T>
+static T readValue(std::ifstream& file) {
+    T value{};
+    file.read(reinterpret_cast<char*>(&value), sizeof(T));
+    if (!file) {
+        throw std::runtime_error("Unexpected end of shortlist file");
+    }
+    return value;
+}
+
+static void readMagic(std::ifstream& file, const char* magic, const std::filesystem::path& path) {
+    char header[4] = {};
+    file.read(header, sizeof(header));
+    if (!file || std::memcmp(header, magic, sizeof(header)) != 0 || readValue<uint32_t>(file) != 1) {
+        throw std::runtime_error("Unsupported shortlist file: " + path.string());
+    }
+}
+
+LexicalShortlist::LexicalShortlist(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open lexical shortlist: " + path.string());
+    }
+    readMagic(file, "LXSL", path);
+
+    uint32_t frequentCount = readValue<uint32_t>(file);
+    frequent.reserve(frequentCount);
+    for (uint32_t i = 0; i < frequentCount; ++i) {
+        frequent.push_back(readValue<int32_t>(file));
+    }
+
+    uint32_t sourceCount = readValue<uint32_t>(file);
+    for (uint32_t i = 0; i < sourceCount; ++i) {
+        int64_t source = readValue<int32_t>(file);
+        uint32_t targetCount = readValue<uint32_t>(file);
+        std::vector<int64_t>& sourceTargets = targets[source];
+        sourceTargets.reserve(targetCount);
+        for (uint32_t j = 0; j < targetCount; ++j) {
+            sourceTargets.push_back(readValue<int32_t>(file));
+        }
+    }
+}
+
+std::vector<int64_t> LexicalShortlist::candidates(const std::vector<const std::vector<int64_t>*>& sources) const {
+    std::vector<int64_t> result = frequent;
+    result.push_back(MARIAN_EOS_ID);
+    for (const std::vector<int64_t>* source : sources) {
+        for (int64_t token : *source) {
+            auto entry = targets.find(token);
+            if (entry != targets.end()) {
+                result.insert(result.end(), entry->second.begin(), entry->second.end());
+            }
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+OutputProjection::OutputProjection(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open output projection: " + path.string());
+    }
+    readMagic(file, "LMHD", path);
+
+    int64_t vocab = readValue<int64_t>(file);
+    modelSize = readValue<int64_t>(file);
+    weights.resize(static_cast<size_t>(vocab * modelSize));
+    bias.resize(static_cast<size_t>(vocab));
+    file.read(reinterpret_cast<char*>(weights.data()), weights.size() * sizeof(float));
+    file.read(reinterpret_cast<char*>(bias.data()), bias.size() * sizeof(float));
+    if (!file) {
+        throw std::runtime_error("Truncated output projection: " + path.string());
+    }
+}
+
+OutputProjection::OutputProjection(std::vector<float> weights, std::vector<float> bias, int64_t hiddenSize)
+    : weights(std::move(weights)), bias(std::move(bias)), modelSize(hiddenSize) {}
+
+void OutputProjection::project(const float* hidden, size_t rows, const std::vector<int64_t>& candidates, float* logits) const {
+    const int64_t vocab = vocabSize();
+    const bool full = candidates.empty();
+    const size_t count = full ? static_cast<size_t>(vocab) : candidates.size();
+
+    if (!full) {
+        std::fill(logits, logits + rows * vocab, -std::numeric_limits<float>::infinity());
+    }
+
+    // Candidates are processed in blocks so their weight rows stay in cache for every row
+    const size_t blockSize = 64;
+    for (size_t blockStart = 0; blockStart < count; blockStart += blockSize) {
+        size_t blockEnd = std::min(count, blockStart + blockSize);
+        for (size_t row = 0; row < rows; ++row) {
+            const float* state = hidden + row * modelSize;
+            for (size_t i = blockStart; i < blockEnd; ++i) {
+                int64_t token = full ? static_cast<int64_t>(i) : candidates[i];
+                const float* weight = weights.data() + token * modelSize;
+
+                // Independent partial sums let the compiler vectorize without reassociating
+                float sums[8] = {};
+                int64_t k = 0;
+                for (; k + 8 <= modelSize; k += 8) {
+                    for (int lane = 0; lane < 8; ++lane) {
+                        sums[lane] += state[k + lane] * weight[k + lane];
+                    }
+                }
+                float sum = 0.0f;
+                for (; k < modelSize; ++k) {
+                    sum += state[k] * weight[k];
+                }
+                for (float partial : sums) {
+                    sum += partial;
+                }
+                logits[row * vocab + token] = sum + bias[token];
+            }
+        }
+    }
+}
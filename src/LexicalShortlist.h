@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Source token to target token table written by buildShortlist.py. A batch may only produce the
+// targets its source tokens co-occurred with in the fine-tuning data and the most frequent ones.
+class LexicalShortlist {
+public:
+    LexicalShortlist() = default;
+    explicit LexicalShortlist(const std::filesystem::path& path);
+
+    // Sorted candidates for the given sources, EOS is always one of them
+    std::vector<int64_t> candidates(const std::vector<const std::vector<int64_t>*>& sources) const;
+
+    bool empty() const { return frequent.empty() && targets.empty(); }
+
+protected:
+    std::vector<int64_t> frequent;
+    std::unordered_map<int64_t, std::vector<int64_t>> targets;
+};
+
+// The decoder's output projection, applied outside the graph so only candidate logits are computed
+class OutputProjection {
+public:
+    OutputProjection() = default;
+    explicit OutputProjection(const std::filesystem::path& path);
+    OutputProjection(std::vector<float> weights, std::vector<float> bias, int64_t hiddenSize);
+
+    // Writes the logits of the candidates into the [rows, vocab] logits and -inf everywhere else.
+    // An empty candidate list projects onto the whole vocabulary.
+    void project(const float* hidden, size_t rows, const std::vector<int64_t>& candidates, float* logits) const;
+
+    int64_t vocabSize() const { return static_cast<int64_t>(bias.size()); }
+    int64_t hiddenSize() const { return modelSize; }
+
+protected:
+    // [vocab, hidden], each candidate reads one contiguous row
+    std::vector<float> weights;
+    std::vector<float> bias;
+    int64_t modelSize = 0;
+};
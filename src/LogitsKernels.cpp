@@ -0,0 +1,326 @@
+#include "LogitsKernels.h"
+#include "Hashing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// Without fma in the target the compiler can't fuse a multiply and an add, which would round
+// differently from the scalar version
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+// Cephes expf: exp(x) = 2^n * exp(r) with r = x - n * ln 2 split into two constants, and a degree 6
+// polynomial for exp(r). Every step is a single rounded operation so the vector version matches.
+static const float expHigh = 88.3762626647949f;
+static const float expLow = -88.3762626647949f;
+static const float log2e = 1.44269504088896341f;
+static const float ln2High = 0.693359375f;
+static const float ln2Low = -2.12194440e-4f;
+static const float expCoefficients[6] = {1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f};
+
+// The 8 partial sums of a log-softmax are added in this order by both versions
+static double sumLanes(const double* lanes) {
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+static void pushCandidate(std::vector<std::pair<float, size_t>>& best, size_t k, float score, size_t index) {
+    auto worseFirst = [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first > b.first; };
+    if (best.size() == k && score <= best.front().first) return;
+    best.emplace_back(score, index);
+    std::push_heap(best.begin(), best.end(), worseFirst);
+    if (best.size() > k) {
+        std::pop_heap(best.begin(), best.end(), worseFirst);
+        best.pop_back();
+    }
+}
+
+static void sortCandidates(std::vector<std::pair<float, size_t>>& best) {
+    auto worseFirst = [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first > b.first; };
+    std::sort_heap(best.begin(), best.end(), worseFirst);
+}
+
+LogitsKernels::LogitsKernels(bool useAvx2) {
+#if defined(__x86_64__) || defined(_M_X64)
+    this->useAvx2 = useAvx2;
+#else
+    (void)useAvx2;
+#endif
+}
+
+float LogitsKernels::expApprox(float x) {
+    // Written like minps and maxps so NaN and the clamps behave as in the vector version
+    x = x < expHigh ? x : expHigh;
+    x = x > expLow ? x : expLow;
+
+    float n = std::floor(x * log2e + 0.5f);
+    float high = n * ln2High;
+    x = x - high;
+    float low = n * ln2Low;
+    x = x - low;
+
+    float square = x * x;
+    float y = expCoefficients[0];
+    for (int i = 1; i < 6; ++i) {
+        y = y * x;
+        y = y + expCoefficients[i];
+    }
+    y = y * square;
+    y = y + x;
+    y = y + 1.0f;
+
+    uint32_t bits = static_cast<uint32_t>(static_cast<int32_t>(n) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return y * scale;
+}
+
+void LogitsKernels::logSoftmax(float* scores, size_t count) const {
+#if defined(__x86_64__) || defined(_M_X64)
+    if (useAvx2) return logSoftmaxAvx2(scores, count);
+#endif
+    logSoftmaxScalar(scores, count);
+}
+
+void LogitsKernels::addScalar(float* scores, size_t count, float value) const {
+#if defined(__x86_64__) || defined(_M_X64)
+    if (useAvx2) return addScalarAvx2(scores, count, value);
+#endif
+    addScalarScalar(scores, count, value);
+}
+
+void LogitsKernels::topK(const float* scores, size_t count, size_t k, std::vector<std::pair<float, size_t>>& best) const {
+#if defined(__x86_64__) || defined(_M_X64)
+    if (useAvx2) return topKAvx2(scores, count, k, best);
+#endif
+    topKScalar(scores, count, k, best);
+}
+
+void LogitsKernels::repetitionPenalty(float* scores, const std::vector<int64_t>& tokens, float penalty, std::vector<int64_t>& scratch) {
+    if (penalty == 1.0f) return;
+
+    scratch.assign(tokens.begin(), tokens.end());
+    std::sort(scratch.begin(), scratch.end());
+    scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+    for (int64_t token : scratch) {
+        float& score = scores[token];
+        score = score < 0 ? score * penalty : score / penalty;
+    }
+}
+
+void LogitsKernels::logSoftmaxScalar(float* scores, size_t count) {
+    if (count == 0) return;
+    float maxScore = *std::max_element(scores, scores + count);
+    if (std::isinf(maxScore)) return;
+
+    // Blocks of 8 so the compiler can vectorize the lanes where the target allows it
+    double lanes[8] = {};
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        for (size_t lane = 0; lane < 8; ++lane) {
+            lanes[lane] += static_cast<double>(expApprox(scores[i + lane] - maxScore));
+        }
+    }
+    for (size_t lane = 0; i + lane < count; ++lane) {
+        lanes[lane] += static_cast<double>(expApprox(scores[i + lane] - maxScore));
+    }
+    float logSum = maxScore + static_cast<float>(std::log(sumLanes(lanes)));
+    for (i = 0; i < count; ++i) {
+        scores[i] -= logSum;
+    }
+}
+
+void LogitsKernels::addScalarScalar(float* scores, size_t count, float value) {
+    for (size_t i = 0; i < count; ++i) {
+        scores[i] += value;
+    }
+}
+
+void LogitsKernels::topKScalar(const float* scores, size_t count, size_t k, std::vector<std::pair<float, size_t>>& best) {
+    best.clear();
+    if (k == 0) return;
+    best.reserve(k + 1);
+    for (size_t i = 0; i < count; ++i) {
+        pushCandidate(best, k, scores[i], i);
+    }
+    sortCandidates(best);
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+AVX2_TARGET static __m256 expAvx2(__m256 x) {
+    x = _mm256_min_ps(x, _mm256_set1_ps(expHigh));
+    x = _mm256_max_ps(x, _mm256_set1_ps(expLow));
+
+    __m256 n = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(log2e)), _mm256_set1_ps(0.5f)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(ln2High)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(ln2Low)));
+
+    __m256 square = _mm256_mul_ps(x, x);
+    __m256 y = _mm256_set1_ps(expCoefficients[0]);
+    for (int i = 1; i < 6; ++i) {
+        y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(expCoefficients[i]));
+    }
+    y = _mm256_add_ps(_mm256_mul_ps(y, square), x);
+    y = _mm256_add_ps(y, _mm256_set1_ps(1.0f));
+
+    __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(exponent));
+}
+
+// Lanes below remaining are set, the tail of an array is loaded and stored through it
+AVX2_TARGET static __m256i tailMask(size_t remaining) {
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(remaining)), lanes);
+}
+
+AVX2_TARGET void LogitsKernels::logSoftmaxAvx2(float* scores, size_t count) {
+    if (count == 0) return;
+    const __m256 negativeInfinity = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+
+    __m256 maxVector = negativeInfinity;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        maxVector = _mm256_max_ps(maxVector, _mm256_loadu_ps(scores + i));
+    }
+    if (i < count) {
+        __m256i mask = tailMask(count - i);
+        maxVector = _mm256_max_ps(maxVector, _mm256_blendv_ps(negativeInfinity, _mm256_maskload_ps(scores + i, mask), _mm256_castsi256_ps(mask)));
+    }
+    float maxLanes[8];
+    _mm256_storeu_ps(maxLanes, maxVector);
+    float maxScore = *std::max_element(maxLanes, maxLanes + 8);
+    if (std::isinf(maxScore)) return;
+
+    // Lane j of the two double accumulators sums the elements i with i % 8 == j
+    const __m256 maxBroadcast = _mm256_set1_ps(maxScore);
+    __m256d lowSums = _mm256_setzero_pd();
+    __m256d highSums = _mm256_setzero_pd();
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m256 e = expAvx2(_mm256_sub_ps(_mm256_loadu_ps(scores + i), maxBroadcast));
+        lowSums = _mm256_add_pd(lowSums, _mm256_cvtps_pd(_mm256_castps256_ps128(e)));
+        highSums = _mm256_add_pd(highSums, _mm256_cvtps_pd(_mm256_extractf128_ps(e, 1)));
+    }
+    if (i < count) {
+        __m256i mask = tailMask(count - i);
+        __m256 e = expAvx2(_mm256_sub_ps(_mm256_maskload_ps(scores + i, mask), maxBroadcast));
+        e = _mm256_and_ps(e, _mm256_castsi256_ps(mask));
+        lowSums = _mm256_add_pd(lowSums, _mm256_cvtps_pd(_mm256_castps256_ps128(e)));
+        highSums = _mm256_add_pd(highSums, _mm256_cvtps_pd(_mm256_extractf128_ps(e, 1)));
+    }
+    double lanes[8];
+    _mm256_storeu_pd(lanes, lowSums);
+    _mm256_storeu_pd(lanes + 4, highSums);
+    float logSum = maxScore + static_cast<float>(std::log(sumLanes(lanes)));
+
+    const __m256 logSumBroadcast = _mm256_set1_ps(logSum);
+    for (i = 0; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(scores + i, _mm256_sub_ps(_mm256_loadu_ps(scores + i), logSumBroadcast));
+    }
+    if (i < count) {
+        __m256i mask = tailMask(count - i);
+        _mm256_maskstore_ps(scores + i, mask, _mm256_sub_ps(_mm256_maskload_ps(scores + i, mask), logSumBroadcast));
+    }
+}
+
+AVX2_TARGET void LogitsKernels::addScalarAvx2(float* scores, size_t count, float value) {
+    const __m256 broadcast = _mm256_set1_ps(value);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(scores + i, _mm256_add_ps(_mm256_loadu_ps(scores + i), broadcast));
+    }
+    if (i < count) {
+        __m256i mask = tailMask(count - i);
+        _mm256_maskstore_ps(scores + i, mask, _mm256_add_ps(_mm256_maskload_ps(scores + i, mask), broadcast));
+    }
+}
+
+AVX2_TARGET void LogitsKernels::topKAvx2(const float* scores, size_t count, size_t k, std::vector<std::pair<float, size_t>>& best) {
+    best.clear();
+    if (k == 0) return;
+    best.reserve(k + 1);
+
+    // Once the heap is full, a block of 8 is skipped if none of its scores beats the worst kept
+    // one. The others go through the scalar step in index order, which checks them again against
+    // the threshold as it rises, so the heap sees exactly the scalar version's insertions.
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        if (best.size() == k) {
+            __m256 above = _mm256_cmp_ps(_mm256_loadu_ps(scores + i), _mm256_set1_ps(best.front().first), _CMP_NLE_UQ);
+            int lanes = _mm256_movemask_ps(above);
+            for (size_t lane = 0; lanes != 0 && lane < 8; ++lane) {
+                if (lanes & (1 << lane)) {
+                    pushCandidate(best, k, scores[i + lane], i + lane);
+                }
+            }
+            continue;
+        }
+        for (size_t j = i; j < i + 8; ++j) {
+            pushCandidate(best, k, scores[j], j);
+        }
+    }
+    for (; i < count; ++i) {
+        pushCandidate(best, k, scores[i], i);
+    }
+    sortCandidates(best);
+}
+
+#endif
+
+void NgramBlocker::extend(const std::vector<int64_t>& tokens) {
+    if (n <= 0 || tokens.size() < static_cast<size_t>(n)) return;
+
+    uint32_t start = static_cast<uint32_t>(tokens.size() - n);
+    insert(prefixHash(tokens.data() + start), start);
+}
+
+void NgramBlocker::apply(float* scores, const std::vector<int64_t>& tokens) const {
+    if (n <= 0 || used == 0 || tokens.size() + 1 < static_cast<size_t>(n)) return;
+
+    // The n - 1 last tokens are the prefix the next token would complete
+    const int64_t* prefix = tokens.data() + tokens.size() - (n - 1);
+    const uint64_t hash = prefixHash(prefix);
+    const size_t capacityMask = hashes.size() - 1;
+    for (size_t slot = hash & capacityMask; starts[slot] != 0; slot = (slot + 1) & capacityMask) {
+        if (hashes[slot] != hash) continue;
+        const int64_t* ngram = tokens.data() + (starts[slot] - 1);
+        if (std::equal(ngram, ngram + n - 1, prefix)) {
+            scores[ngram[n - 1]] = -std::numeric_limits<float>::infinity();
+        }
+    }
+}
+
+uint64_t NgramBlocker::prefixHash(const int64_t* prefix) const {
+    return Hashing::fnv1a64(prefix, sizeof(int64_t) * (n - 1));
+}
+
+void NgramBlocker::insert(uint64_t hash, uint32_t start) {
+    // Kept at most half full so probes stay short
+    if ((used + 1) * 2 > hashes.size()) {
+        std::vector<uint64_t> oldHashes = std::move(hashes);
+        std::vector<uint32_t> oldStarts = std::move(starts);
+        hashes.assign(std::max<size_t>(16, oldHashes.size() * 2), 0);
+        starts.assign(hashes.size(), 0);
+        used = 0;
+        for (size_t slot = 0; slot < oldHashes.size(); ++slot) {
+            if (oldStarts[slot] != 0) insert(oldHashes[slot], oldStarts[slot] - 1);
+        }
+    }
+
+    const size_t capacityMask = hashes.size() - 1;
+    size_t slot = hash & capacityMask;
+    while (starts[slot] != 0) {
+        slot = (slot + 1) & capacityMask;
+    }
+    hashes[slot] = hash;
+    starts[slot] = start + 1;
+    ++used;
+}
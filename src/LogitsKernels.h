@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "CpuFeatures.h"
+
+// The per-step work on a beam's logits outside the ONNX graph. Every kernel has a scalar version
+// and an AVX2 version that rounds exactly like it: the exp is a fixed polynomial instead of
+// std::exp, and the scalar sums run over 8 lanes in the order the vector registers use. Both
+// therefore produce bit-identical scores and hypotheses, the AVX2 one is picked when the CPU has it.
+class LogitsKernels {
+public:
+    explicit LogitsKernels(bool useAvx2 = CpuFeatures::hasAvx2());
+
+    bool avx2() const { return useAvx2; }
+
+    // scores[i] -= log(sum(exp(scores))), scores are left alone if the largest one is infinite
+    void logSoftmax(float* scores, size_t count) const;
+
+    void addScalar(float* scores, size_t count, float value) const;
+
+    // The k best (score, index) pairs, best first. Equal scores keep the order a min-heap fed in
+    // index order leaves them in, so both versions return the same pairs.
+    void topK(const float* scores, size_t count, size_t k, std::vector<std::pair<float, size_t>>& best) const;
+
+    // Scales each distinct token once. The penalty only touches the generated tokens, so there is
+    // nothing to vectorize, scratch replaces the std::set the per-token version needed.
+    static void repetitionPenalty(float* scores, const std::vector<int64_t>& tokens, float penalty, std::vector<int64_t>& scratch);
+
+    // The exp both versions use, exposed for the tests
+    static float expApprox(float x);
+
+protected:
+    static void logSoftmaxScalar(float* scores, size_t count);
+    static void addScalarScalar(float* scores, size_t count, float value);
+    static void topKScalar(const float* scores, size_t count, size_t k, std::vector<std::pair<float, size_t>>& best);
+#if defined(__x86_64__) || defined(_M_X64)
+    static void logSoftmaxAvx2(float* scores, size_t count);
+    static void addScalarAvx2(float* scores, size_t count, float value);
+    static void topKAvx2(const float* scores, size_t count, size_t k, std::vector<std::pair<float, size_t>>& best);
+#endif
+
+    bool useAvx2 = false;
+};
+
+// The n-grams of one hypothesis, indexed by the hash of their first n - 1 tokens. Banning the
+// tokens that would repeat an n-gram looks up the current prefix instead of scanning the whole
+// hypothesis. A beam search keeps one per beam and copies it along with the beam.
+class NgramBlocker {
+public:
+    explicit NgramBlocker(int n = 0) : n(n) {}
+
+    // Indexes the n-gram that ends at the last of tokens, called after every appended token
+    void extend(const std::vector<int64_t>& tokens);
+
+    // Sets the score of every token that would complete an n-gram already in tokens to -inf
+    void apply(float* scores, const std::vector<int64_t>& tokens) const;
+
+    size_t size() const { return used; }
+
+protected:
+    uint64_t prefixHash(const int64_t* prefix) const;
+    void insert(uint64_t hash, uint32_t start);
+
+    int n = 0;
+
+    // Open addressing with linear probing. starts holds the n-gram's first position plus one,
+    // 0 marks an empty slot. Equal prefixes share a hash, so lookups compare the tokens.
+    std::vector<uint64_t> hashes;
+    std::vector<uint32_t> starts;
+    size_t used = 0;
+};
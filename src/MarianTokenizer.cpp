@@ -0,0 +1,119 @@
+#include "MarianTokenizer.h"
+
+MarianTokenizer::MarianTokenizer(const std::filesystem::path& modelDir) {
+    std::filesystem::path sourceSpmPath = modelDir / "source.spm";
+    std::filesystem::path targetSpmPath = modelDir / "target.spm";
+
+    if (!sourceSpm.Load(sourceSpmPath.string()).ok()) {
+        throw std::runtime_error("Failed to load SentencePiece model: " + sourceSpmPath.string());
+    }
+    if (!targetSpm.Load(targetSpmPath.string()).ok()) {
+        throw std::runtime_error("Failed to load SentencePiece model: " + targetSpmPath.string());
+    }
+
+    loadVocab(modelDir / "vocab.json");
+    buildPieceTable();
+}
+
+void MarianTokenizer::loadVocab(const std::filesystem::path& vocabPath) {
+    std::ifstream vocabFile(vocabPath);
+    if (!vocabFile.is_open()) {
+        throw std::runtime_error("Failed to open vocab file: " + vocabPath.string());
+    }
+
+    nlohmann::json vocabJson = nlohmann::json::parse(vocabFile);
+    idToToken.resize(vocabJson.size());
+    for (const auto& [token, id] : vocabJson.items()) {
+        int64_t tokenId = id.get<int64_t>();
+        if (tokenId >= static_cast<int64_t>(idToToken.size())) {
+            idToToken.resize(tokenId + 1);
+        }
+        vocab[token] = tokenId;
+        idToToken[tokenId] = token;
+    }
+}
+
+void MarianTokenizer::buildPieceTable() {
+    int pieceCount = sourceSpm.GetPieceSize();
+    sourcePieceToVocab.resize(pieceCount);
+    for (int pieceId = 0; pieceId < pieceCount; ++pieceId) {
+        sourcePieceToVocab[pieceId] = tokenToId(sourceSpm.IdToPiece(pieceId));
+    }
+}
+
+int64_t MarianTokenizer::tokenToId(const std::string& token) const {
+    auto it = vocab.find(token);
+    return it != vocab.end() ? it->second : MARIAN_UNK_ID;
+}
+
+std::pair<std::string, std::string> MarianTokenizer::splitLanguageCode(const std::string& text) const {
+    // The translators prefix each segment with ">>lang<< " for the multilingual model
+    if (text.compare(0, 2, ">>") != 0) {
+        return {"", text};
+    }
+
+    size_t end = text.find("<<", 2);
+    if (end == std::string::npos) {
+        return {"", text};
+    }
+
+    return {text.substr(0, end + 2), text.substr(end + 2)};
+}
+
+std::string MarianTokenizer::stripWhitespace(const std::string& text) const {
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) return "";
+    size_t last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+std::vector<int64_t> MarianTokenizer::encode(const std::string& text) const {
+    std::vector<int64_t> ids;
+    auto [languageCode, body] = splitLanguageCode(text);
+
+    // The language code is a single token and must not go through SentencePiece. The mul-en
+    // vocab has no language tokens so, like the HF tokenizer, it maps to <unk>.
+    if (!languageCode.empty()) {
+        ids.push_back(tokenToId(languageCode));
+    }
+
+    std::vector<int> pieceIds;
+    sourceSpm.Encode(body, &pieceIds);
+
+    ids.reserve(ids.size() + pieceIds.size() + 1);
+    for (int pieceId : pieceIds) {
+        ids.push_back(sourcePieceToVocab[pieceId]);
+    }
+
+    if (ids.size() > maxSourceTokens) {
+        ids.resize(maxSourceTokens);
+    }
+    ids.push_back(MARIAN_EOS_ID);
+    return ids;
+}
+
+std::vector<std::vector<int64_t>> MarianTokenizer::encodeBatch(const std::vector<std::string>& texts) const {
+    std::vector<std::vector<int64_t>> batch;
+    runBatch(texts, batch, [this](const std::string& text) { return encode(text); });
+    return batch;
+}
+
+std::string MarianTokenizer::decode(const std::vector<int64_t>& ids) const {
+    std::vector<std::string> pieces;
+    pieces.reserve(ids.size());
+    for (int64_t id : ids) {
+        if (id == MARIAN_EOS_ID || id == MARIAN_UNK_ID || id == MARIAN_PAD_ID) continue;
+        if (id < 0 || id >= static_cast<int64_t>(idToToken.size())) continue;
+        pieces.push_back(idToToken[id]);
+    }
+
+    std::string text;
+    targetSpm.Decode(pieces, &text);
+    return stripWhitespace(text);
+}
+
+std::vector<std::string> MarianTokenizer::decodeBatch(const std::vector<std::vector<int64_t>>& ids) const {
+    std::vector<std::string> batch;
+    runBatch(ids, batch, [this](const std::vector<int64_t>& hypothesis) { return decode(hypothesis); });
+    return batch;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <sentencepiece_processor.h>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Marian special token ids (see onnx-model-dir/config.json)
+#define MARIAN_EOS_ID 0
+#define MARIAN_UNK_ID 1
+#define MARIAN_PAD_ID 64171
+
+// Native replacement for the HF MarianTokenizer. Source text is split with source.spm,
+// output ids are turned back into text with target.spm and both share vocab.json.
+class MarianTokenizer {
+public:
+    explicit MarianTokenizer(const std::filesystem::path& modelDir = "onnx-model-dir");
+
+    // Encodes one segment, a leading ">>lang<<" code becomes a single token and EOS is appended
+    std::vector<int64_t> encode(const std::string& text) const;
+    std::vector<std::vector<int64_t>> encodeBatch(const std::vector<std::string>& texts) const;
+
+    // Decodes generated ids, special tokens are skipped like skip_special_tokens=True
+    std::string decode(const std::vector<int64_t>& ids) const;
+    std::vector<std::string> decodeBatch(const std::vector<std::vector<int64_t>>& ids) const;
+
+    int64_t tokenToId(const std::string& token) const;
+    size_t vocabSize() const { return idToToken.size(); }
+
+    // Inputs are truncated so that the EOS token still fits in the 512 positions of the model
+    static const size_t maxSourceTokens = 511;
+
+protected:
+    void loadVocab(const std::filesystem::path& vocabPath);
+    void buildPieceTable();
+    std::pair<std::string, std::string> splitLanguageCode(const std::string& text) const;
+    std::string stripWhitespace(const std::string& text) const;
+
+    template <typename Input, typename Output, typename Function>
+    void runBatch(const std::vector<Input>& inputs, std::vector<Output>& outputs, Function function) const;
+
+    sentencepiece::SentencePieceProcessor sourceSpm;
+    sentencepiece::SentencePieceProcessor targetSpm;
+    std::unordered_map<std::string, int64_t> vocab;
+    std::vector<std::string> idToToken;
+
+    // Maps a source.spm piece id straight to its vocab.json id so encoding never hashes strings
+    std::vector<int64_t> sourcePieceToVocab;
+};
+
+// Splits a batch across the hardware threads, SentencePiece is safe to call concurrently
+template <typename Input, typename Output, typename Function>
+void MarianTokenizer::runBatch(const std::vector<Input>& inputs, std::vector<Output>& outputs, Function function) const {
+    outputs.resize(inputs.size());
+
+    const size_t minPerThread = 256;
+    size_t threadCount = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), inputs.size() / minPerThread));
+
+    if (threadCount == 1) {
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            outputs[i] = function(inputs[i]);
+        }
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    size_t chunk = (inputs.size() + threadCount - 1) / threadCount;
+    for (size_t t = 0; t < threadCount; ++t) {
+        size_t begin = t * chunk;
+        size_t end = std::min(inputs.size(), begin + chunk);
+        threads.emplace_back([&, begin, end]() {
+            for (size_t i = begin; i < end; ++i) {
+                outputs[i] = function(inputs[i]);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
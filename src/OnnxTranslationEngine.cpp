@@ -0,0 +1,1540 @@
+#include "OnnxTranslationEngine.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <list>
+#include <thread>
+#include <unordered_set>
+
+OnnxTranslationEngine::OnnxTranslationEngine(const std::filesystem::path& modelDir, const std::filesystem::path& configPath)
+    : env(ORT_LOGGING_LEVEL_WARNING, "BookTranslator"),
+      memoryInfo(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)),
+      tokenizer(modelDir) {
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::cout << "Loading model..." << "\n";
+
+    loadTranslationConfig(configPath);
+    degenerationDetector = DegenerationDetector(degeneration);
+    segmentPacker = SegmentPacker(packing);
+    loadModelConfig(modelDir);
+    loadSessions(modelDir);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << "Model loaded successfully in " << elapsed.count() << "s" << "\n";
+}
+
+void OnnxTranslationEngine::loadTranslationConfig(const std::filesystem::path& configPath) {
+    modelName = "Helsinki-NLP/opus-mt-mul-en";
+
+    if (!std::filesystem::exists(configPath)) {
+        std::cout << "No translation config found. Using default values." << "\n";
+        return;
+    }
+
+    std::ifstream configFile(configPath);
+    if (!configFile.is_open()) {
+        throw std::runtime_error("Failed to open translation config: " + configPath.string());
+    }
+
+    std::cout << "Loading translation config..." << "\n";
+    nlohmann::json config = nlohmann::json::parse(configFile);
+
+    modelName = config.value("Model_name", modelName);
+
+    nlohmann::json jsonParams = config.value("params", nlohmann::json::object());
+    params.maxNewTokens = jsonParams.value("max_new_tokens", jsonParams.value("max_length", params.maxNewTokens));
+    params.numBeams = jsonParams.value("num_beams", params.numBeams);
+    params.noRepeatNgramSize = jsonParams.value("no_repeat_ngram_size", params.noRepeatNgramSize);
+    params.repetitionPenalty = jsonParams.value("repetition_penalty", params.repetitionPenalty);
+    params.earlyStopping = jsonParams.value("early_stopping", params.earlyStopping);
+
+    nlohmann::json jsonBatching = config.value("batching", nlohmann::json::object());
+    batching.batchSize = std::max<size_t>(1, jsonBatching.value("batch_size", batching.batchSize));
+    batching.maxBatchTokens = std::max<size_t>(1, jsonBatching.value("max_batch_tokens", batching.maxBatchTokens));
+    params.numBeams = std::max(1, params.numBeams);
+
+    nlohmann::json jsonQuantization = config.value("quantization", nlohmann::json::object());
+    quantization.variant = jsonQuantization.value("variant", quantization.variant);
+    quantization.maxBleuDrop = jsonQuantization.value("max_bleu_drop", quantization.maxBleuDrop);
+
+    nlohmann::json jsonGraphCache = config.value("graph_cache", nlohmann::json::object());
+    graphCache.enabled = jsonGraphCache.value("enabled", graphCache.enabled);
+    graphCache.directory = jsonGraphCache.value("directory", graphCache.directory);
+
+    nlohmann::json jsonLengthBudget = config.value("length_budget", nlohmann::json::object());
+    lengthBudget.enabled = jsonLengthBudget.value("enabled", lengthBudget.enabled);
+    lengthBudget.ratio = jsonLengthBudget.value("ratio", lengthBudget.ratio);
+    lengthBudget.slack = jsonLengthBudget.value("slack", lengthBudget.slack);
+
+    nlohmann::json jsonDegeneration = config.value("degeneration", nlohmann::json::object());
+    degeneration.enabled = jsonDegeneration.value("enabled", degeneration.enabled);
+    degeneration.maxPeriod = jsonDegeneration.value("max_period", degeneration.maxPeriod);
+    degeneration.minRepeats = jsonDegeneration.value("min_repeats", degeneration.minRepeats);
+    degeneration.window = jsonDegeneration.value("window", degeneration.window);
+    degeneration.minDistinctRatio = jsonDegeneration.value("min_distinct_ratio", degeneration.minDistinctRatio);
+    degeneration.retryRepetitionPenalty = jsonDegeneration.value("retry_repetition_penalty", degeneration.retryRepetitionPenalty);
+    degeneration.retryNoRepeatNgramSize = jsonDegeneration.value("retry_no_repeat_ngram_size", degeneration.retryNoRepeatNgramSize);
+
+    nlohmann::json jsonSessions = config.value("sessions", nlohmann::json::object());
+    sessionPool.count = jsonSessions.value("count", sessionPool.count);
+    sessionPool.threadsPerSession = jsonSessions.value("threads_per_session", sessionPool.threadsPerSession);
+    sessionPool.pinThreads = jsonSessions.value("pin_threads", sessionPool.pinThreads);
+
+    nlohmann::json jsonShortlist = config.value("shortlist", nlohmann::json::object());
+    shortlist.enabled = jsonShortlist.value("enabled", shortlist.enabled);
+    shortlist.maxCandidates = jsonShortlist.value("max_candidates", shortlist.maxCandidates);
+
+    nlohmann::json jsonSpeculative = config.value("speculative", nlohmann::json::object());
+    speculative.enabled = jsonSpeculative.value("enabled", speculative.enabled);
+    speculative.draftModelDir = jsonSpeculative.value("draft_model_dir", speculative.draftModelDir);
+    speculative.draftTokens = std::max<size_t>(1, jsonSpeculative.value("draft_tokens", speculative.draftTokens));
+    speculative.minAcceptanceRate = jsonSpeculative.value("min_acceptance_rate", speculative.minAcceptanceRate);
+    speculative.probeTokens = jsonSpeculative.value("probe_tokens", speculative.probeTokens);
+
+    nlohmann::json jsonPacking = config.value("packing", nlohmann::json::object());
+    packing.enabled = jsonPacking.value("enabled", packing.enabled);
+    packing.maxSegmentTokens = jsonPacking.value("max_segment_tokens", packing.maxSegmentTokens);
+    packing.maxPackedTokens = jsonPacking.value("max_packed_tokens", packing.maxPackedTokens);
+    packing.maxSegments = jsonPacking.value("max_segments", packing.maxSegments);
+    packing.separator = jsonPacking.value("separator", packing.separator);
+
+    nlohmann::json jsonTwoTier = config.value("two_tier", nlohmann::json::object());
+    twoTier.enabled = jsonTwoTier.value("enabled", twoTier.enabled);
+    twoTier.confidenceThreshold = jsonTwoTier.value("confidence_threshold", twoTier.confidenceThreshold);
+
+    nlohmann::json jsonPipeline = config.value("pipeline", nlohmann::json::object());
+    pipeline.enabled = jsonPipeline.value("enabled", pipeline.enabled);
+    pipeline.queueDepth = std::max<size_t>(1, jsonPipeline.value("queue_depth", pipeline.queueDepth));
+    pipeline.encoderThreads = jsonPipeline.value("encoder_threads", pipeline.encoderThreads);
+}
+
+void OnnxTranslationEngine::loadModelConfig(const std::filesystem::path& modelDir) {
+    std::filesystem::path modelConfigPath = modelDir / "config.json";
+
+    std::ifstream modelConfigFile(modelConfigPath);
+    if (modelConfigFile.is_open()) {
+        nlohmann::json modelConfig = nlohmann::json::parse(modelConfigFile);
+        hiddenSize = modelConfig.value("d_model", hiddenSize);
+        vocabSize = modelConfig.value("vocab_size", vocabSize);
+        decoderLayers = modelConfig.value("decoder_layers", decoderLayers);
+        decoderHeads = modelConfig.value("decoder_attention_heads", decoderHeads);
+
+        // The start token takes the first of the static positions, the output can't use more
+        int maxPositions = modelConfig.value("max_position_embeddings", 512);
+        params.maxNewTokens = std::min(params.maxNewTokens, maxPositions - 1);
+    }
+
+    std::ifstream generationConfigFile(modelDir / "generation_config.json");
+    if (generationConfigFile.is_open()) {
+        nlohmann::json generationConfig = nlohmann::json::parse(generationConfigFile);
+        params.renormalizeLogits = generationConfig.value("renormalize_logits", params.renormalizeLogits);
+    }
+}
+
+std::filesystem::path OnnxTranslationEngine::resolveGraphDir(const std::filesystem::path& modelDir, const QuantizationParams& quantization) {
+    if (quantization.variant.empty() || quantization.variant == "fp32") {
+        return modelDir;
+    }
+
+    // quantizeModel.py writes the variant next to the fp32 graphs together with its BLEU check
+    std::filesystem::path variantDir = modelDir / quantization.variant;
+    std::ifstream gateFile(variantDir / "quantization_gate.json");
+    if (!gateFile.is_open()) {
+        std::cerr << "No quantization_gate.json for " << quantization.variant << ", run quantizeModel.py first. Using the fp32 model." << "\n";
+        return modelDir;
+    }
+
+    nlohmann::json gate = nlohmann::json::parse(gateFile, nullptr, false);
+    if (gate.is_discarded()) {
+        std::cerr << "Invalid quantization_gate.json for " << quantization.variant << ". Using the fp32 model." << "\n";
+        return modelDir;
+    }
+
+    // The drop is checked against the configured margin so tightening it needs no new evaluation
+    float bleuDrop = gate.value("baseline_bleu", 0.0f) - gate.value("quantized_bleu", 0.0f);
+    if (!gate.value("passed", false) || bleuDrop > quantization.maxBleuDrop) {
+        std::cerr << "The " << quantization.variant << " model lost " << bleuDrop << " BLEU, more than the allowed " << quantization.maxBleuDrop << ". Using the fp32 model." << "\n";
+        return modelDir;
+    }
+
+    std::cout << "Using the " << quantization.variant << " model (BLEU drop " << bleuDrop << ")" << "\n";
+    return variantDir;
+}
+
+std::unique_ptr<Ort::Session> OnnxTranslationEngine::createSession(const std::filesystem::path& modelPath, const Ort::SessionOptions& sessionOptions) {
+    if (!graphCache.enabled) {
+        return std::make_unique<Ort::Session>(env, modelPath.c_str(), sessionOptions);
+    }
+    return GraphCache(graphCache.directory).createSession(env, modelPath, sessionOptions);
+}
+
+std::vector<std::vector<int>> OnnxTranslationEngine::sessionCores(const std::vector<int>& cores, SessionPoolParams& sessionPool) {
+    CpuTopology::autoLayout(cores.size(), sessionPool.count, sessionPool.threadsPerSession);
+    if (sessionPool.count * sessionPool.threadsPerSession > cores.size()) {
+        std::cerr << sessionPool.count << " sessions of " << sessionPool.threadsPerSession << " threads oversubscribe the " << cores.size() << " physical cores." << "\n";
+    }
+    return CpuTopology::partition(cores, sessionPool.count, sessionPool.threadsPerSession);
+}
+
+Ort::SessionOptions OnnxTranslationEngine::sessionOptions(const std::vector<int>& cores) const {
+    Ort::SessionOptions options;
+    options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+    options.SetIntraOpNumThreads(static_cast<int>(cores.size()));
+    options.SetExecutionMode(ExecutionMode::ORT_SEQUENTIAL);
+
+#ifndef __APPLE__
+    // The worker thread that calls Run is the first intra-op thread and pins itself to cores[0],
+    // ORT pins the rest of the pool. Ids are 1-based logical processors separated by ';'.
+    if (sessionPool.pinThreads && cores.size() > 1) {
+        std::string affinities;
+        for (size_t i = 1; i < cores.size(); ++i) {
+            if (!affinities.empty()) affinities += ";";
+            affinities += std::to_string(cores[i] + 1);
+        }
+        options.AddConfigEntry("session.intra_op_thread_affinities", affinities.c_str());
+    }
+#endif
+    return options;
+}
+
+std::filesystem::path OnnxTranslationEngine::loadShortlist(const std::filesystem::path& modelDir, const std::filesystem::path& graphDir) {
+    // buildShortlist.py cuts the decoders of each variant before their output projection
+    std::filesystem::path shortlistDir = graphDir / "shortlist";
+    std::filesystem::path tablePath = modelDir / "lexical_shortlist.bin";
+    if (!std::filesystem::exists(tablePath) || !std::filesystem::exists(shortlistDir / "lm_head.bin") ||
+        !std::filesystem::exists(shortlistDir / "decoder_model.onnx") || !std::filesystem::exists(shortlistDir / "decoder_with_past_model.onnx")) {
+        std::cerr << "No lexical shortlist for " << graphDir.string() << ", run buildShortlist.py first. Using the full vocabulary." << "\n";
+        return graphDir;
+    }
+
+    try {
+        lexicalShortlist = LexicalShortlist(tablePath);
+        outputProjection = OutputProjection(shortlistDir / "lm_head.bin");
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Failed to load the lexical shortlist, using the full vocabulary. Details: " << e.what() << "\n";
+        return graphDir;
+    }
+
+    if (outputProjection.vocabSize() != vocabSize || outputProjection.hiddenSize() != hiddenSize) {
+        std::cerr << "The output projection in " << shortlistDir.string() << " does not match the model, using the full vocabulary." << "\n";
+        return graphDir;
+    }
+
+    useShortlist = true;
+    std::cout << "Using the lexical shortlist" << "\n";
+    return shortlistDir;
+}
+
+void OnnxTranslationEngine::loadSessions(const std::filesystem::path& modelDir) {
+    std::filesystem::path graphDir = resolveGraphDir(modelDir, quantization);
+    graphVariant = graphDir == modelDir ? "fp32" : quantization.variant;
+    std::filesystem::path decoderDir = shortlist.enabled ? loadShortlist(modelDir, graphDir) : graphDir;
+    std::filesystem::path encoderPath = graphDir / "encoder_model.onnx";
+    std::filesystem::path decoderPath = decoderDir / "decoder_model.onnx";
+    std::filesystem::path decoderWithPastPath = decoderDir / "decoder_with_past_model.onnx";
+
+    if (!std::filesystem::exists(encoderPath) || !std::filesystem::exists(decoderPath) || !std::filesystem::exists(decoderWithPastPath)) {
+        throw std::runtime_error("ONNX model not found in " + graphDir.string() + ", export it with optimum-cli --task text2text-generation-with-past first.");
+    }
+
+    workerCores = sessionCores(CpuTopology::physicalCores(), sessionPool);
+    std::cout << "Running " << sessionPool.count << " sessions with " << sessionPool.threadsPerSession << " threads each." << "\n";
+
+    // A speculative worker decodes one segment at a time and has no slots to keep busy
+    if (pipeline.enabled && speculative.enabled) {
+        std::cerr << "The encoder pipeline is not used with speculative decoding." << "\n";
+    }
+    usePipeline = pipeline.enabled && !speculative.enabled;
+    if (usePipeline) {
+        encoderCores.clear();
+        for (auto& cores : workerCores) {
+            encoderCores.push_back(splitEncoderCores(cores, pipeline.encoderThreads));
+        }
+        std::cout << "Encoding ahead with " << encoderCores.front().size() << " threads per session" << (encoderCores.front() == workerCores.front() ? " on the decoder's cores." : ".") << "\n";
+    }
+
+    // Every worker gets its own sessions, the first one fills the graph cache for the others
+    workers.resize(workerCores.size());
+    for (size_t worker = 0; worker < workers.size(); ++worker) {
+        workers[worker] = createModelSessions(encoderPath, decoderPath, decoderWithPastPath, sessionOptions(workerCores[worker]));
+    }
+
+    // The encoder stage needs its own session, the intra-op pool of a session is shared by all its runs
+    encoderWorkers.clear();
+    if (usePipeline) {
+        encoderWorkers.resize(workers.size());
+        for (size_t worker = 0; worker < workers.size(); ++worker) {
+            encoderWorkers[worker] = createEncoderSessions(encoderPath, sessionOptions(encoderCores[worker]));
+        }
+    }
+
+    if (speculative.enabled) {
+        loadDraftModel();
+    }
+}
+
+std::vector<int> OnnxTranslationEngine::splitEncoderCores(std::vector<int>& cores, size_t encoderThreads) {
+    // A session too small to give cores away shares them between both stages
+    if (encoderThreads == 0 || encoderThreads >= cores.size()) {
+        return cores;
+    }
+    std::vector<int> encoder(cores.end() - encoderThreads, cores.end());
+    cores.resize(cores.size() - encoderThreads);
+    return encoder;
+}
+
+ModelSessions OnnxTranslationEngine::createEncoderSessions(const std::filesystem::path& encoderPath, const Ort::SessionOptions& options) {
+    ModelSessions sessions;
+    sessions.encoder = createSession(encoderPath, options);
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    for (size_t i = 0; i < sessions.encoder->GetInputCount(); ++i) {
+        sessions.encoderInputNames.push_back(sessions.encoder->GetInputNameAllocated(i, allocator).get());
+    }
+
+    // A draft model may use a different hidden size than the main model
+    std::vector<int64_t> encoderShape = sessions.encoder->GetOutputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+    sessions.encoderHiddenSize = encoderShape.size() == 3 && encoderShape[2] > 0 ? encoderShape[2] : hiddenSize;
+    sessions.encoderBinding = std::make_unique<Ort::IoBinding>(*sessions.encoder);
+    return sessions;
+}
+
+ModelSessions OnnxTranslationEngine::createModelSessions(const std::filesystem::path& encoderPath, const std::filesystem::path& decoderPath, const std::filesystem::path& decoderWithPastPath, const Ort::SessionOptions& options) {
+    ModelSessions sessions = createEncoderSessions(encoderPath, options);
+    sessions.decoder = createSession(decoderPath, options);
+    sessions.decoderWithPast = createSession(decoderWithPastPath, options);
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    for (size_t i = 0; i < sessions.decoder->GetInputCount(); ++i) {
+        sessions.decoderInputNames.push_back(sessions.decoder->GetInputNameAllocated(i, allocator).get());
+    }
+    for (size_t i = 0; i < sessions.decoder->GetOutputCount(); ++i) {
+        sessions.decoderOutputNames.push_back(sessions.decoder->GetOutputNameAllocated(i, allocator).get());
+    }
+    for (size_t i = 0; i < sessions.decoderWithPast->GetInputCount(); ++i) {
+        sessions.decoderWithPastInputNames.push_back(sessions.decoderWithPast->GetInputNameAllocated(i, allocator).get());
+    }
+    for (size_t i = 0; i < sessions.decoderWithPast->GetOutputCount(); ++i) {
+        sessions.decoderWithPastOutputNames.push_back(sessions.decoderWithPast->GetOutputNameAllocated(i, allocator).get());
+    }
+
+    // present.N.decoder.key is fed back as past_key_values.N.decoder.key
+    auto pastNames = [](const std::vector<std::string>& outputNames) {
+        std::vector<std::string> names;
+        for (const auto& name : outputNames) {
+            names.push_back(name.rfind("present", 0) == 0 ? "past_key_values" + name.substr(std::string("present").size()) : "");
+        }
+        return names;
+    };
+    sessions.decoderPastNames = pastNames(sessions.decoderOutputNames);
+    sessions.decoderWithPastPastNames = pastNames(sessions.decoderWithPastOutputNames);
+
+    sessions.decoderBinding = std::make_unique<Ort::IoBinding>(*sessions.decoder);
+    sessions.decoderWithPastBinding = std::make_unique<Ort::IoBinding>(*sessions.decoderWithPast);
+    return sessions;
+}
+
+void OnnxTranslationEngine::loadDraftModel() {
+    // Verifying the draft against the main model's best token only reproduces greedy search
+    if (params.numBeams != 1) {
+        std::cerr << "Speculative decoding needs num_beams 1, decoding without the draft model." << "\n";
+        return;
+    }
+
+    std::filesystem::path draftDir = speculative.draftModelDir;
+    std::filesystem::path encoderPath = draftDir / "encoder_model.onnx";
+    std::filesystem::path decoderPath = draftDir / "decoder_model.onnx";
+    std::filesystem::path decoderWithPastPath = draftDir / "decoder_with_past_model.onnx";
+    if (!std::filesystem::exists(encoderPath) || !std::filesystem::exists(decoderPath) || !std::filesystem::exists(decoderWithPastPath)) {
+        std::cerr << "No draft model in " << draftDir.string() << ", export it with optimum-cli --task text2text-generation-with-past. Decoding without the draft model." << "\n";
+        return;
+    }
+
+    // The draft proposes ids of the main vocabulary, so both models must share vocab.json
+    std::ifstream draftConfigFile(draftDir / "config.json");
+    int64_t draftVocabSize = 0;
+    if (draftConfigFile.is_open()) {
+        draftVocabSize = nlohmann::json::parse(draftConfigFile).value("vocab_size", int64_t(0));
+    }
+    if (draftVocabSize != vocabSize) {
+        std::cerr << "The draft model in " << draftDir.string() << " has a different vocabulary, decoding without it." << "\n";
+        return;
+    }
+
+    // The main model verifies the draft from its cache, which needs a decoder_with_past that
+    // takes more than one token per row
+    auto idsInput = std::find(workers[0].decoderWithPastInputNames.begin(), workers[0].decoderWithPastInputNames.end(), "input_ids");
+    if (idsInput != workers[0].decoderWithPastInputNames.end()) {
+        std::vector<int64_t> idsShape = workers[0].decoderWithPast->GetInputTypeInfo(idsInput - workers[0].decoderWithPastInputNames.begin()).GetTensorTypeAndShapeInfo().GetShape();
+        if (idsShape.size() == 2 && idsShape[1] == 1) {
+            std::cerr << "decoder_with_past_model.onnx takes a single token per row, decoding without the draft model." << "\n";
+            return;
+        }
+    }
+
+    draftWorkers.resize(workers.size());
+    for (size_t worker = 0; worker < workers.size(); ++worker) {
+        draftWorkers[worker] = createModelSessions(encoderPath, decoderPath, decoderWithPastPath, sessionOptions(workerCores[worker]));
+    }
+
+    useSpeculative = true;
+    std::cout << "Using the draft model in " << draftDir.string() << " for speculative decoding" << "\n";
+}
+
+const float* OnnxTranslationEngine::runEncoder(ModelSessions& sessions, const int64_t* inputIds, const int64_t* attentionMask, int64_t rows, int64_t sourceLength) {
+    std::array<int64_t, 2> shape = {rows, sourceLength};
+    std::array<int64_t, 3> hiddenShape = {rows, sourceLength, sessions.encoderHiddenSize};
+    const size_t count = static_cast<size_t>(rows * sourceLength);
+
+    Ort::IoBinding& binding = *sessions.encoderBinding;
+    binding.ClearBoundInputs();
+    binding.ClearBoundOutputs();
+    for (const auto& name : sessions.encoderInputNames) {
+        const int64_t* data = (name == "attention_mask") ? attentionMask : inputIds;
+        binding.BindInput(name.c_str(), Ort::Value::CreateTensor<int64_t>(memoryInfo, const_cast<int64_t*>(data), count, shape.data(), shape.size()));
+    }
+
+    // The hidden states stay in the arena until the next encoder run, callers copy what they keep
+    float* hidden = sessions.arena.floats("last_hidden_state", count * sessions.encoderHiddenSize);
+    binding.BindOutput("last_hidden_state", Ort::Value::CreateTensor<float>(memoryInfo, hidden, count * sessions.encoderHiddenSize, hiddenShape.data(), hiddenShape.size()));
+    sessions.tensorValues += sessions.encoderInputNames.size() + 1;
+    sessions.encoder->Run(Ort::RunOptions{nullptr}, binding);
+    return hidden;
+}
+
+std::vector<Ort::Value> OnnxTranslationEngine::runDecoder(ModelSessions& sessions, DecodeCohort& cohort, std::vector<int64_t>& decoderIds, int64_t length) {
+    Ort::Session& session = cohort.started ? *sessions.decoderWithPast : *sessions.decoder;
+    const std::vector<std::string>& sessionInputNames = cohort.started ? sessions.decoderWithPastInputNames : sessions.decoderInputNames;
+    const std::vector<std::string>& sessionOutputNames = cohort.started ? sessions.decoderWithPastOutputNames : sessions.decoderOutputNames;
+
+    // The verification of draft tokens feeds several tokens per row, both graphs mask them causally
+    const int64_t rows = static_cast<int64_t>(decoderIds.size()) / length;
+    std::vector<int64_t> idsShape = {rows, length};
+    std::vector<int64_t> maskShape = {rows, cohort.sourceLength};
+
+    // A draft model may use a different hidden size than the main model
+    int64_t cohortHiddenSize = cohort.encoderHiddenStates.empty() ? hiddenSize : static_cast<int64_t>(cohort.encoderHiddenStates.size()) / (rows * cohort.sourceLength);
+    std::vector<int64_t> hiddenShape = {rows, cohort.sourceLength, cohortHiddenSize};
+
+    std::vector<const char*> inputNames;
+    std::vector<Ort::Value> inputs;
+    for (const auto& name : sessionInputNames) {
+        inputNames.push_back(name.c_str());
+        if (name == "input_ids") {
+            inputs.push_back(Ort::Value::CreateTensor<int64_t>(memoryInfo, decoderIds.data(), decoderIds.size(), idsShape.data(), idsShape.size()));
+        } else if (name == "encoder_attention_mask") {
+            inputs.push_back(Ort::Value::CreateTensor<int64_t>(memoryInfo, cohort.attentionMask.data(), cohort.attentionMask.size(), maskShape.data(), maskShape.size()));
+        } else if (name == "encoder_hidden_states") {
+            inputs.push_back(Ort::Value::CreateTensor<float>(memoryInfo, cohort.encoderHiddenStates.data(), cohort.encoderHiddenStates.size(), hiddenShape.data(), hiddenShape.size()));
+        } else if (cohort.pastKeyValues.count(name)) {
+            CacheTensor& cache = cohort.pastKeyValues[name];
+            inputs.push_back(Ort::Value::CreateTensor<float>(memoryInfo, cache.data.data(), cache.data.size(), cache.shape.data(), cache.shape.size()));
+        } else {
+            throw std::runtime_error("Unexpected decoder input: " + name);
+        }
+    }
+
+    std::vector<const char*> outputNames;
+    for (const auto& name : sessionOutputNames) {
+        outputNames.push_back(name.c_str());
+    }
+
+    // The session allocates a value for every output as well
+    sessions.tensorValues += inputs.size() + outputNames.size();
+    return session.Run(Ort::RunOptions{nullptr}, inputNames.data(), inputs.data(), inputs.size(), outputNames.data(), outputNames.size());
+}
+
+void OnnxTranslationEngine::runBoundDecoder(ModelSessions& sessions, DecodeCohort& cohort, int64_t* decoderIds, int64_t rows) {
+    Ort::Session& session = cohort.started ? *sessions.decoderWithPast : *sessions.decoder;
+    const std::vector<std::string>& sessionInputNames = cohort.started ? sessions.decoderWithPastInputNames : sessions.decoderInputNames;
+    const std::vector<std::string>& sessionOutputNames = cohort.started ? sessions.decoderWithPastOutputNames : sessions.decoderOutputNames;
+    const std::vector<std::string>& pastNames = cohort.started ? sessions.decoderWithPastPastNames : sessions.decoderPastNames;
+
+    // The first step runs once per cohort on the worker's binding. Cohorts of a worker take turns,
+    // so every cohort binds decoder_with_past on its own and only rebinds what changed since its
+    // last step: the decoder cache grows by a position every step, the rest only with the rows.
+    if (cohort.started && !cohort.binding) {
+        cohort.binding = std::make_unique<Ort::IoBinding>(session);
+        cohort.boundData.assign(sessionInputNames.size() + sessionOutputNames.size(), nullptr);
+    }
+    Ort::IoBinding& binding = cohort.started ? *cohort.binding : *sessions.decoderBinding;
+    if (!cohort.started) {
+        binding.ClearBoundInputs();
+        binding.ClearBoundOutputs();
+    }
+    auto isBound = [&](size_t index, const void* data, bool fixedShape) {
+        if (cohort.started) {
+            if (fixedShape && cohort.boundRows == rows && cohort.boundData[index] == data) return true;
+            cohort.boundData[index] = data;
+        }
+        sessions.tensorValues++;
+        return false;
+    };
+
+    std::array<int64_t, 2> idsShape = {rows, 1};
+    std::array<int64_t, 2> maskShape = {rows, cohort.sourceLength};
+    std::array<int64_t, 3> hiddenShape = {rows, cohort.sourceLength, hiddenSize};
+
+    for (size_t input = 0; input < sessionInputNames.size(); ++input) {
+        const std::string& name = sessionInputNames[input];
+        if (name == "input_ids") {
+            if (isBound(input, decoderIds, true)) continue;
+            binding.BindInput(name.c_str(), Ort::Value::CreateTensor<int64_t>(memoryInfo, decoderIds, rows, idsShape.data(), idsShape.size()));
+        } else if (name == "encoder_attention_mask") {
+            if (isBound(input, cohort.attentionMask.data(), true)) continue;
+            binding.BindInput(name.c_str(), Ort::Value::CreateTensor<int64_t>(memoryInfo, cohort.attentionMask.data(), cohort.attentionMask.size(), maskShape.data(), maskShape.size()));
+        } else if (name == "encoder_hidden_states") {
+            if (isBound(input, cohort.encoderHiddenStates.data(), true)) continue;
+            binding.BindInput(name.c_str(), Ort::Value::CreateTensor<float>(memoryInfo, cohort.encoderHiddenStates.data(), cohort.encoderHiddenStates.size(), hiddenShape.data(), hiddenShape.size()));
+        } else if (cohort.pastKeyValues.count(name)) {
+            CacheTensor& cache = cohort.pastKeyValues[name];
+            const bool growing = name.find(".decoder.") != std::string::npos;
+            if (isBound(input, cache.data.data(), !growing)) continue;
+            binding.BindInput(name.c_str(), Ort::Value::CreateTensor<float>(memoryInfo, cache.data.data(), cache.data.size(), cache.shape.data(), cache.shape.size()));
+        } else {
+            throw std::runtime_error("Unexpected decoder input: " + name);
+        }
+    }
+
+    // Each output is written into an arena buffer reserved for its largest shape, the decoder
+    // cache for the longest output of the cohort, so the buffers don't grow from step to step.
+    // The caller reads them through boundOutputs instead of asking the binding for new values.
+    const int64_t headSize = hiddenSize / decoderHeads;
+    const int64_t pastPositions = pastLength(cohort);
+    sessions.boundOutputs.resize(sessionOutputNames.size());
+    for (size_t output = 0; output < sessionOutputNames.size(); ++output) {
+        const std::string& name = sessionOutputNames[output];
+        BoundOutput& bound = sessions.boundOutputs[output];
+        bool growing = false;
+        if (output == 0) {
+            bound.shape = {rows, 1, useShortlist ? hiddenSize : vocabSize, 0};
+            bound.rank = 3;
+            bound.count = static_cast<size_t>(rows * bound.shape[2]);
+            bound.data = sessions.arena.floats(name, bound.count);
+        } else if (pastNames[output].find(".encoder.") != std::string::npos) {
+            bound.shape = {rows, decoderHeads, cohort.sourceLength, headSize};
+            bound.rank = 4;
+            bound.count = static_cast<size_t>(rows * decoderHeads * cohort.sourceLength * headSize);
+            bound.data = sessions.arena.floats(name, bound.count);
+        } else if (pastNames[output].find(".decoder.") != std::string::npos) {
+            bound.shape = {rows, decoderHeads, pastPositions + 1, headSize};
+            bound.rank = 4;
+            bound.count = static_cast<size_t>(rows * decoderHeads * bound.shape[2] * headSize);
+            bound.data = sessions.arena.floats(name, static_cast<size_t>(rows * decoderHeads * std::max(cohort.maxLength, bound.shape[2]) * headSize));
+            growing = true;
+        } else {
+            throw std::runtime_error("Unexpected decoder output: " + name);
+        }
+        if (isBound(sessionInputNames.size() + output, bound.data, !growing)) continue;
+        binding.BindOutput(name.c_str(), Ort::Value::CreateTensor<float>(memoryInfo, bound.data, bound.count, bound.shape.data(), bound.rank));
+    }
+    cohort.boundRows = rows;
+
+    session.Run(Ort::RunOptions{nullptr}, binding);
+}
+
+int64_t OnnxTranslationEngine::pastLength(const DecodeCohort& cohort) {
+    for (const auto& [name, cache] : cohort.pastKeyValues) {
+        if (name.find(".decoder.") != std::string::npos && cache.shape.size() == 4) {
+            return cache.shape[2];
+        }
+    }
+    return 0;
+}
+
+std::vector<std::vector<size_t>> OnnxTranslationEngine::createBatches(const std::vector<std::vector<int64_t>>& sourceIds, const BatchingParams& batching) {
+    // Sort by token length so segments of similar length share a batch and padding stays small
+    std::vector<size_t> order(sourceIds.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sourceIds](size_t a, size_t b) {
+        return sourceIds[a].size() < sourceIds[b].size();
+    });
+
+    std::vector<std::vector<size_t>> batches;
+    std::vector<size_t> current;
+    size_t currentLongest = 0;
+    for (size_t index : order) {
+        size_t longest = std::max(currentLongest, sourceIds[index].size());
+
+        // Every row is padded to the longest one, so the token budget is rows * longest
+        if (!current.empty() && (current.size() >= batching.batchSize || longest * (current.size() + 1) > batching.maxBatchTokens)) {
+            batches.push_back(current);
+            current.clear();
+            longest = sourceIds[index].size();
+        }
+        current.push_back(index);
+        currentLongest = longest;
+    }
+
+    if (!current.empty()) {
+        batches.push_back(current);
+    }
+    return batches;
+}
+
+size_t OnnxTranslationEngine::decodeSlotCount(const GenerationParams& generation) const {
+    // Every beam holds a self attention cache that grows to maxNewTokens and a cross attention
+    // cache over the source, both for every decoder layer, and each is gathered into a new copy
+    uint64_t cachePositions = static_cast<uint64_t>(generation.maxNewTokens + 1) + MarianTokenizer::maxSourceTokens + 1;
+    uint64_t bytesPerBeam = 2 * (cachePositions * decoderLayers * 2 * hiddenSize * sizeof(float)) + static_cast<uint64_t>(vocabSize) * sizeof(float);
+    uint64_t bytesPerSlot = bytesPerBeam * generation.numBeams;
+
+    // Leave most of the memory to the OS, the GUI and the ORT arenas
+    uint64_t budget = DecodeScheduler::availableMemory() / 4;
+    return DecodeScheduler::slotsForMemory(budget, bytesPerSlot, batching.batchSize);
+}
+
+double OnnxTranslationEngine::batchCost(const std::vector<size_t>& batch, const std::vector<std::vector<int64_t>>& sourceIds, const LengthBudgetParams& lengthBudget, int maxNewTokens) {
+    // The encoder pass grows with the source tokens, the decoder steps with the output budget
+    double cost = 0.0;
+    for (size_t index : batch) {
+        size_t sourceTokens = sourceIds[index].size();
+        cost += static_cast<double>(sourceTokens) + outputBudget(sourceTokens, lengthBudget, maxNewTokens);
+    }
+    return cost;
+}
+
+int OnnxTranslationEngine::outputBudget(size_t sourceTokens, const LengthBudgetParams& lengthBudget, int maxNewTokens) {
+    if (!lengthBudget.enabled) return maxNewTokens;
+
+    double budget = std::ceil(lengthBudget.ratio * static_cast<double>(sourceTokens) + lengthBudget.slack);
+    return static_cast<int>(std::clamp<double>(budget, 1.0, maxNewTokens));
+}
+
+GenerationParams OnnxTranslationEngine::segmentParams(const GenerationParams& generation, size_t sourceTokens, bool retry) const {
+    // A short line can't run into the global cap and hold its slot for hundreds of steps
+    GenerationParams segment = generation;
+    segment.maxNewTokens = outputBudget(sourceTokens, lengthBudget, generation.maxNewTokens);
+
+    // A penalty above 1 punishes repeated tokens, unlike the configured 0.6
+    if (retry) {
+        segment.repetitionPenalty = degeneration.retryRepetitionPenalty;
+        segment.noRepeatNgramSize = degeneration.retryNoRepeatNgramSize;
+    }
+    return segment;
+}
+
+void OnnxTranslationEngine::encodeSources(ModelSessions& sessions, TensorArena& sourceArena, const std::vector<size_t>& batch, const std::vector<std::vector<int64_t>>& sourceIds, std::unordered_map<size_t, EncodedSource>& encoded) {
+    const int64_t rows = static_cast<int64_t>(batch.size());
+    int64_t sourceLength = 0;
+    for (size_t index : batch) {
+        sourceLength = std::max<int64_t>(sourceLength, sourceIds[index].size());
+    }
+
+    // Right pad the sources so they form a single [rows, sourceLength] batch
+    int64_t* inputIds = sessions.arena.int64s("encoder.input_ids", rows * sourceLength);
+    int64_t* attentionMask = sessions.arena.int64s("encoder.attention_mask", rows * sourceLength);
+    std::fill(inputIds, inputIds + rows * sourceLength, MARIAN_PAD_ID);
+    std::fill(attentionMask, attentionMask + rows * sourceLength, 0);
+    for (int64_t row = 0; row < rows; ++row) {
+        const std::vector<int64_t>& ids = sourceIds[batch[row]];
+        std::copy(ids.begin(), ids.end(), inputIds + row * sourceLength);
+        std::fill(attentionMask + row * sourceLength, attentionMask + row * sourceLength + ids.size(), 1);
+    }
+
+    const float* hiddenStates = runEncoder(sessions, inputIds, attentionMask, rows, sourceLength);
+
+    // Each segment keeps only its own positions so it can join any cohort later
+    for (int64_t row = 0; row < rows; ++row) {
+        EncodedSource source;
+        source.length = static_cast<int64_t>(sourceIds[batch[row]].size());
+        const float* rowStart = hiddenStates + row * sourceLength * hiddenSize;
+        source.hiddenStates = sourceArena.acquireFloats(source.length * hiddenSize);
+        source.hiddenStates.assign(rowStart, rowStart + source.length * hiddenSize);
+        encoded[batch[row]] = std::move(source);
+    }
+}
+
+DecodeCohort OnnxTranslationEngine::startCohort(ModelSessions& sessions, const GenerationParams& generation, const std::vector<std::pair<size_t, size_t>>& assigned, const std::vector<std::vector<int64_t>>& sourceIds, std::unordered_map<size_t, EncodedSource>& encoded, std::vector<BeamSearch>& searches) {
+    DecodeCohort cohort;
+    cohort.numBeams = static_cast<size_t>(generation.numBeams);
+    for (const auto& [slot, index] : assigned) {
+        GenerationParams segment = segmentParams(generation, sourceIds[index].size(), encoded[index].retry);
+        cohort.slots.push_back(slot);
+        cohort.sourceLength = std::max(cohort.sourceLength, encoded[index].length);
+        cohort.maxLength = std::max<int64_t>(cohort.maxLength, segment.maxNewTokens + 1);
+        searches[slot] = BeamSearch(segment, vocabSize);
+        searches[slot].start();
+    }
+
+    // Every beam gets its own copy of the segment's encoder output and mask
+    const int64_t rows = static_cast<int64_t>(assigned.size()) * generation.numBeams;
+    cohort.encoderHiddenStates = sessions.arena.acquireFloats(rows * cohort.sourceLength * hiddenSize);
+    cohort.encoderHiddenStates.assign(rows * cohort.sourceLength * hiddenSize, 0.0f);
+    cohort.attentionMask = sessions.arena.acquireInt64s(rows * cohort.sourceLength);
+    cohort.attentionMask.assign(rows * cohort.sourceLength, 0);
+    for (size_t i = 0; i < assigned.size(); ++i) {
+        const EncodedSource& source = encoded[assigned[i].second];
+        for (int beam = 0; beam < generation.numBeams; ++beam) {
+            int64_t row = static_cast<int64_t>(i) * generation.numBeams + beam;
+            std::copy(source.hiddenStates.begin(), source.hiddenStates.end(), cohort.encoderHiddenStates.begin() + row * cohort.sourceLength * hiddenSize);
+            std::fill(cohort.attentionMask.begin() + row * cohort.sourceLength, cohort.attentionMask.begin() + row * cohort.sourceLength + source.length, 1);
+        }
+        sessions.arena.release(encoded[assigned[i].second].hiddenStates);
+        encoded.erase(assigned[i].second);
+    }
+
+    if (useShortlist) {
+        std::vector<const std::vector<int64_t>*> sources;
+        for (const auto& [slot, index] : assigned) {
+            sources.push_back(&sourceIds[index]);
+        }
+        // A shortlist that large saves little and risks cutting off a rare word
+        cohort.candidates = lexicalShortlist.candidates(sources);
+        if (cohort.candidates.size() > shortlist.maxCandidates) {
+            cohort.candidates.clear();
+        }
+    }
+    return cohort;
+}
+
+void OnnxTranslationEngine::decodeCohortStep(ModelSessions& sessions, DecodeCohort& cohort, std::vector<BeamSearch>& searches, std::vector<size_t>& finished, EngineStats& stepStats) {
+    auto start = std::chrono::high_resolution_clock::now();
+    const size_t numBeams = cohort.numBeams;
+    const std::vector<std::string>& pastNames = cohort.started ? sessions.decoderWithPastPastNames : sessions.decoderPastNames;
+
+    const size_t rowCount = cohort.slots.size() * numBeams;
+    int64_t* decoderIds = sessions.arena.int64s("input_ids", rowCount);
+    for (size_t i = 0; i < cohort.slots.size(); ++i) {
+        for (size_t beam = 0; beam < numBeams; ++beam) {
+            decoderIds[i * numBeams + beam] = searches[cohort.slots[i]].beam(beam).back();
+        }
+    }
+
+    runBoundDecoder(sessions, cohort, decoderIds, static_cast<int64_t>(rowCount));
+    const std::vector<BoundOutput>& outputs = sessions.boundOutputs;
+
+    // logits is [rows, 1, vocab] since every step feeds a single token per beam
+    float* logits = nullptr;
+    if (useShortlist) {
+        // The shortlist decoders return the hidden state [rows, 1, hidden] in place of the logits
+        logits = sessions.arena.floats("projected_logits", rowCount * vocabSize);
+        outputProjection.project(outputs[0].data, rowCount, cohort.candidates, logits);
+        stepStats.projectedLogits += rowCount * (cohort.candidates.empty() ? vocabSize : cohort.candidates.size());
+    } else {
+        logits = outputs[0].data;
+    }
+
+    // Rows of the segments that keep decoding. Decoder caches follow the beams they extend,
+    // the encoder caches and mask are the same for every beam of a segment.
+    std::vector<size_t>& keptSlots = sessions.keptSlots;
+    std::vector<size_t>& decoderRows = sessions.decoderRows;
+    std::vector<size_t>& encoderRows = sessions.encoderRows;
+    finished.clear();
+    keptSlots.clear();
+    decoderRows.clear();
+    encoderRows.clear();
+    cohort.degenerate.clear();
+    for (size_t i = 0; i < cohort.slots.size(); ++i) {
+        size_t slot = cohort.slots[i];
+        const std::vector<size_t>& sources = searches[slot].advance(logits + i * numBeams * vocabSize);
+        if (searches[slot].isDone()) {
+            finished.push_back(slot);
+            continue;
+        }
+
+        // The best beam decides, a looping runner-up usually drops out by itself
+        if (degenerationDetector.isDegenerate(searches[slot].beam(0))) {
+            cohort.degenerate.push_back(slot);
+            finished.push_back(slot);
+            continue;
+        }
+
+        keptSlots.push_back(slot);
+        for (size_t beam = 0; beam < numBeams; ++beam) {
+            decoderRows.push_back(i * numBeams + sources[beam]);
+            encoderRows.push_back(i * numBeams + beam);
+        }
+    }
+    const bool pruned = keptSlots.size() != cohort.slots.size();
+
+    for (auto& [name, cache] : cohort.pastKeyValues) {
+        cache.refreshed = false;
+    }
+    for (size_t output = 1; output < outputs.size(); ++output) {
+        const std::string& name = pastNames[output];
+        if (name.empty()) continue;
+
+        const std::array<int64_t, 4>& shape = outputs[output].shape;
+        size_t rowSize = outputs[output].count / shape[0];
+        const bool encoderCache = name.find(".encoder.") != std::string::npos;
+        const std::vector<size_t>& rows = encoderCache ? encoderRows : decoderRows;
+
+        // The decoder cache is reserved for the cohort's longest output, so gathering a step
+        // into it never reallocates
+        CacheTensor& cache = cohort.pastKeyValues[name];
+        if (cache.data.capacity() == 0) {
+            size_t positions = encoderCache ? shape[2] : std::max<int64_t>(cohort.maxLength, shape[2]);
+            cache.data = sessions.arena.acquireFloats(rows.size() * rowSize / shape[2] * positions);
+        }
+        gatherRows(outputs[output].data, rowSize, rows, cache.data);
+        cache.shape.assign(shape.begin(), shape.begin() + outputs[output].rank);
+        cache.shape[0] = static_cast<int64_t>(rows.size());
+        cache.refreshed = true;
+    }
+
+    if (pruned) {
+        // The encoder cache is only returned by the first step, later steps prune the stored copy
+        for (auto& [name, cache] : cohort.pastKeyValues) {
+            if (cache.refreshed) continue;
+            compactRows(cache.data, cache.data.size() / cache.shape[0], encoderRows);
+            cache.shape[0] = static_cast<int64_t>(encoderRows.size());
+        }
+        compactRows(cohort.attentionMask, cohort.sourceLength, encoderRows);
+        cohort.slots = keptSlots;
+    }
+
+    // The hidden states are only needed again if the cached graph asks for them
+    bool withPastNeedsHidden = std::find(sessions.decoderWithPastInputNames.begin(), sessions.decoderWithPastInputNames.end(), "encoder_hidden_states") != sessions.decoderWithPastInputNames.end();
+    if (!withPastNeedsHidden) {
+        sessions.arena.release(cohort.encoderHiddenStates);
+    } else if (pruned) {
+        compactRows(cohort.encoderHiddenStates, cohort.sourceLength * hiddenSize, encoderRows);
+    }
+
+    cohort.started = true;
+
+    auto end = std::chrono::high_resolution_clock::now();
+    stepStats.decodeSteps++;
+    stepStats.decodeSeconds += std::chrono::duration<double>(end - start).count();
+}
+
+void OnnxTranslationEngine::releaseCohort(TensorArena& arena, DecodeCohort& cohort) {
+    // The next cohort of the worker reuses the buffers instead of allocating its own
+    arena.release(cohort.encoderHiddenStates);
+    arena.release(cohort.attentionMask);
+    for (auto& [name, cache] : cohort.pastKeyValues) {
+        arena.release(cache.data);
+    }
+}
+
+void OnnxTranslationEngine::decode(const std::vector<std::vector<int64_t>>& sourceIds, std::vector<std::vector<int64_t>>& generated, std::vector<bool>& completed, std::vector<float>& confidences, const SegmentCallback& onFinished) {
+    if (!twoTier.enabled || params.numBeams == 1) {
+        generate(params, sourceIds, generated, completed, confidences, onFinished);
+        return;
+    }
+
+    // The greedy pass keeps every other setting. Confident greedy translations are final right
+    // away, the rest once the beams are done.
+    GenerationParams greedy = params;
+    greedy.numBeams = 1;
+    generate(greedy, sourceIds, generated, completed, confidences, [&](size_t index) {
+        if (onFinished && confidences[index] >= twoTier.confidenceThreshold) onFinished(index);
+    });
+
+    std::vector<size_t> escalated;
+    for (size_t i = 0; i < sourceIds.size(); ++i) {
+        if (completed[i] && confidences[i] < twoTier.confidenceThreshold) {
+            escalated.push_back(i);
+        }
+    }
+    if (escalated.empty()) return;
+
+    std::vector<std::vector<int64_t>> escalatedIds;
+    escalatedIds.reserve(escalated.size());
+    for (size_t index : escalated) {
+        escalatedIds.push_back(sourceIds[index]);
+    }
+    std::vector<std::vector<int64_t>> beamGenerated;
+    std::vector<bool> beamCompleted;
+    std::vector<float> beamConfidences;
+    generate(params, escalatedIds, beamGenerated, beamCompleted, beamConfidences, [&](size_t i) {
+        generated[escalated[i]] = std::move(beamGenerated[i]);
+        confidences[escalated[i]] = beamConfidences[i];
+        if (onFinished) onFinished(escalated[i]);
+    });
+
+    // A failed beam decode keeps the greedy translation
+    for (size_t i = 0; i < escalated.size(); ++i) {
+        if (!beamCompleted[i] && onFinished) onFinished(escalated[i]);
+    }
+
+    EngineStats escalationStats;
+    escalationStats.escalatedSegments = escalated.size();
+    addStats(escalationStats);
+}
+
+void OnnxTranslationEngine::generate(const GenerationParams& generation, const std::vector<std::vector<int64_t>>& sourceIds, std::vector<std::vector<int64_t>>& generated, std::vector<bool>& completed, std::vector<float>& confidences, const SegmentCallback& onFinished) {
+    generated.assign(sourceIds.size(), {});
+    completed.assign(sourceIds.size(), false);
+    confidences.assign(sourceIds.size(), 0.0f);
+
+    // The encoder batches are dealt out longest first and each worker claims its next one when
+    // its slots run low, stealing from the others once its own share is done
+    std::vector<std::vector<size_t>> encoderBatches = createBatches(sourceIds, batching);
+    std::vector<double> costs;
+    costs.reserve(encoderBatches.size());
+    for (const auto& batch : encoderBatches) {
+        costs.push_back(batchCost(batch, sourceIds, lengthBudget, generation.maxNewTokens));
+    }
+    WorkStealingQueue queue(costs, workers.size());
+    std::mutex resultMutex;
+
+    // The cache memory budget is split between the workers
+    size_t slotCount = std::max<size_t>(1, decodeSlotCount(generation) / workers.size());
+    std::cout << "Decoding with " << workers.size() << " workers of " << slotCount << " slots of " << generation.numBeams << " beams." << "\n";
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::exception_ptr> errors(workers.size());
+    std::vector<double> busySeconds(workers.size(), 0.0);
+    std::vector<std::thread> threads;
+    for (size_t worker = 0; worker < workers.size(); ++worker) {
+        threads.emplace_back([&, worker]() {
+            auto workerStart = std::chrono::high_resolution_clock::now();
+            if (sessionPool.pinThreads) {
+                CpuTopology::pinCurrentThread({workerCores[worker].front()});
+            }
+            try {
+                if (useSpeculative) {
+                    speculativeWorker(workers[worker], draftWorkers[worker], generation, sourceIds, encoderBatches, queue, worker, generated, completed, confidences, resultMutex, onFinished);
+                } else if (usePipeline) {
+                    // The encoder thread claims the batches and fills the queue while this thread decodes
+                    BoundedQueue<EncodedBatch> encodedBatches(pipeline.queueDepth);
+                    std::exception_ptr encoderError;
+                    std::thread encoderThread([&]() {
+                        try {
+                            encoderStage(encoderWorkers[worker], workers[worker].arena, sourceIds, encoderBatches, queue, worker, encodedBatches);
+                        } catch (...) {
+                            encoderError = std::current_exception();
+                            encodedBatches.close();
+                        }
+                    });
+                    try {
+                        decodeWorker(workers[worker], generation, slotCount, sourceIds, encoderBatches, queue, worker, generated, completed, confidences, resultMutex, onFinished, &encodedBatches);
+                    } catch (...) {
+                        encodedBatches.close();
+                        encoderThread.join();
+                        throw;
+                    }
+                    encoderThread.join();
+                    if (encoderError) std::rethrow_exception(encoderError);
+                } else {
+                    decodeWorker(workers[worker], generation, slotCount, sourceIds, encoderBatches, queue, worker, generated, completed, confidences, resultMutex, onFinished);
+                }
+            } catch (...) {
+                errors[worker] = std::current_exception();
+            }
+            busySeconds[worker] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - workerStart).count();
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        double makespan = std::chrono::duration<double>(end - start).count();
+        engineStats.generateSeconds += makespan;
+
+        // A worker is idle from the moment the queue has nothing left for it until the last one ends
+        engineStats.workerBusySeconds.resize(workers.size(), 0.0);
+        engineStats.workerIdleSeconds.resize(workers.size(), 0.0);
+        for (size_t worker = 0; worker < workers.size(); ++worker) {
+            engineStats.workerBusySeconds[worker] += busySeconds[worker];
+            engineStats.workerIdleSeconds[worker] += std::max(0.0, makespan - busySeconds[worker]);
+        }
+    }
+
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+void OnnxTranslationEngine::encoderStage(ModelSessions& encoderSessions, TensorArena& sourceArena, const std::vector<std::vector<int64_t>>& sourceIds, const std::vector<std::vector<size_t>>& encoderBatches, WorkStealingQueue& queue, size_t worker, BoundedQueue<EncodedBatch>& encodedBatches) {
+    // Cores shared with the decoder are left to the scheduler, the decoder thread is pinned to the first one
+    if (sessionPool.pinThreads && encoderCores[worker] != workerCores[worker]) {
+        CpuTopology::pinCurrentThread({encoderCores[worker].front()});
+    }
+    EngineStats stageStats;
+    const size_t allocationsBefore = encoderSessions.arena.allocations();
+    const size_t valuesBefore = encoderSessions.tensorValues;
+
+    while (true) {
+        EncodedBatch encodedBatch;
+        bool stolen = false;
+        if (!queue.next(worker, encodedBatch.batchIndex, stolen)) break;
+        stageStats.stolenBatches += stolen;
+
+        // The hidden states are taken from the decoder's arena, which gets them back once a cohort starts
+        const std::vector<size_t>& batch = encoderBatches[encodedBatch.batchIndex];
+        auto start = std::chrono::high_resolution_clock::now();
+        try {
+            encodeSources(encoderSessions, sourceArena, batch, sourceIds, encodedBatch.sources);
+        } catch (const Ort::Exception& e) {
+            std::cerr << "Error encoding batch of " << batch.size() << " segments, Details: " << e.what() << "\n";
+            continue;
+        }
+        auto encodedAt = std::chrono::high_resolution_clock::now();
+        stageStats.encoderStageSeconds += std::chrono::duration<double>(encodedAt - start).count();
+
+        // The decoder closes the queue when it fails, the rest of the share is dropped with it
+        bool pushed = encodedBatches.push(std::move(encodedBatch));
+        stageStats.encoderBlockedSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - encodedAt).count();
+        if (!pushed) break;
+    }
+
+    encodedBatches.close();
+    stageStats.arenaGrowths = encoderSessions.arena.allocations() - allocationsBefore;
+    stageStats.tensorValues = encoderSessions.tensorValues - valuesBefore;
+    addStats(stageStats);
+}
+
+void OnnxTranslationEngine::decodeWorker(ModelSessions& sessions, const GenerationParams& generation, size_t slotCount, const std::vector<std::vector<int64_t>>& sourceIds, const std::vector<std::vector<size_t>>& encoderBatches, WorkStealingQueue& queue, size_t worker, std::vector<std::vector<int64_t>>& generated, std::vector<bool>& completed, std::vector<float>& confidences, std::mutex& resultMutex, const SegmentCallback& onFinished, BoundedQueue<EncodedBatch>* encodedBatches) {
+    std::unordered_map<size_t, EncodedSource> encoded;
+    DecodeScheduler scheduler(slotCount);
+    std::vector<BeamSearch> searches(scheduler.slotCount());
+    std::list<DecodeCohort> cohorts;
+    EngineStats workerStats;
+
+    // The step buffers are sized for full slots up front, the caches reach their size with the first long cohort
+    const size_t allocationsBefore = sessions.arena.allocations();
+    const size_t valuesBefore = sessions.tensorValues;
+    const size_t maxRows = scheduler.slotCount() * generation.numBeams;
+    sessions.arena.int64s("input_ids", maxRows);
+    sessions.arena.floats(sessions.decoderOutputNames.front(), maxRows * (useShortlist ? hiddenSize : vocabSize));
+    sessions.arena.floats(sessions.decoderWithPastOutputNames.front(), maxRows * (useShortlist ? hiddenSize : vocabSize));
+    if (useShortlist) {
+        sessions.arena.floats("projected_logits", maxRows * vocabSize);
+    }
+    std::vector<size_t> finished;
+    finished.reserve(scheduler.slotCount());
+    sessions.keptSlots.reserve(scheduler.slotCount());
+    sessions.decoderRows.reserve(maxRows);
+    sessions.encoderRows.reserve(maxRows);
+
+    // Segments that degenerated once are decoded again with the retry settings, but only once
+    std::vector<size_t> retries;
+    std::unordered_set<size_t> retried;
+
+    while (true) {
+        // Each cohort costs a decoder run per step, so free slots are refilled in groups
+        bool refill = cohorts.empty() || scheduler.freeSlotCount() * 4 >= scheduler.slotCount();
+
+        if (refill && !retries.empty()) {
+            try {
+                encodeSources(sessions, sessions.arena, retries, sourceIds, encoded);
+                for (size_t index : retries) {
+                    encoded[index].retry = true;
+                    scheduler.enqueue(index);
+                }
+                workerStats.redecodedSegments += retries.size();
+            } catch (const Ort::Exception& e) {
+                std::cerr << "Error encoding " << retries.size() << " segments for a second decode, Details: " << e.what() << "\n";
+            }
+            retries.clear();
+        }
+
+        while (refill && scheduler.pendingCount() < scheduler.freeSlotCount()) {
+            if (encodedBatches) {
+                // Decoding never waits for the encoder, only a worker with nothing to decode blocks
+                EncodedBatch encodedBatch;
+                bool idle = cohorts.empty() && scheduler.pendingCount() == 0;
+                auto waitStart = std::chrono::high_resolution_clock::now();
+                if (!(idle ? encodedBatches->pop(encodedBatch) : encodedBatches->tryPop(encodedBatch))) break;
+                if (idle) {
+                    workerStats.decoderStarvedSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - waitStart).count();
+                }
+                for (size_t index : encoderBatches[encodedBatch.batchIndex]) {
+                    encoded[index] = std::move(encodedBatch.sources[index]);
+                    scheduler.enqueue(index);
+                }
+                continue;
+            }
+
+            size_t batchIndex = 0;
+            bool stolen = false;
+            if (!queue.next(worker, batchIndex, stolen)) break;
+            workerStats.stolenBatches += stolen;
+
+            const std::vector<size_t>& batch = encoderBatches[batchIndex];
+            // A failed encoder batch is skipped so the callers keep the untranslated text
+            try {
+                encodeSources(sessions, sessions.arena, batch, sourceIds, encoded);
+            } catch (const Ort::Exception& e) {
+                std::cerr << "Error encoding batch of " << batch.size() << " segments, Details: " << e.what() << "\n";
+                continue;
+            }
+            for (size_t index : batch) {
+                scheduler.enqueue(index);
+            }
+        }
+
+        if (refill) {
+            std::vector<std::pair<size_t, size_t>> assigned = scheduler.refill();
+            if (!assigned.empty()) {
+                cohorts.push_back(startCohort(sessions, generation, assigned, sourceIds, encoded, searches));
+            }
+        }
+
+        if (cohorts.empty()) break;
+
+        for (auto cohort = cohorts.begin(); cohort != cohorts.end();) {
+            try {
+                decodeCohortStep(sessions, *cohort, searches, finished, workerStats);
+            } catch (const Ort::Exception& e) {
+                // A failed step drops the cohort, the rest of the queue still gets translated
+                std::cerr << "Error decoding " << cohort->slots.size() << " segments, Details: " << e.what() << "\n";
+                for (size_t slot : cohort->slots) {
+                    scheduler.release(slot);
+                }
+                releaseCohort(sessions.arena, *cohort);
+                cohort = cohorts.erase(cohort);
+                continue;
+            }
+
+            // Finished slots are handed back to the scheduler for the next pending segments
+            if (!finished.empty()) {
+                std::lock_guard<std::mutex> lock(resultMutex);
+                for (size_t slot : finished) {
+                    size_t segment = scheduler.segmentInSlot(slot);
+                    if (std::find(cohort->degenerate.begin(), cohort->degenerate.end(), slot) != cohort->degenerate.end()) {
+                        workerStats.degenerateSegments++;
+                        workerStats.degenerateTokens += searches[slot].beam(0).size() - 1;
+                        // A second loop keeps what was generated, the segment isn't worth a third decode
+                        if (retried.insert(segment).second) {
+                            retries.push_back(segment);
+                            continue;
+                        }
+                    }
+                    generated[segment] = searches[slot].best();
+                    confidences[segment] = searches[slot].bestScore();
+                    completed[segment] = true;
+                    workerStats.generatedTokens += generated[segment].size() - 1;
+                    if (onFinished) onFinished(segment);
+                }
+            }
+            for (size_t slot : finished) {
+                scheduler.release(slot);
+            }
+
+            if (cohort->slots.empty()) {
+                releaseCohort(sessions.arena, *cohort);
+                cohort = cohorts.erase(cohort);
+            } else {
+                ++cohort;
+            }
+        }
+    }
+
+    workerStats.arenaGrowths = sessions.arena.allocations() - allocationsBefore;
+    workerStats.tensorValues = sessions.tensorValues - valuesBefore;
+    addStats(workerStats);
+}
+
+void OnnxTranslationEngine::speculativeWorker(ModelSessions& sessions, ModelSessions& draft, const GenerationParams& generation, const std::vector<std::vector<int64_t>>& sourceIds, const std::vector<std::vector<size_t>>& encoderBatches, WorkStealingQueue& queue, size_t worker, std::vector<std::vector<int64_t>>& generated, std::vector<bool>& completed, std::vector<float>& confidences, std::mutex& resultMutex, const SegmentCallback& onFinished) {
+    EngineStats workerStats;
+    const size_t allocationsBefore = sessions.arena.allocations() + draft.arena.allocations();
+    const size_t valuesBefore = sessions.tensorValues + draft.tensorValues;
+
+    // Each segment decodes on its own, the verification pass has no room for other rows
+    while (true) {
+        size_t batchIndex = 0;
+        bool stolen = false;
+        if (!queue.next(worker, batchIndex, stolen)) break;
+        workerStats.stolenBatches += stolen;
+
+        const std::vector<size_t>& batch = encoderBatches[batchIndex];
+        std::unordered_map<size_t, EncodedSource> encoded;
+        try {
+            encodeSources(sessions, sessions.arena, batch, sourceIds, encoded);
+        } catch (const Ort::Exception& e) {
+            std::cerr << "Error encoding batch of " << batch.size() << " segments, Details: " << e.what() << "\n";
+            continue;
+        }
+
+        for (size_t index : batch) {
+            std::vector<int64_t> tokens;
+            float confidence = 0.0f;
+            try {
+                bool degenerate = false;
+                tokens = decodeSpeculative(sessions, draft, generation, sourceIds[index], encoded[index], workerStats, degenerate, confidence);
+                if (degenerate) {
+                    encoded[index].retry = true;
+                    workerStats.redecodedSegments++;
+                    tokens = decodeSpeculative(sessions, draft, generation, sourceIds[index], encoded[index], workerStats, degenerate, confidence);
+                }
+            } catch (const Ort::Exception& e) {
+                std::cerr << "Error decoding segment " << index << ", Details: " << e.what() << "\n";
+                sessions.arena.release(encoded[index].hiddenStates);
+                continue;
+            }
+            sessions.arena.release(encoded[index].hiddenStates);
+
+            workerStats.generatedTokens += tokens.size() - 1;
+            std::lock_guard<std::mutex> lock(resultMutex);
+            generated[index] = std::move(tokens);
+            confidences[index] = confidence;
+            completed[index] = true;
+            if (onFinished) onFinished(index);
+        }
+    }
+
+    workerStats.arenaGrowths = sessions.arena.allocations() + draft.arena.allocations() - allocationsBefore;
+    workerStats.tensorValues = sessions.tensorValues + draft.tensorValues - valuesBefore;
+    addStats(workerStats);
+}
+
+std::vector<int64_t> OnnxTranslationEngine::decodeSpeculative(ModelSessions& sessions, ModelSessions& draft, const GenerationParams& generation, const std::vector<int64_t>& sourceIds, const EncodedSource& source, EngineStats& stepStats, bool& degenerate, float& confidence) {
+    // The main model keeps its own cache, each pass feeds only the tokens it hasn't seen yet
+    DecodeCohort verifier;
+    verifier.sourceLength = source.length;
+    verifier.attentionMask.assign(source.length, 1);
+    verifier.encoderHiddenStates = source.hiddenStates;
+    if (useShortlist) {
+        verifier.candidates = lexicalShortlist.candidates({&sourceIds});
+        if (verifier.candidates.size() > shortlist.maxCandidates) {
+            verifier.candidates.clear();
+        }
+    }
+
+    std::vector<int64_t> mask(sourceIds.size(), 1);
+    DecodeCohort drafter;
+    drafter.sourceLength = static_cast<int64_t>(sourceIds.size());
+    drafter.attentionMask = mask;
+    const float* draftHidden = runEncoder(draft, sourceIds.data(), mask.data(), 1, drafter.sourceLength);
+    drafter.encoderHiddenStates.assign(draftHidden, draftHidden + drafter.sourceLength * draft.encoderHiddenSize);
+    size_t draftCached = 0;
+
+    GenerationParams budgeted = segmentParams(generation, sourceIds.size(), source.retry);
+    degenerate = false;
+    BeamSearch search(budgeted, vocabSize);
+    search.start();
+    while (!search.isDone()) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<int64_t> sequence = search.beam(0);
+
+        // The last position is left to the main model, which forces EOS there. A draft model that
+        // is rarely right only costs time, the worker then decodes with the main model alone.
+        size_t remaining = static_cast<size_t>(budgeted.maxNewTokens) + 1 - sequence.size();
+        bool drafting = stepStats.draftedTokens < speculative.probeTokens || static_cast<double>(stepStats.acceptedTokens) >= speculative.minAcceptanceRate * static_cast<double>(stepStats.draftedTokens);
+        std::vector<int64_t> drafted = drafting ? proposeDraft(draft, drafter, sequence, draftCached, std::min(speculative.draftTokens, remaining - 1)) : std::vector<int64_t>();
+
+        // The cache holds every token but the last, position i of the output predicts the token
+        // after input i, so the first prediction that counts is the one after the last token
+        const size_t cached = static_cast<size_t>(pastLength(verifier));
+        std::vector<int64_t> verifyIds(sequence.begin() + cached, sequence.end());
+        verifyIds.insert(verifyIds.end(), drafted.begin(), drafted.end());
+        std::vector<Ort::Value> outputs = runDecoder(sessions, verifier, verifyIds, static_cast<int64_t>(verifyIds.size()));
+        storePresent(verifier, outputs, verifier.started ? sessions.decoderWithPastOutputNames : sessions.decoderOutputNames);
+        verifier.started = true;
+
+        const size_t first = sequence.size() - 1 - cached;
+        const size_t positions = drafted.size() + 1;
+        float* logits = nullptr;
+        std::vector<float> projected;
+        if (useShortlist) {
+            projected.resize(positions * vocabSize);
+            outputProjection.project(outputs[0].GetTensorData<float>() + first * hiddenSize, positions, verifier.candidates, projected.data());
+            logits = projected.data();
+            stepStats.projectedLogits += positions * (verifier.candidates.empty() ? vocabSize : verifier.candidates.size());
+        } else {
+            logits = outputs[0].GetTensorMutableData<float>() + first * vocabSize;
+        }
+
+        // The search picks each token from the main model's logits, so a draft token only
+        // survives if it is exactly what greedy search would have produced
+        size_t accepted = 0;
+        for (size_t i = 0; i < positions; ++i) {
+            search.advance(logits + i * vocabSize);
+            if (search.isDone() || i == drafted.size() || search.beam(0).back() != drafted[i]) break;
+            ++accepted;
+        }
+
+        // Rejected draft tokens leave both caches
+        draftCached = std::min(draftCached, sequence.size() + accepted);
+        truncateDecoderCache(drafter, static_cast<int64_t>(draftCached));
+        truncateDecoderCache(verifier, static_cast<int64_t>(sequence.size() + accepted));
+
+        auto end = std::chrono::high_resolution_clock::now();
+        stepStats.decodeSteps++;
+        stepStats.decodeSeconds += std::chrono::duration<double>(end - start).count();
+        stepStats.draftedTokens += drafted.size();
+        stepStats.acceptedTokens += accepted;
+
+        if (!search.isDone() && degenerationDetector.isDegenerate(search.beam(0))) {
+            degenerate = true;
+            stepStats.degenerateSegments++;
+            stepStats.degenerateTokens += search.beam(0).size() - 1;
+            break;
+        }
+    }
+    confidence = search.bestScore();
+    return search.best();
+}
+
+std::vector<int64_t> OnnxTranslationEngine::proposeDraft(ModelSessions& draft, DecodeCohort& drafter, const std::vector<int64_t>& sequence, size_t& draftCached, size_t count) {
+    std::vector<int64_t> drafted;
+    if (count == 0) return drafted;
+
+    // The draft cache first catches up with the tokens the main model accepted or corrected
+    size_t next = draftCached;
+    while (drafted.size() < count) {
+        std::vector<int64_t> ids = {next < sequence.size() ? sequence[next++] : drafted.back()};
+        std::vector<Ort::Value> outputs = runDecoder(draft, drafter, ids);
+        storePresent(drafter, outputs, drafter.started ? draft.decoderWithPastOutputNames : draft.decoderOutputNames);
+        drafter.started = true;
+        draftCached++;
+        if (next < sequence.size()) continue;
+
+        // Greedy proposals, the pad token can never be accepted
+        float* logits = outputs[0].GetTensorMutableData<float>();
+        if (MARIAN_PAD_ID < vocabSize) {
+            logits[MARIAN_PAD_ID] = -std::numeric_limits<float>::infinity();
+        }
+        int64_t token = std::max_element(logits, logits + vocabSize) - logits;
+        drafted.push_back(token);
+        if (token == MARIAN_EOS_ID) break;
+    }
+    return drafted;
+}
+
+void OnnxTranslationEngine::storePresent(DecodeCohort& cohort, std::vector<Ort::Value>& outputs, const std::vector<std::string>& outputNames) {
+    for (size_t output = 1; output < outputs.size(); ++output) {
+        std::string name = outputNames[output];
+        if (name.rfind("present", 0) != 0) continue;
+        name.replace(0, std::string("present").size(), "past_key_values");
+
+        const float* data = outputs[output].GetTensorData<float>();
+        CacheTensor& cache = cohort.pastKeyValues[name];
+        cache.data.assign(data, data + outputs[output].GetTensorTypeAndShapeInfo().GetElementCount());
+        cache.shape = outputs[output].GetTensorTypeAndShapeInfo().GetShape();
+    }
+}
+
+void OnnxTranslationEngine::truncateDecoderCache(DecodeCohort& cohort, int64_t length) {
+    for (auto& [name, cache] : cohort.pastKeyValues) {
+        if (name.find(".decoder.") == std::string::npos || cache.shape[2] <= length) continue;
+
+        // [rows, heads, length, headSize], every (row, head) keeps its first positions. The blocks
+        // only move towards the front, so they are compacted in place.
+        const int64_t blocks = cache.shape[0] * cache.shape[1];
+        const int64_t headSize = cache.shape[3];
+        for (int64_t block = 1; block < blocks; ++block) {
+            auto blockStart = cache.data.begin() + block * cache.shape[2] * headSize;
+            std::copy(blockStart, blockStart + length * headSize, cache.data.begin() + block * length * headSize);
+        }
+        cache.data.resize(blocks * length * headSize);
+        cache.shape[2] = length;
+    }
+}
+
+void OnnxTranslationEngine::addStats(const EngineStats& workerStats) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    engineStats.decodeSteps += workerStats.decodeSteps;
+    engineStats.decodeSeconds += workerStats.decodeSeconds;
+    engineStats.projectedLogits += workerStats.projectedLogits;
+    engineStats.generatedTokens += workerStats.generatedTokens;
+    engineStats.draftedTokens += workerStats.draftedTokens;
+    engineStats.acceptedTokens += workerStats.acceptedTokens;
+    engineStats.degenerateSegments += workerStats.degenerateSegments;
+    engineStats.degenerateTokens += workerStats.degenerateTokens;
+    engineStats.redecodedSegments += workerStats.redecodedSegments;
+    engineStats.packedSegments += workerStats.packedSegments;
+    engineStats.unpackedSegments += workerStats.unpackedSegments;
+    engineStats.stolenBatches += workerStats.stolenBatches;
+    engineStats.escalatedSegments += workerStats.escalatedSegments;
+    engineStats.arenaGrowths += workerStats.arenaGrowths;
+    engineStats.tensorValues += workerStats.tensorValues;
+    engineStats.encoderStageSeconds += workerStats.encoderStageSeconds;
+    engineStats.encoderBlockedSeconds += workerStats.encoderBlockedSeconds;
+    engineStats.decoderStarvedSeconds += workerStats.decoderStarvedSeconds;
+}
+
+void OnnxTranslationEngine::translatePacked(const std::vector<TranslationSegment>& segments, const std::vector<std::vector<int64_t>>& sourceIds, std::vector<std::string>& translations, std::vector<bool>& completed, std::vector<float>& confidences, const SegmentCallback& onFinished) {
+    std::vector<size_t> sourceTokens;
+    sourceTokens.reserve(sourceIds.size());
+    for (const auto& ids : sourceIds) {
+        sourceTokens.push_back(ids.size());
+    }
+    std::vector<PackedSegment> packed = segmentPacker.pack(segments, sourceTokens);
+
+    // Single segments keep their tokens, only the packed texts need encoding
+    std::vector<std::string> packedTexts;
+    std::vector<size_t> packedIndices;
+    std::vector<std::vector<int64_t>> packedIds(packed.size());
+    for (size_t i = 0; i < packed.size(); ++i) {
+        if (packed[i].members.size() == 1) {
+            packedIds[i] = sourceIds[packed[i].members.front()];
+        } else {
+            packedTexts.push_back(packed[i].text);
+            packedIndices.push_back(i);
+        }
+    }
+    std::vector<std::vector<int64_t>> encodedTexts = tokenizer.encodeBatch(packedTexts);
+    for (size_t i = 0; i < packedIndices.size(); ++i) {
+        packedIds[packedIndices[i]] = std::move(encodedTexts[i]);
+    }
+
+    // A packed sequence is split as soon as it is decoded, its members are final unless the split fails
+    EngineStats packingStats;
+    std::vector<std::vector<int64_t>> generated;
+    std::vector<bool> packedCompleted;
+    std::vector<float> packedConfidences;
+    std::vector<std::string> parts;
+    decode(packedIds, generated, packedCompleted, packedConfidences, [&](size_t i) {
+        const std::vector<size_t>& members = packed[i].members;
+        std::string translation = tokenizer.decode(generated[i]);
+        if (members.size() > 1 && !segmentPacker.unpack(translation, members.size(), parts)) return;
+        if (members.size() == 1) {
+            parts.assign(1, std::move(translation));
+        } else {
+            packingStats.packedSegments += members.size();
+        }
+
+        for (size_t j = 0; j < members.size(); ++j) {
+            // Members share the score of the sequence they were decoded in
+            translations[members[j]] = std::move(parts[j]);
+            completed[members[j]] = true;
+            confidences[members[j]] = packedConfidences[i];
+            if (onFinished) onFinished(members[j]);
+        }
+    });
+
+    std::vector<size_t> fallback;
+    for (const auto& sequence : packed) {
+        if (sequence.members.size() > 1 && !completed[sequence.members.front()]) {
+            fallback.insert(fallback.end(), sequence.members.begin(), sequence.members.end());
+        }
+    }
+
+    // Members of a packed segment whose split failed are translated like unpacked segments
+    if (!fallback.empty()) {
+        std::cout << "Packed translations lost their separators, translating " << fallback.size() << " segments alone." << "\n";
+        std::vector<std::vector<int64_t>> fallbackIds;
+        fallbackIds.reserve(fallback.size());
+        for (size_t index : fallback) {
+            fallbackIds.push_back(sourceIds[index]);
+        }
+        std::vector<bool> fallbackCompleted;
+        std::vector<float> fallbackConfidences;
+        decode(fallbackIds, generated, fallbackCompleted, fallbackConfidences, [&](size_t i) {
+            translations[fallback[i]] = tokenizer.decode(generated[i]);
+            completed[fallback[i]] = true;
+            confidences[fallback[i]] = fallbackConfidences[i];
+            if (onFinished) onFinished(fallback[i]);
+        });
+        packingStats.unpackedSegments += fallback.size();
+    }
+
+    std::cout << "Translated " << segments.size() << " segments as " << packed.size() << " sequences." << "\n";
+    addStats(packingStats);
+}
+
+std::vector<TranslationResult> OnnxTranslationEngine::translate(const std::vector<TranslationSegment>& segments) {
+    return translateStreaming(segments, nullptr);
+}
+
+std::vector<TranslationResult> OnnxTranslationEngine::translateStreaming(const std::vector<TranslationSegment>& segments, const ResultCallback& onResult) {
+    std::lock_guard<std::mutex> lock(runMutex);
+
+    std::vector<std::string> texts;
+    texts.reserve(segments.size());
+    for (const auto& segment : segments) {
+        texts.push_back(segment.text);
+    }
+    std::vector<std::vector<int64_t>> sourceIds = tokenizer.encodeBatch(texts);
+
+    std::cout << "Processing " << segments.size() << " segments." << "\n";
+
+    std::vector<std::string> translations(segments.size());
+    std::vector<bool> completed(segments.size(), false);
+    std::vector<float> confidences(segments.size(), 0.0f);
+    // Every segment is reported from the decode workers the moment its translation is final
+    auto finish = [&](size_t i) {
+        if (onResult) onResult({segments[i].chapterNum, segments[i].position, translations[i], confidences[i]});
+    };
+
+    EngineStats before = stats();
+    if (packing.enabled) {
+        translatePacked(segments, sourceIds, translations, completed, confidences, finish);
+    } else {
+        std::vector<std::vector<int64_t>> generated;
+        decode(sourceIds, generated, completed, confidences, [&](size_t i) {
+            translations[i] = tokenizer.decode(generated[i]);
+            finish(i);
+        });
+    }
+    EngineStats after = stats();
+
+    // Results keep the input order regardless of when each segment finished decoding
+    std::vector<TranslationResult> results;
+    results.reserve(segments.size());
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (!completed[i]) continue;
+        results.push_back({segments[i].chapterNum, segments[i].position, translations[i], confidences[i]});
+    }
+
+    std::cout << "Processed " << results.size() << " results." << "\n";
+
+    size_t generatedTokens = after.generatedTokens - before.generatedTokens;
+    double generateSeconds = after.generateSeconds - before.generateSeconds;
+    if (generateSeconds > 0.0) {
+        std::cout << "Generated " << generatedTokens << " tokens at " << generatedTokens / generateSeconds << " tokens/s." << "\n";
+    }
+    if (workers.size() > 1) {
+        for (size_t worker = 0; worker < workers.size(); ++worker) {
+            double busy = after.workerBusySeconds[worker] - (worker < before.workerBusySeconds.size() ? before.workerBusySeconds[worker] : 0.0);
+            double idle = after.workerIdleSeconds[worker] - (worker < before.workerIdleSeconds.size() ? before.workerIdleSeconds[worker] : 0.0);
+            std::cout << "Worker " << worker << " was busy for " << busy << "s and idle for " << idle << "s." << "\n";
+        }
+        std::cout << "Idle workers stole " << after.stolenBatches - before.stolenBatches << " batches." << "\n";
+    }
+    if (usePipeline && generateSeconds > 0.0) {
+        // Both stages as a share of the time every worker spent in generate
+        double stageSeconds = generateSeconds * workers.size();
+        std::cout << "The encoder stage was busy " << 100.0 * (after.encoderStageSeconds - before.encoderStageSeconds) / stageSeconds << "% of the time and blocked on a full queue for "
+                  << after.encoderBlockedSeconds - before.encoderBlockedSeconds << "s. The decoder stage was busy " << 100.0 * (after.decodeSeconds - before.decodeSeconds) / stageSeconds
+                  << "% of the time and waited " << after.decoderStarvedSeconds - before.decoderStarvedSeconds << "s for encoded batches." << "\n";
+    }
+    size_t degenerateSegments = after.degenerateSegments - before.degenerateSegments;
+    if (degenerateSegments > 0) {
+        std::cout << "Stopped " << degenerateSegments << " looping segments after " << after.degenerateTokens - before.degenerateTokens << " tokens, decoded " << after.redecodedSegments - before.redecodedSegments << " of them again with stricter settings." << "\n";
+    }
+    std::cout << "Tensor arenas grew " << after.arenaGrowths - before.arenaGrowths << " times and " << after.tensorValues - before.tensorValues << " tensor values were created over " << after.decodeSteps - before.decodeSteps << " decode steps." << "\n";
+    if (twoTier.enabled && params.numBeams > 1) {
+        std::cout << "Escalated " << after.escalatedSegments - before.escalatedSegments << " of " << segments.size() << " segments below confidence " << twoTier.confidenceThreshold << " from greedy to " << params.numBeams << " beams." << "\n";
+    }
+    if (useSpeculative) {
+        size_t drafted = after.draftedTokens - before.draftedTokens;
+        size_t accepted = after.acceptedTokens - before.acceptedTokens;
+        std::cout << "The main model accepted " << accepted << " of " << drafted << " draft tokens (" << (drafted ? 100.0 * accepted / drafted : 0.0) << "%)." << "\n";
+    }
+    return results;
+}
+
+std::string OnnxTranslationEngine::modelId() const {
+    return modelName + " (" + graphVariant + ")";
+}
+
+std::string OnnxTranslationEngine::decodingParams() const {
+    // Only the settings that change the output, batching, sessions and the speculative mode keep it.
+    // The keys of a json object are sorted, so equal settings always dump to the same string.
+    nlohmann::json decoding = {
+        {"max_new_tokens", params.maxNewTokens},
+        {"num_beams", params.numBeams},
+        {"no_repeat_ngram_size", params.noRepeatNgramSize},
+        {"repetition_penalty", params.repetitionPenalty},
+        {"early_stopping", params.earlyStopping},
+        {"renormalize_logits", params.renormalizeLogits},
+        {"length_budget", lengthBudget.enabled ? nlohmann::json{{"ratio", lengthBudget.ratio}, {"slack", lengthBudget.slack}} : nlohmann::json(false)},
+        {"degeneration", degeneration.enabled ? nlohmann::json{{"max_period", degeneration.maxPeriod}, {"min_repeats", degeneration.minRepeats}, {"window", degeneration.window}, {"min_distinct_ratio", degeneration.minDistinctRatio}, {"retry_repetition_penalty", degeneration.retryRepetitionPenalty}, {"retry_no_repeat_ngram_size", degeneration.retryNoRepeatNgramSize}} : nlohmann::json(false)},
+        {"shortlist", useShortlist ? nlohmann::json{{"max_candidates", shortlist.maxCandidates}} : nlohmann::json(false)},
+        {"packing", packing.enabled ? nlohmann::json{{"max_segment_tokens", packing.maxSegmentTokens}, {"max_packed_tokens", packing.maxPackedTokens}, {"max_segments", packing.maxSegments}, {"separator", packing.separator}} : nlohmann::json(false)},
+        {"two_tier", twoTier.enabled ? nlohmann::json{{"confidence_threshold", twoTier.confidenceThreshold}} : nlohmann::json(false)}
+    };
+    return decoding.dump();
+}
+
+EngineStats OnnxTranslationEngine::stats() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return engineStats;
+}
@@ -0,0 +1,370 @@
+#pragma once
+
+#include <onnxruntime_cxx_api.h>
+#include <nlohmann/json.hpp>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "TranslationEngine.h"
+#include "MarianTokenizer.h"
+#include "DecodeScheduler.h"
+#include "BeamSearch.h"
+#include "GraphCache.h"
+#include "CpuTopology.h"
+#include "LexicalShortlist.h"
+#include "DegenerationDetector.h"
+#include "SegmentPacker.h"
+#include "WorkStealingQueue.h"
+#include "TensorArena.h"
+#include "BoundedQueue.h"
+
+// Mirrors the "batching" object of translationConfig.json
+struct BatchingParams {
+    size_t batchSize = 16;
+    size_t maxBatchTokens = 2048;
+};
+
+// Mirrors the "quantization" object of translationConfig.json
+struct QuantizationParams {
+    std::string variant = "fp32";
+    float maxBleuDrop = 1.0f;
+};
+
+// Mirrors the "graph_cache" object of translationConfig.json
+struct GraphCacheParams {
+    bool enabled = true;
+    std::string directory = "ort-cache";
+};
+
+// Mirrors the "length_budget" object of translationConfig.json. A segment may generate
+// ratio * source tokens + slack tokens, fitLengthBudget.py fits both on the evaluation data.
+struct LengthBudgetParams {
+    bool enabled = true;
+    float ratio = 2.0f;
+    int slack = 16;
+};
+
+// Mirrors the "sessions" object of translationConfig.json, 0 derives the value from the physical cores
+struct SessionPoolParams {
+    size_t count = 0;
+    size_t threadsPerSession = 0;
+    bool pinThreads = true;
+};
+
+// Mirrors the "shortlist" object of translationConfig.json. Cohorts whose sources allow more than
+// maxCandidates targets project onto the whole vocabulary.
+struct ShortlistParams {
+    bool enabled = false;
+    size_t maxCandidates = 8192;
+};
+
+// Mirrors the "speculative" object of translationConfig.json. The draft model proposes draftTokens
+// tokens that the main model verifies in one pass, which keeps the output of greedy search. Once
+// a worker has drafted probeTokens tokens, it stops drafting if the main model accepted fewer than
+// minAcceptanceRate of them.
+struct SpeculativeParams {
+    bool enabled = false;
+    std::string draftModelDir = "draft-model-dir";
+    size_t draftTokens = 4;
+    float minAcceptanceRate = 0.3f;
+    size_t probeTokens = 64;
+};
+
+// Mirrors the "two_tier" object of translationConfig.json. Every segment is decoded greedily
+// first and only those whose average token log probability stays below confidenceThreshold
+// are decoded again with the configured num_beams.
+struct TwoTierParams {
+    bool enabled = false;
+    float confidenceThreshold = -0.5f;
+};
+
+// Encodes the next batches on a separate thread while the worker keeps decoding. queueDepth
+// encoded batches can wait for free slots, encoderThreads cores of every session are given to
+// its encoder (0 shares them with the decoder).
+struct PipelineParams {
+    bool enabled = false;
+    size_t queueDepth = 2;
+    size_t encoderThreads = 0;
+};
+
+// Counters since the engine was created
+struct EngineStats {
+    size_t decodeSteps = 0;
+    double decodeSeconds = 0.0;
+    // Logits computed outside the graph, only the shortlist mode does that
+    size_t projectedLogits = 0;
+
+    size_t generatedTokens = 0;
+    double generateSeconds = 0.0;
+
+    // Draft tokens proposed and accepted by the main model in the speculative mode
+    size_t draftedTokens = 0;
+    size_t acceptedTokens = 0;
+
+    // Segments the degeneration detector stopped, the tokens they had generated by then and
+    // how many of them were decoded again with the retry settings
+    size_t degenerateSegments = 0;
+    size_t degenerateTokens = 0;
+    size_t redecodedSegments = 0;
+
+    // Segments translated inside a packed sequence and those translated alone again because
+    // the separators of their packed translation didn't match
+    size_t packedSegments = 0;
+    size_t unpackedSegments = 0;
+
+    // Encoder batches a worker took from another worker's queue, and the time each worker spent
+    // decoding or waiting for the others to finish their share
+    size_t stolenBatches = 0;
+    std::vector<double> workerBusySeconds;
+    std::vector<double> workerIdleSeconds;
+
+    // Segments the greedy pass of the two tier mode handed to beam search
+    size_t escalatedSegments = 0;
+
+    // Times a session's TensorArena had to grow, it stays flat once the loop has seen its largest shapes
+    size_t arenaGrowths = 0;
+
+    // Ort::Values created to bind or pass tensors, the growing decoder cache needs new ones every step
+    size_t tensorValues = 0;
+
+    // Stage utilization of the pipelined workers: time spent encoding, encoder time lost to a
+    // full queue, and decoder time spent waiting on an empty one
+    double encoderStageSeconds = 0.0;
+    double encoderBlockedSeconds = 0.0;
+    double decoderStarvedSeconds = 0.0;
+};
+
+// An output of the bound decoder, it lives in the session's arena until the next step
+struct BoundOutput {
+    float* data = nullptr;
+    std::array<int64_t, 4> shape = {};
+    size_t rank = 0;
+    size_t count = 0;
+};
+
+// The graphs exported by optimum-cli with --task text2text-generation-with-past. The plain decoder
+// runs the first step and returns the encoder key/values, every later step reuses the cache.
+struct ModelSessions {
+    std::unique_ptr<Ort::Session> encoder;
+    std::unique_ptr<Ort::Session> decoder;
+    std::unique_ptr<Ort::Session> decoderWithPast;
+    std::vector<std::string> encoderInputNames;
+    std::vector<std::string> decoderInputNames;
+    std::vector<std::string> decoderOutputNames;
+    std::vector<std::string> decoderWithPastInputNames;
+    std::vector<std::string> decoderWithPastOutputNames;
+
+    // The past_key_values input each output feeds on the next step, empty for the logits
+    std::vector<std::string> decoderPastNames;
+    std::vector<std::string> decoderWithPastPastNames;
+    int64_t encoderHiddenSize = 0;
+
+    // The decode loop binds its inputs and outputs to arena memory, so steps reuse the same buffers
+    std::unique_ptr<Ort::IoBinding> encoderBinding;
+    std::unique_ptr<Ort::IoBinding> decoderBinding;
+    std::unique_ptr<Ort::IoBinding> decoderWithPastBinding;
+    TensorArena arena;
+    size_t tensorValues = 0;
+
+    // Filled by every decode step of the worker, they keep their capacity from step to step
+    std::vector<BoundOutput> boundOutputs;
+    std::vector<size_t> keptSlots;
+    std::vector<size_t> decoderRows;
+    std::vector<size_t> encoderRows;
+};
+
+// A key/value cache tensor laid out as [rows, heads, length, headSize]
+struct CacheTensor {
+    std::vector<float> data;
+    std::vector<int64_t> shape;
+
+    // Set when the last decode step returned it, the encoder cache is only returned by the first
+    bool refreshed = false;
+};
+
+// Encoder output of one segment, trimmed to its own source length
+struct EncodedSource {
+    std::vector<float> hiddenStates;
+    int64_t length = 0;
+
+    // Set for the second decode of a segment that degenerated
+    bool retry = false;
+};
+
+// What the encoder stage of a pipelined worker hands to its decoder
+struct EncodedBatch {
+    size_t batchIndex = 0;
+    std::unordered_map<size_t, EncodedSource> sources;
+};
+
+// Segments that started decoding at the same step. decoder_with_past has no self attention mask,
+// so every row of a Run must share the same past length and later segments form a new cohort.
+struct DecodeCohort {
+    // Each slot owns numBeams consecutive rows
+    std::vector<size_t> slots;
+    int64_t sourceLength = 0;
+    std::vector<int64_t> attentionMask;
+    std::vector<float> encoderHiddenStates;
+
+    // Keyed by the past_key_values input name of decoder_with_past
+    std::map<std::string, CacheTensor> pastKeyValues;
+    bool started = false;
+
+    // Longest self attention cache any of its segments can reach, the cache is reserved for it
+    int64_t maxLength = 0;
+
+    // Shortlist of the cohort's sources, empty when it projects onto the whole vocabulary
+    std::vector<int64_t> candidates;
+
+    // Slots the degeneration detector stopped in the last step, they are also reported as finished
+    std::vector<size_t> degenerate;
+
+    // Rows per slot, the two tier mode decodes its greedy pass with 1
+    size_t numBeams = 1;
+
+    // The cohort's own binding of decoder_with_past and the memory bound to each of its inputs and
+    // outputs, values whose shape only changes with the rows stay bound while the cohort keeps them
+    std::unique_ptr<Ort::IoBinding> binding;
+    std::vector<const void*> boundData;
+    int64_t boundRows = 0;
+};
+
+class OnnxTranslationEngine : public TranslationEngine {
+public:
+    OnnxTranslationEngine(const std::filesystem::path& modelDir = "onnx-model-dir", const std::filesystem::path& configPath = "translationConfig.json");
+
+    std::vector<TranslationResult> translate(const std::vector<TranslationSegment>& segments) override;
+    std::vector<TranslationResult> translateStreaming(const std::vector<TranslationSegment>& segments, const ResultCallback& onResult) override;
+
+    std::string modelId() const override;
+    std::string decodingParams() const override;
+
+    EngineStats stats() const;
+
+protected:
+    // Called with the index of every segment whose tokens are final, under the workers' result mutex
+    using SegmentCallback = std::function<void(size_t)>;
+
+    void loadTranslationConfig(const std::filesystem::path& configPath);
+    void loadModelConfig(const std::filesystem::path& modelDir);
+    void loadSessions(const std::filesystem::path& modelDir);
+    std::filesystem::path loadShortlist(const std::filesystem::path& modelDir, const std::filesystem::path& graphDir);
+    void loadDraftModel();
+    ModelSessions createModelSessions(const std::filesystem::path& encoderPath, const std::filesystem::path& decoderPath, const std::filesystem::path& decoderWithPastPath, const Ort::SessionOptions& options);
+    ModelSessions createEncoderSessions(const std::filesystem::path& encoderPath, const Ort::SessionOptions& options);
+    static std::vector<int> splitEncoderCores(std::vector<int>& cores, size_t encoderThreads);
+    std::unique_ptr<Ort::Session> createSession(const std::filesystem::path& modelPath, const Ort::SessionOptions& sessionOptions);
+    static std::filesystem::path resolveGraphDir(const std::filesystem::path& modelDir, const QuantizationParams& quantization);
+    static std::vector<std::vector<size_t>> createBatches(const std::vector<std::vector<int64_t>>& sourceIds, const BatchingParams& batching);
+    size_t decodeSlotCount(const GenerationParams& generation) const;
+    static double batchCost(const std::vector<size_t>& batch, const std::vector<std::vector<int64_t>>& sourceIds, const LengthBudgetParams& lengthBudget, int maxNewTokens);
+    static int outputBudget(size_t sourceTokens, const LengthBudgetParams& lengthBudget, int maxNewTokens);
+    GenerationParams segmentParams(const GenerationParams& generation, size_t sourceTokens, bool retry = false) const;
+    static std::vector<std::vector<int>> sessionCores(const std::vector<int>& cores, SessionPoolParams& sessionPool);
+    Ort::SessionOptions sessionOptions(const std::vector<int>& cores) const;
+    void decode(const std::vector<std::vector<int64_t>>& sourceIds, std::vector<std::vector<int64_t>>& generated, std::vector<bool>& completed, std::vector<float>& confidences, const SegmentCallback& onFinished = nullptr);
+    void generate(const GenerationParams& generation, const std::vector<std::vector<int64_t>>& sourceIds, std::vector<std::vector<int64_t>>& generated, std::vector<bool>& completed, std::vector<float>& confidences, const SegmentCallback& onFinished = nullptr);
+    void translatePacked(const std::vector<TranslationSegment>& segments, const std::vector<std::vector<int64_t>>& sourceIds, std::vector<std::string>& translations, std::vector<bool>& completed, std::vector<float>& confidences, const SegmentCallback& onFinished);
+    void decodeWorker(ModelSessions& sessions, const GenerationParams& generation, size_t slotCount, const std::vector<std::vector<int64_t>>& sourceIds, const std::vector<std::vector<size_t>>& encoderBatches, WorkStealingQueue& queue, size_t worker, std::vector<std::vector<int64_t>>& generated, std::vector<bool>& completed, std::vector<float>& confidences, std::mutex& resultMutex, const SegmentCallback& onFinished, BoundedQueue<EncodedBatch>* encodedBatches = nullptr);
+    void encoderStage(ModelSessions& encoderSessions, TensorArena& sourceArena, const std::vector<std::vector<int64_t>>& sourceIds, const std::vector<std::vector<size_t>>& encoderBatches, WorkStealingQueue& queue, size_t worker, BoundedQueue<EncodedBatch>& encodedBatches);
+    void speculativeWorker(ModelSessions& sessions, ModelSessions& draft, const GenerationParams& generation, const std::vector<std::vector<int64_t>>& sourceIds, const std::vector<std::vector<size_t>>& encoderBatches, WorkStealingQueue& queue, size_t worker, std::vector<std::vector<int64_t>>& generated, std::vector<bool>& completed, std::vector<float>& confidences, std::mutex& resultMutex, const SegmentCallback& onFinished);
+    std::vector<int64_t> decodeSpeculative(ModelSessions& sessions, ModelSessions& draft, const GenerationParams& generation, const std::vector<int64_t>& sourceIds, const EncodedSource& source, EngineStats& stepStats, bool& degenerate, float& confidence);
+    std::vector<int64_t> proposeDraft(ModelSessions& draft, DecodeCohort& drafter, const std::vector<int64_t>& sequence, size_t& draftCached, size_t count);
+    static void storePresent(DecodeCohort& cohort, std::vector<Ort::Value>& outputs, const std::vector<std::string>& outputNames);
+    static void truncateDecoderCache(DecodeCohort& cohort, int64_t length);
+    void addStats(const EngineStats& workerStats);
+    void encodeSources(ModelSessions& sessions, TensorArena& sourceArena, const std::vector<size_t>& batch, const std::vector<std::vector<int64_t>>& sourceIds, std::unordered_map<size_t, EncodedSource>& encoded);
+    DecodeCohort startCohort(ModelSessions& sessions, const GenerationParams& generation, const std::vector<std::pair<size_t, size_t>>& assigned, const std::vector<std::vector<int64_t>>& sourceIds, std::unordered_map<size_t, EncodedSource>& encoded, std::vector<BeamSearch>& searches);
+    void decodeCohortStep(ModelSessions& sessions, DecodeCohort& cohort, std::vector<BeamSearch>& searches, std::vector<size_t>& finished, EngineStats& stepStats);
+    void releaseCohort(TensorArena& arena, DecodeCohort& cohort);
+    const float* runEncoder(ModelSessions& sessions, const int64_t* inputIds, const int64_t* attentionMask, int64_t rows, int64_t sourceLength);
+    std::vector<Ort::Value> runDecoder(ModelSessions& sessions, DecodeCohort& cohort, std::vector<int64_t>& decoderIds, int64_t length = 1);
+    void runBoundDecoder(ModelSessions& sessions, DecodeCohort& cohort, int64_t* decoderIds, int64_t rows);
+    static int64_t pastLength(const DecodeCohort& cohort);
+
+    // Copies the listed rows of a [rows, ...] tensor into gathered, used to reorder the cache
+    template <typename T>
+    static void gatherRows(const T* data, size_t rowSize, const std::vector<size_t>& rows, std::vector<T>& gathered);
+
+    // Keeps the listed rows of a [rows, ...] buffer in place, the rows have to be ascending
+    template <typename T>
+    static void compactRows(std::vector<T>& data, size_t rowSize, const std::vector<size_t>& rows);
+
+    Ort::Env env;
+    Ort::MemoryInfo memoryInfo;
+    // One set of sessions per worker, each worker owns workerCores[i] so the intra-op pools
+    // of different sessions never compete for a core
+    std::vector<ModelSessions> workers;
+    std::vector<std::vector<int>> workerCores;
+
+    // The encoder sessions of the pipelined workers, on encoderCores[i] or shared with workerCores[i]
+    bool usePipeline = false;
+    std::vector<ModelSessions> encoderWorkers;
+    std::vector<std::vector<int>> encoderCores;
+    // Fixed once the model is loaded, a decode pass that needs other settings gets its own copy
+    GenerationParams params;
+    BatchingParams batching;
+    QuantizationParams quantization;
+    GraphCacheParams graphCache;
+    LengthBudgetParams lengthBudget;
+    DegenerationParams degeneration;
+    SessionPoolParams sessionPool;
+    ShortlistParams shortlist;
+    SpeculativeParams speculative;
+    PackingParams packing;
+    TwoTierParams twoTier;
+    PipelineParams pipeline;
+    std::string modelName;
+    // The quantization variant the graphs were loaded from, fp32 when the configured one failed its gate
+    std::string graphVariant = "fp32";
+    int64_t hiddenSize = 512;
+    int64_t vocabSize = 64172;
+    int64_t decoderLayers = 6;
+    int64_t decoderHeads = 8;
+
+    MarianTokenizer tokenizer;
+    DegenerationDetector degenerationDetector;
+    SegmentPacker segmentPacker;
+
+    // Loaded when the shortlist is enabled and buildShortlist.py produced its files
+    bool useShortlist = false;
+    LexicalShortlist lexicalShortlist;
+    OutputProjection outputProjection;
+
+    // One draft model per worker, loaded when the speculative mode can keep the greedy output
+    bool useSpeculative = false;
+    std::vector<ModelSessions> draftWorkers;
+
+    EngineStats engineStats;
+    mutable std::mutex statsMutex;
+
+    // The workers split a single translate call, concurrent calls are queued
+    std::mutex runMutex;
+};
+
+template <typename T>
+void OnnxTranslationEngine::gatherRows(const T* data, size_t rowSize, const std::vector<size_t>& rows, std::vector<T>& gathered) {
+    gathered.resize(rows.size() * rowSize);
+    for (size_t row = 0; row < rows.size(); ++row) {
+        std::copy(data + rows[row] * rowSize, data + (rows[row] + 1) * rowSize, gathered.begin() + row * rowSize);
+    }
+}
+
+template <typename T>
+void OnnxTranslationEngine::compactRows(std::vector<T>& data, size_t rowSize, const std::vector<size_t>& rows) {
+    // Every kept row moves towards the front, so no row is overwritten before it is copied
+    for (size_t row = 0; row < rows.size(); ++row) {
+        if (rows[row] != row) {
+            std::copy(data.begin() + rows[row] * rowSize, data.begin() + (rows[row] + 1) * rowSize, data.begin() + row * rowSize);
+        }
+    }
+    data.resize(rows.size() * rowSize);
+}
@@ -10,12 +10,10 @@ int PDFTranslator::run(const std::string& inputPath, const std::string& outputPa
     const std::string extractedTextPath = "extractedPDFtext.txt";
     const std::string imagesDir = "FilteredImages";
     std::string outputPdfPath = outputPath + "/output.pdf";
-    std::string translatedTagsPath = "translatedTags.txt";
 
     std::filesystem::path rawTextFilePathPath = std::filesystem::u8path(rawTextFilePath);
     std::filesystem::path extractedTextPathPath = std::filesystem::u8path(extractedTextPath);
     std::filesystem::path imagesDirPath = std::filesystem::u8path(imagesDir);
-    std::filesystem::path translatedTagsPathPath = std::filesystem::u8path(translatedTagsPath);
 
 
     // Check if the temp files exist and delete them
@@ -28,9 +26,6 @@ int PDFTranslator::run(const std::string& inputPath, const std::string& outputPa
     if (std::filesystem::exists(imagesDirPath)) {
         std::filesystem::remove_all(imagesDirPath);
     }
-    if (std::filesystem::exists(translatedTagsPathPath)) {
-        std::filesystem::remove(translatedTagsPathPath);
-    }
 
 
     // Ensure the images directory exists
@@ -45,7 +40,6 @@ int PDFTranslator::run(const std::string& inputPath, const std::string& outputPa
         }
     }
 
-    std::filesystem::path currentDirPath = std::filesystem::current_path();
     std::cout << "Hello from PDFTranslator!\n";
 
 
@@ -57,20 +51,14 @@ int PDFTranslator::run(const std::string& inputPath, const std::string& outputPa
     // Extracts text from the PDF and writes it to extractedPDFtext.txt
     extractTextFromPDF(inputPath, extractedTextPath);
 
-    
-
-
+    // Finished segments are journaled, a run that was interrupted continues where it stopped
+    TranslationJob job(std::filesystem::u8path(inputPath), "journals", TranslationMemory::shared());
+    std::vector<TranslationResult> results;
 
     try {
-        // Splits the merged japanese into sentence and writes it to pdftext.txt
+        // Splits the merged japanese into sentences
         std::vector<std::string> sentences = processAndSplitText(extractedTextPath, 300);
 
-        // Open the output file
-        std::ofstream outputFile(rawTextFilePath);
-        if (!outputFile.is_open()) {
-            throw std::runtime_error("Failed to open output file: " + rawTextFilePath);
-        }
-
         // Handle DeepL request
         if (localModel == 1) {
             if (deepLKey.empty()) {
@@ -78,17 +66,14 @@ int PDFTranslator::run(const std::string& inputPath, const std::string& outputPa
                 return 1;
             }
 
-            // Write each sentence to the file with a corresponding number
-            // for (size_t i = 0; i < sentences.size(); ++i) {
-            //     outputFile << sentences[i] << "\n";
-            // }
-
-            // Test writing to the file limit the number of sentences
-            for (size_t i = 0; i < 5; ++i) {
-                outputFile << sentences[i] << "\n";
+            // DeepL gets the sentences as a text file, one per line
+            std::ofstream outputFile(rawTextFilePath);
+            if (!outputFile.is_open()) {
+                throw std::runtime_error("Failed to open output file: " + rawTextFilePath);
+            }
+            for (const auto& sentence : sentences) {
+                outputFile << sentence << "\n";
             }
-            
-
             outputFile.close();
 
             const std::string translatedTextPath = "translatedDeepL.txt";
@@ -115,33 +100,18 @@ int PDFTranslator::run(const std::string& inputPath, const std::string& outputPa
                 return 1;
             }
 
-            std::vector<std::string> translatedSentences;
+            std::vector<TranslationResult> translatedSentences;
             std::string line;
 
             while (std::getline(translatedFile, line)) {
                 if (!line.empty() && line.find_first_not_of(" \t\r\n") != std::string::npos) {
-                    translatedSentences.push_back(line);
+                    translatedSentences.push_back({0, static_cast<int>(translatedSentences.size() + 1), line});
                 }
             }
 
             translatedFile.close();
 
-            // Write the translated sentence back to translatedTextPath
-            std::ofstream translatedOutputFile(translatedTextPath);
-
-            if (!translatedOutputFile.is_open()) {
-                std::cerr << "Failed to open translated text file for writing: " << translatedTextPath << std::endl;
-                return 1;
-            }
-
-            for (const auto& sentence : translatedSentences) {
-                translatedOutputFile << sentence << "\n";
-            }
-
-            translatedOutputFile.close();
-
-            
-            createPDF(outputPdfPath, translatedTextPath, imagesDir);
+            createPDF(outputPdfPath, translatedSentences, imagesDir);
             
             if (std::filesystem::exists(rawTextFilePathPath)) {
                 std::filesystem::remove(rawTextFilePathPath);
@@ -152,110 +122,33 @@ int PDFTranslator::run(const std::string& inputPath, const std::string& outputPa
             if (std::filesystem::exists(imagesDirPath)) {
                 std::filesystem::remove_all(imagesDirPath);
             }
-            if (std::filesystem::exists(translatedTagsPathPath)) {
-                std::filesystem::remove(translatedTagsPathPath);
-            }
 
             return 0;
 
         }
 
+        std::cout << "Finished splitting text" << '\n';
 
-        // Write each sentence to the file with a corresponding number
+        // PDF does not have chapters, so every sentence goes in chapter 0 numbered from 1
+        std::vector<TranslationSegment> segments;
         for (size_t i = 0; i < sentences.size(); ++i) {
-            outputFile << (i + 1) << ",>>" << langcode << "<< " << sentences[i] << "\n";
+            segments.push_back({0, static_cast<int>(i + 1), ">>" + langcode + "<< " + sentences[i]});
         }
 
-        outputFile.close();
+        std::shared_ptr<TranslationEngine> engine = TranslationEngineFactory::getEngine();
+        results = job.translate(*engine, segments, TranslationEngine::progressReporter(segments.size()));
 
     } catch (const std::exception& ex) {
         std::cerr << "Exception: " << ex.what() << std::endl;
         return 1;
     }
 
-    std::cout << "Finished splitting text" << '\n';
-    std::string chapterNumberMode = "1";    // PDF does not have chapters, so use mode 1
-    
-    //Start the multiprocessing translaton
-    std::filesystem::path translationExe;
-
-    #if defined(__APPLE__)
-        translationExe = currentDirPath / "translation";
 
-    #elif defined(_WIN32)
-        translationExe = currentDirPath / "translation.exe";
-    #else
-        std::cerr << "Unsupported platform!" << std::endl;
-        return 1; // Or some other error handling
-    #endif
-
-    if (!std::filesystem::exists(translationExe)) {
-        std::cerr << "Executable not found: " << translationExe << std::endl;
-        return 1;
-    }
-
-    std::string translationExePath = translationExe.string();
     
 
-    std::cout << "Before call to translation.exe" << '\n';
-
-    boost::process::ipstream pipe_stdout, pipe_stderr;
-
     try {
-        #if defined(_WIN32)
-            boost::process::child c(
-                translationExePath,
-                rawTextFilePath,
-                chapterNumberMode,
-                boost::process::std_out > pipe_stdout, 
-                boost::process::std_err > pipe_stderr,
-                boost::process::windows::hide
-            );
-        #else
-            boost::process::child c(
-                translationExePath,
-                rawTextFilePath,
-                chapterNumberMode,
-                boost::process::std_out > pipe_stdout, 
-                boost::process::std_err > pipe_stderr
-            );
-        #endif
-        
-        // Threads to handle asynchronous reading
-        std::thread stdout_thread([&pipe_stdout]() {
-            std::string line;
-            while (std::getline(pipe_stdout, line)) {
-                std::cout << line << "\n";
-            }
-        });
-
-        std::thread stderr_thread([&pipe_stderr]() {
-            std::string line;
-            while (std::getline(pipe_stderr, line)) {
-                std::cerr << "Python stderr: " << line << "\n";
-            }
-        });
-
-        c.wait(); // Wait for process completion
-
-        stdout_thread.join();
-        stderr_thread.join();
-
-        if (c.exit_code() == 0) {
-            std::cout << "Translation Python script executed successfully." << "\n";
-        } else {
-            std::cerr << "Translation Python script exited with code: " << c.exit_code() << "\n";
-        }
-    } catch (const std::exception& ex) {
-        std::cerr << "Exception: " << ex.what() << "\n";
-    }
-
-    std::cout << "After call to translation.exe" << '\n';
-
-    
-
-    try {
-        createPDF(outputPdfPath, "translatedTags.txt", imagesDir);
+        createPDF(outputPdfPath, results, imagesDir);
+        job.finish();
     }
     catch (const std::exception& ex) {
         std::cerr << "Exception: " << ex.what() << std::endl;
@@ -271,9 +164,6 @@ int PDFTranslator::run(const std::string& inputPath, const std::string& outputPa
     if (std::filesystem::exists(imagesDirPath)) {
         std::filesystem::remove_all(imagesDirPath);
     }
-    if (std::filesystem::exists(translatedTagsPathPath)) {
-        std::filesystem::remove(translatedTagsPathPath);
-    }
 
     std::cout << "Finished" << std::endl;
 
@@ -781,28 +671,13 @@ void PDFTranslator::configureTextRendering(cairo_t *cr, const std::string &font_
     cairo_set_font_size(cr, font_size);
 }
 
-void PDFTranslator::addTextToPdf(cairo_t* cr, cairo_surface_t* surface, const std::string &input_file, double page_width, double page_height, double margin, double line_spacing, double font_size) {
-    std::ifstream infile(input_file);
-    if (!infile.is_open()) {
-        std::cerr << "Error: Could not open file " << input_file << std::endl;
-        return;
-    }
-
+void PDFTranslator::addTextToPdf(cairo_t* cr, cairo_surface_t* surface, const std::vector<TranslationResult>& translations, double page_width, double page_height, double margin, double line_spacing, double font_size) {
     double x = margin;
     double y = margin;
     double usable_width = page_width - 2 * margin;
 
-    std::string line;
-    while (std::getline(infile, line)) {
-        // Assuming format: number,text
-        size_t comma_pos = line.find(',');
-        if (comma_pos == std::string::npos) {
-            // If no comma found, skip or handle differently
-            continue;
-        }
-
-        // Extract text after the comma
-        std::string text = line.substr(comma_pos + 1);
+    for (const auto& translation : translations) {
+        const std::string& text = translation.text;
 
         // Word wrapping
         std::istringstream text_stream(text);
@@ -850,16 +725,7 @@ void PDFTranslator::addTextToPdf(cairo_t* cr, cairo_surface_t* surface, const st
     }
 }
 
-void PDFTranslator::createPDF(const std::string &output_file, const std::string &input_file, const std::string &images_dir) {
-    // Check if the input file exists
-    std::filesystem::path inputPath = std::filesystem::u8path(input_file);
-
-    if (!std::filesystem::exists(inputPath)) {
-        std::cerr << "Input file does not exist: " << inputPath.string() << std::endl;
-        return;
-    }
-    
-    
+void PDFTranslator::createPDF(const std::string &output_file, const std::vector<TranslationResult>& translations, const std::string &images_dir) {
     // Page dimensions in points (A4: 612x792 points)
     const double page_width = 612.0;
     const double page_height = 792.0;
@@ -882,7 +748,7 @@ void PDFTranslator::createPDF(const std::string &output_file, const std::string
 
     // 3. Configure text rendering and add text
     configureTextRendering(cr, font_family, font_size);
-    addTextToPdf(cr, surface, input_file, page_width, page_height, margin, line_spacing, font_size);
+    addTextToPdf(cr, surface, translations, page_width, page_height, margin, line_spacing, font_size);
 
     // 4. Cleanup
     cleanupCairo(cr, surface);
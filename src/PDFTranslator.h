@@ -8,7 +8,6 @@
 #include <iostream>
 #include <string>
 #include <memory>
-#include <boost/process.hpp>
 #include <boost/filesystem.hpp>
 #include <sstream>
 #include <iostream>
@@ -20,13 +19,11 @@
 #include <cairo.h>
 #include <cairo-pdf.h>
 #include "Translator.h"
+#include "TranslationEngineFactory.h"
+#include "TranslationJob.h"
 #include <nlohmann/json.hpp>
 #include <curl/curl.h>
 
-#ifdef _WIN32
-#include <boost/process/windows.hpp>
-#endif
-
 
 class PDFTranslator : public Translator {
 public:
@@ -45,7 +42,8 @@ protected:
     size_t getUtf8CharLength(unsigned char firstByte);
     void convertPdfToImages(const std::string& pdfPath, const std::string& outputFolder, float stdDevThreshold);
     bool isImageAboveThreshold(const std::string& imagePath, float threshold);
-    void createPDF(const std::string& output_file, const std::string& text, const std::string& images_dir);
+    // The images of images_dir come first, then the translated text
+    void createPDF(const std::string& output_file, const std::vector<TranslationResult>& translations, const std::string& images_dir);
     std::string uploadDocumentToDeepL(const std::string& filePath, const std::string& deepLKey);
     std::string checkDocumentStatus(const std::string& document_id, const std::string& document_key, const std::string& deepLKey);
     std::string downloadTranslatedDocument(const std::string& document_id, const std::string& document_key, const std::string& deepLKey);
@@ -62,6 +60,6 @@ protected:
     std::vector<std::string> collectImageFiles(const std::string &images_dir);
     bool addImagesToPdf(cairo_t *cr, cairo_surface_t *surface, const std::vector<std::string> &image_files);
     void configureTextRendering(cairo_t *cr, const std::string &font_family, double font_size);
-    void addTextToPdf(cairo_t* cr, cairo_surface_t* surface, const std::string &input_file, double page_width, double page_height, double margin, double line_spacing, double font_size);
+    void addTextToPdf(cairo_t* cr, cairo_surface_t* surface, const std::vector<TranslationResult>& translations, double page_width, double page_height, double margin, double line_spacing, double font_size);
     bool isImageFile(const std::string &extension);
 };
\ No newline at end of file
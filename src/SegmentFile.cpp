@@ -0,0 +1,122 @@
+#include "SegmentFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+// Values are stored in the host order like the other binary files, every supported target is little endian
+template <typename T>
+static void putValue(std::vector<unsigned char>& buffer, size_t offset, T value) {
+    std::memcpy(buffer.data() + offset, &value, sizeof(T));
+}
+
+template <typename T>
+static T getValue(const unsigned char* bytes) {
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+void SegmentFile::write(const std::filesystem::path& path, const std::vector<SegmentRecord>& records) {
+    size_t total = headerSize + records.size() * recordSize;
+    for (const auto& record : records) {
+        if (record.text.size() > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("Segment " + std::to_string(record.id) + " is too large for a segment file");
+        }
+        total += sizeof(uint32_t) + record.text.size();
+    }
+
+    // The whole file is laid out in memory and written with a single call
+    std::vector<unsigned char> buffer(total, 0);
+    std::memcpy(buffer.data(), "SEGS", 4);
+    putValue<uint32_t>(buffer, 4, 1);
+    putValue<uint32_t>(buffer, 8, static_cast<uint32_t>(records.size()));
+    putValue<uint32_t>(buffer, 12, static_cast<uint32_t>(recordSize));
+
+    uint64_t payload = headerSize + records.size() * recordSize;
+    for (size_t i = 0; i < records.size(); ++i) {
+        const SegmentRecord& record = records[i];
+        size_t offset = headerSize + i * recordSize;
+        putValue<uint32_t>(buffer, offset, record.id);
+        putValue<int32_t>(buffer, offset + 4, record.chapterNum);
+        putValue<int32_t>(buffer, offset + 8, record.position);
+        std::memcpy(buffer.data() + offset + 12, record.language.data(), std::min(record.language.size(), languageSize));
+        putValue<uint64_t>(buffer, offset + 24, payload);
+
+        putValue<uint32_t>(buffer, payload, static_cast<uint32_t>(record.text.size()));
+        std::memcpy(buffer.data() + payload + sizeof(uint32_t), record.text.data(), record.text.size());
+        payload += sizeof(uint32_t) + record.text.size();
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open segment file for writing: " + path.string());
+    }
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    if (!file) {
+        throw std::runtime_error("Failed to write segment file: " + path.string());
+    }
+}
+
+SegmentFile::SegmentFile(const std::filesystem::path& path) : file(path) {
+    const unsigned char* bytes = file.data();
+    if (file.size() < headerSize || std::memcmp(bytes, "SEGS", 4) != 0 || getValue<uint32_t>(bytes + 4) != 1 || getValue<uint32_t>(bytes + 12) != recordSize) {
+        throw std::runtime_error("Unsupported segment file: " + path.string());
+    }
+
+    count = getValue<uint32_t>(bytes + 8);
+    if ((file.size() - headerSize) / recordSize < count) {
+        count = 0;
+        throw std::runtime_error("Truncated segment file: " + path.string());
+    }
+
+    // Checked once here so the accessors can read without bounds checks
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t payload = getValue<uint64_t>(recordAt(i) + 24);
+        if (payload > file.size() || file.size() - payload < sizeof(uint32_t) || file.size() - payload - sizeof(uint32_t) < getValue<uint32_t>(bytes + payload)) {
+            count = 0;
+            throw std::runtime_error("Truncated segment file: " + path.string());
+        }
+    }
+}
+
+uint32_t SegmentFile::id(size_t index) const {
+    return getValue<uint32_t>(recordAt(index));
+}
+
+int32_t SegmentFile::chapterNum(size_t index) const {
+    return getValue<int32_t>(recordAt(index) + 4);
+}
+
+int32_t SegmentFile::position(size_t index) const {
+    return getValue<int32_t>(recordAt(index) + 8);
+}
+
+std::string_view SegmentFile::language(size_t index) const {
+    const char* language = reinterpret_cast<const char*>(recordAt(index) + 12);
+    size_t length = 0;
+    while (length < languageSize && language[length] != '\0') {
+        ++length;
+    }
+    return std::string_view(language, length);
+}
+
+std::string_view SegmentFile::text(size_t index) const {
+    const unsigned char* payload = file.data() + getValue<uint64_t>(recordAt(index) + 24);
+    return std::string_view(reinterpret_cast<const char*>(payload + sizeof(uint32_t)), getValue<uint32_t>(payload));
+}
+
+SegmentRecord SegmentFile::record(size_t index) const {
+    return {id(index), chapterNum(index), position(index), std::string(language(index)), std::string(text(index))};
+}
+
+std::vector<SegmentRecord> SegmentFile::records() const {
+    std::vector<SegmentRecord> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        result.push_back(record(i));
+    }
+    return result;
+}
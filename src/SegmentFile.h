@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MappedFile.h"
+
+// One segment of a book as it is handed between the translators and translation.py
+struct SegmentRecord {
+    uint32_t id = 0;
+    int32_t chapterNum = 0;
+    int32_t position = 0;
+    // Model language code such as "jpn", at most 8 bytes are kept
+    std::string language;
+    std::string text;
+};
+
+// Binary segment file, all values little endian:
+//   header   "SEGS", uint32 version 1, uint32 record count, uint32 record size (32)
+//   records  uint32 id, int32 chapter, int32 position, char language[8] (zero padded),
+//            uint32 reserved, uint64 offset of the payload from the start of the file
+//   payloads uint32 byte length followed by the UTF-8 text, in record order
+// Text may hold commas and newlines. The reader maps the file and returns views into it, so
+// opening a book's segments costs one pass over the records to check their bounds.
+class SegmentFile {
+public:
+    static constexpr size_t headerSize = 16;
+    static constexpr size_t recordSize = 32;
+    static constexpr size_t languageSize = 8;
+
+    static void write(const std::filesystem::path& path, const std::vector<SegmentRecord>& records);
+
+    SegmentFile() = default;
+    explicit SegmentFile(const std::filesystem::path& path);
+
+    size_t size() const { return count; }
+
+    uint32_t id(size_t index) const;
+    int32_t chapterNum(size_t index) const;
+    int32_t position(size_t index) const;
+    std::string_view language(size_t index) const;
+    // Points into the mapping, valid as long as this SegmentFile
+    std::string_view text(size_t index) const;
+
+    SegmentRecord record(size_t index) const;
+    std::vector<SegmentRecord> records() const;
+
+protected:
+    const unsigned char* recordAt(size_t index) const { return file.data() + headerSize + index * recordSize; }
+
+    MappedFile file;
+    size_t count = 0;
+};
@@ -0,0 +1,105 @@
+#include "SegmentPacker.h"
+
+SegmentPacker::SegmentPacker(const PackingParams& params) : params(params) {}
+
+std::string SegmentPacker::languagePrefix(const std::string& text) {
+    if (text.compare(0, 2, ">>") != 0) {
+        return "";
+    }
+    size_t end = text.find("<<", 2);
+    if (end == std::string::npos) {
+        return "";
+    }
+    end += 2;
+    while (end < text.size() && text[end] == ' ') {
+        ++end;
+    }
+    return text.substr(0, end);
+}
+
+static std::string trim(const std::string& text) {
+    const char* whitespace = " \t\r\n";
+    size_t start = text.find_first_not_of(whitespace);
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(whitespace);
+    return text.substr(start, end - start + 1);
+}
+
+std::vector<PackedSegment> SegmentPacker::pack(const std::vector<TranslationSegment>& segments, const std::vector<size_t>& sourceTokens) const {
+    std::vector<PackedSegment> packed;
+    packed.reserve(segments.size());
+
+    // The group being filled, it only takes segments that directly follow its last member
+    PackedSegment group;
+    std::string groupPrefix;
+    size_t groupTokens = 0;
+
+    auto flush = [&]() {
+        if (!group.members.empty()) {
+            packed.push_back(std::move(group));
+        }
+        group = PackedSegment();
+        groupTokens = 0;
+    };
+
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const TranslationSegment& segment = segments[i];
+
+        // A segment that already contains the separator would make the split ambiguous
+        bool packable = params.enabled && params.maxSegments > 1 && !params.separator.empty() &&
+            sourceTokens[i] <= params.maxSegmentTokens &&
+            segment.text.find(params.separator) == std::string::npos;
+        if (!packable) {
+            flush();
+            packed.push_back({{i}, segment.text});
+            continue;
+        }
+
+        std::string prefix = languagePrefix(segment.text);
+        bool fits = !group.members.empty() &&
+            segments[group.members.back()].chapterNum == segment.chapterNum &&
+            prefix == groupPrefix &&
+            group.members.size() < params.maxSegments &&
+            groupTokens + sourceTokens[i] <= params.maxPackedTokens;
+
+        if (fits) {
+            // Only the first member keeps the language prefix
+            group.text += " " + params.separator + " " + segment.text.substr(prefix.size());
+        } else {
+            flush();
+            groupPrefix = prefix;
+            group.text = segment.text;
+        }
+        group.members.push_back(i);
+        groupTokens += sourceTokens[i];
+    }
+    flush();
+
+    return packed;
+}
+
+bool SegmentPacker::unpack(const std::string& translation, size_t memberCount, std::vector<std::string>& parts) const {
+    parts.clear();
+    if (memberCount <= 1) {
+        parts.push_back(translation);
+        return memberCount == 1;
+    }
+
+    size_t start = 0;
+    while (true) {
+        size_t end = translation.find(params.separator, start);
+        parts.push_back(trim(translation.substr(start, end == std::string::npos ? std::string::npos : end - start)));
+        if (end == std::string::npos) break;
+        start = end + params.separator.size();
+    }
+
+    // An empty part means two separators collapsed around a member the model left out
+    for (const std::string& part : parts) {
+        if (part.empty()) {
+            return false;
+        }
+    }
+    return parts.size() == memberCount;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "TranslationEngine.h"
+
+// Mirrors the "packing" object of translationConfig.json. Consecutive segments of up to
+// maxSegmentTokens tokens from one chapter are translated as one sequence of at most
+// maxPackedTokens tokens, joined by a separator the model copies to its output.
+struct PackingParams {
+    bool enabled = false;
+    size_t maxSegmentTokens = 24;
+    size_t maxPackedTokens = 128;
+    size_t maxSegments = 8;
+    std::string separator = "◆";
+};
+
+// Segments translated as one sequence, members index the engine's input segments
+struct PackedSegment {
+    std::vector<size_t> members;
+    std::string text;
+};
+
+class SegmentPacker {
+public:
+    SegmentPacker() = default;
+    explicit SegmentPacker(const PackingParams& params);
+
+    // sourceTokens holds the token count of every segment. Segments that can't be packed come
+    // back as single members with their text unchanged, so the result covers every segment in order.
+    std::vector<PackedSegment> pack(const std::vector<TranslationSegment>& segments, const std::vector<size_t>& sourceTokens) const;
+
+    // Splits the translation of a packed segment into its members' translations. Returns false
+    // when the model dropped, merged or invented a separator, the members are then translated alone.
+    bool unpack(const std::string& translation, size_t memberCount, std::vector<std::string>& parts) const;
+
+protected:
+    // The ">>lang<< " prefix the translators put in front of every segment, empty if there is none
+    static std::string languagePrefix(const std::string& text);
+
+    PackingParams params;
+};
@@ -0,0 +1,88 @@
+#include "TensorArena.h"
+
+#include <utility>
+
+TensorArena::TensorArena(TensorArena&& other) noexcept
+    : floatBuffers(std::move(other.floatBuffers)), int64Buffers(std::move(other.int64Buffers)),
+      floatPool(std::move(other.floatPool)), int64Pool(std::move(other.int64Pool)), allocationCount(other.allocationCount.load()) {}
+
+TensorArena& TensorArena::operator=(TensorArena&& other) noexcept {
+    floatBuffers = std::move(other.floatBuffers);
+    int64Buffers = std::move(other.int64Buffers);
+    floatPool = std::move(other.floatPool);
+    int64Pool = std::move(other.int64Pool);
+    allocationCount = other.allocationCount.load();
+    return *this;
+}
+
+template <typename T>
+T* TensorArena::scratch(std::unordered_map<std::string, std::vector<T>>& buffers, const std::string& name, size_t count) {
+    auto entry = buffers.find(name);
+    if (entry == buffers.end()) {
+        entry = buffers.emplace(name, std::vector<T>()).first;
+    }
+
+    std::vector<T>& buffer = entry->second;
+    if (buffer.size() < count) {
+        ++allocationCount;
+        buffer.resize(count);
+    }
+    return buffer.data();
+}
+
+template <typename T>
+std::vector<T> TensorArena::acquire(std::vector<std::vector<T>>& pool, size_t capacity) {
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    // The smallest pooled buffer that fits, so large ones stay available for large requests
+    size_t best = pool.size();
+    for (size_t i = 0; i < pool.size(); ++i) {
+        if (pool[i].capacity() >= capacity && (best == pool.size() || pool[i].capacity() < pool[best].capacity())) {
+            best = i;
+        }
+    }
+
+    std::vector<T> buffer;
+    if (best != pool.size()) {
+        buffer = std::move(pool[best]);
+        pool[best] = std::move(pool.back());
+        pool.pop_back();
+    } else if (capacity > 0) {
+        ++allocationCount;
+        buffer.reserve(capacity);
+    }
+    buffer.clear();
+    return buffer;
+}
+
+float* TensorArena::floats(const std::string& name, size_t count) {
+    return scratch(floatBuffers, name, count);
+}
+
+int64_t* TensorArena::int64s(const std::string& name, size_t count) {
+    return scratch(int64Buffers, name, count);
+}
+
+std::vector<float> TensorArena::acquireFloats(size_t capacity) {
+    return acquire(floatPool, capacity);
+}
+
+std::vector<int64_t> TensorArena::acquireInt64s(size_t capacity) {
+    return acquire(int64Pool, capacity);
+}
+
+void TensorArena::release(std::vector<float>& buffer) {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (buffer.capacity() > 0) {
+        floatPool.push_back(std::move(buffer));
+    }
+    buffer = std::vector<float>();
+}
+
+void TensorArena::release(std::vector<int64_t>& buffer) {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (buffer.capacity() > 0) {
+        int64Pool.push_back(std::move(buffer));
+    }
+    buffer = std::vector<int64_t>();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Tensor memory a session reuses across decode steps and cohorts. Buffers only grow, so once
+// every shape has been seen at its largest the decode loop runs without allocating tensor memory.
+// allocations() counts every time a buffer had to grow, the engine reports it in its stats.
+class TensorArena {
+public:
+    TensorArena() = default;
+
+    // Only for setting up the sessions, before any worker uses the arena
+    TensorArena(TensorArena&& other) noexcept;
+    TensorArena& operator=(TensorArena&& other) noexcept;
+
+    // Scratch buffer of at least count elements, its contents are overwritten by the next user
+    // of the same name. Names are the graph's input and output names.
+    float* floats(const std::string& name, size_t count);
+    int64_t* int64s(const std::string& name, size_t count);
+
+    // Storage that outlives a step, like a cohort's cache. An empty buffer with at least the
+    // given capacity, handed back with release once its owner is done with it. Unlike the
+    // scratch buffers these can be used from a second thread, the encoder stage of a pipeline.
+    std::vector<float> acquireFloats(size_t capacity);
+    std::vector<int64_t> acquireInt64s(size_t capacity);
+    void release(std::vector<float>& buffer);
+    void release(std::vector<int64_t>& buffer);
+
+    size_t allocations() const { return allocationCount.load(); }
+
+protected:
+    template <typename T>
+    T* scratch(std::unordered_map<std::string, std::vector<T>>& buffers, const std::string& name, size_t count);
+
+    template <typename T>
+    std::vector<T> acquire(std::vector<std::vector<T>>& pool, size_t capacity);
+
+    std::unordered_map<std::string, std::vector<float>> floatBuffers;
+    std::unordered_map<std::string, std::vector<int64_t>> int64Buffers;
+    std::vector<std::vector<float>> floatPool;
+    std::vector<std::vector<int64_t>> int64Pool;
+    std::mutex poolMutex;
+    std::atomic<size_t> allocationCount{0};
+};
@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "OnnxTranslationEngine.h"
+#include "DaemonTranslationEngine.h"
+#include "TranslationServer.h"
+
+// Long lived translation worker. Loads the model once and serves the translators over a local socket.
+// Usage: TranslationDaemon [--socket <path>] [--idle-minutes <n>] [--stop]
+int main(int argc, char* argv[]) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    std::filesystem::path socketPath;
+    int idleMinutes = 30;
+    bool stop = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--idle-minutes") == 0 && i + 1 < argc) {
+            idleMinutes = std::stoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--stop") == 0) {
+            stop = true;
+        } else {
+            std::cerr << "Usage: TranslationDaemon [--socket <path>] [--idle-minutes <n>] [--stop]" << "\n";
+            return 1;
+        }
+    }
+
+    try {
+        if (socketPath.empty()) {
+            socketPath = TranslationProtocol::defaultSocketPath();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Translation daemon failed, Details: " << e.what() << "\n";
+        return 1;
+    }
+
+    if (stop) {
+        DaemonTranslationEngine::shutdown(socketPath);
+        return 0;
+    }
+
+    // A daemon busy with a client doesn't answer the ping, but still owns the socket
+    if (DaemonTranslationEngine::isListening(socketPath)) {
+        std::cout << "Translation daemon already running on " << socketPath.string() << "\n";
+        return 0;
+    }
+
+    try {
+        // The socket only appears once the model is loaded, so clients never wait on a cold engine
+        auto engine = std::make_shared<OnnxTranslationEngine>();
+        TranslationServer server(engine, socketPath, std::chrono::minutes(idleMinutes));
+        server.run();
+    } catch (const std::exception& e) {
+        std::cerr << "Translation daemon failed, Details: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+#else
+    std::cerr << "Local sockets are not supported on this platform." << "\n";
+    return 1;
+#endif
+}
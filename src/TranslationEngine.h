@@ -0,0 +1,65 @@
+#pragma once
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A single piece of text to translate. The text already carries the ">>lang<<" prefix
+// that the translators add for the multilingual model.
+struct TranslationSegment {
+    int chapterNum;
+    int position;
+    std::string text;
+};
+
+struct TranslationResult {
+    int chapterNum;
+    int position;
+    std::string text;
+
+    // Average log probability of the output tokens under the decoding settings, closer to 0 is
+    // more confident. Engines that don't score their output leave it at 0.
+    float confidence = 0.0f;
+};
+
+class TranslationEngine {
+public:
+    using ResultCallback = std::function<void(const TranslationResult&)>;
+
+    virtual ~TranslationEngine() = default;
+
+    // Translates the segments and returns the results in input order. Segments that fail
+    // to translate are left out so the caller keeps the original text for them.
+    virtual std::vector<TranslationResult> translate(const std::vector<TranslationSegment>& segments) = 0;
+
+    // Like translate, but also hands every result to onResult as soon as it is final, in the order
+    // the segments finish. onResult is called from one thread at a time, though not always the
+    // caller's. Engines that can't stream report everything once translate returns.
+    virtual std::vector<TranslationResult> translateStreaming(const std::vector<TranslationSegment>& segments, const ResultCallback& onResult) {
+        std::vector<TranslationResult> results = translate(segments);
+        if (onResult) {
+            for (const auto& result : results) {
+                onResult(result);
+            }
+        }
+        return results;
+    }
+
+    // The model and the settings that shape its output, a translation memory only reuses results
+    // produced under the same ones. Engines that leave modelId empty are never cached.
+    virtual std::string modelId() const { return ""; }
+    virtual std::string decodingParams() const { return ""; }
+
+    // A callback for translateStreaming that prints how far the total got at every tenth
+    static ResultCallback progressReporter(size_t total) {
+        auto done = std::make_shared<size_t>(0);
+        return [total, done](const TranslationResult&) {
+            size_t before = 10 * (*done)++ / total;
+            if (10 * *done / total > before) {
+                std::cout << "Translated " << *done << " of " << total << " segments." << "\n";
+            }
+        };
+    }
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include <boost/process.hpp>
+#if defined(_WIN32)
+#include <boost/process/windows.hpp>
+#endif
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "TranslationEngine.h"
+#include "OnnxTranslationEngine.h"
+#include "DaemonTranslationEngine.h"
+
+
+
+class TranslationEngineFactory {
+public:
+    // Prefers a warm TranslationDaemon and starts one when none is running. Without a daemon the
+    // model is loaded on first use and shared by every translator for the rest of the process.
+    static std::shared_ptr<TranslationEngine> getEngine() {
+        static std::mutex engineMutex;
+        static std::shared_ptr<TranslationEngine> engine;
+
+        std::lock_guard<std::mutex> lock(engineMutex);
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        try {
+            std::filesystem::path socketPath = TranslationProtocol::defaultSocketPath();
+            if (DaemonTranslationEngine::isRunning(socketPath)) {
+                return std::make_shared<DaemonTranslationEngine>(socketPath);
+            }
+
+            // A second daemon would take the socket from one that is busy or hung
+            if (DaemonTranslationEngine::isListening(socketPath)) {
+                std::cerr << "The translation daemon on " << socketPath.string() << " doesn't answer, translating in process." << std::endl;
+            } else if (startDaemon(socketPath)) {
+                return std::make_shared<DaemonTranslationEngine>(socketPath);
+            }
+        } catch (const std::exception& ex) {
+            std::cerr << "Translation daemon unavailable, Details: " << ex.what() << std::endl;
+        }
+#endif
+
+        if (!engine) {
+            std::cout << "Creating ONNX Runtime translation engine" << std::endl;
+            engine = std::make_shared<OnnxTranslationEngine>();
+        }
+        return engine;
+    }
+
+private:
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    static bool startDaemon(const std::filesystem::path& socketPath) {
+        std::filesystem::path daemonExe;
+        #if defined(_WIN32)
+            daemonExe = "TranslationDaemon.exe";
+        #else
+            daemonExe = "TranslationDaemon";
+        #endif
+
+        if (!std::filesystem::exists(daemonExe)) {
+            std::cerr << "Executable not found: " << daemonExe << std::endl;
+            return false;
+        }
+
+        std::cout << "Starting translation daemon" << std::endl;
+
+        try {
+            #if defined(_WIN32)
+                boost::process::child daemon(daemonExe.string(), "--socket", socketPath.string(), boost::process::std_out > boost::process::null, boost::process::windows::hide);
+            #else
+                boost::process::child daemon(daemonExe.string(), "--socket", socketPath.string(), boost::process::std_out > boost::process::null);
+            #endif
+
+            // The socket appears once the model is loaded, a daemon that exits early failed to load it
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::minutes(2);
+            while (std::chrono::steady_clock::now() < deadline) {
+                if (DaemonTranslationEngine::isRunning(socketPath)) {
+                    daemon.detach();
+                    return true;
+                }
+                if (!daemon.running()) {
+                    std::cerr << "Translation daemon exited with code: " << daemon.exit_code() << std::endl;
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+
+            std::cerr << "Translation daemon did not start in time" << std::endl;
+            daemon.terminate();
+        } catch (const std::exception& ex) {
+            std::cerr << "Exception: " << ex.what() << std::endl;
+        }
+        return false;
+    }
+#endif
+};
@@ -0,0 +1,184 @@
+#include "TranslationJob.h"
+#include "Hashing.h"
+
+#include <iostream>
+#include <map>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+TranslationJob::TranslationJob(const std::filesystem::path& documentPath, const std::filesystem::path& journalDir, std::shared_ptr<TranslationMemory> memory)
+    : documentPath(documentPath), journalDir(journalDir), memory(std::move(memory)) {}
+
+void TranslationJob::openJournal() {
+    // Without a journal the job still translates, it just can't be resumed
+    try {
+        documentHash = Hashing::hashFile(documentPath);
+        std::filesystem::create_directories(journalDir);
+        path = journalDir / (Hashing::toHex(documentHash) + ".journal");
+        journal = std::make_unique<TranslationJournal>(path, documentHash);
+    } catch (const std::exception& e) {
+        std::cerr << "Translation journal disabled, the job can't be resumed. Details: " << e.what() << "\n";
+        journal.reset();
+    }
+}
+
+std::vector<TranslationResult> TranslationJob::translate(TranslationEngine& engine, const std::vector<TranslationSegment>& segments, const TranslationEngine::ResultCallback& onResult) {
+    using Key = std::pair<int, int>;
+    if (!journal) openJournal();
+
+    // A journaled result only counts while its segment still has the same text
+    std::map<Key, const JournalEntry*> journaled;
+    if (journal) {
+        for (const auto& entry : journal->entries()) {
+            journaled[{entry.result.chapterNum, entry.result.position}] = &entry;
+        }
+    }
+
+    // Engines without a model id can't tell whether a remembered translation is theirs
+    std::string modelId = memory ? engine.modelId() : "";
+    std::string decodingParams = modelId.empty() ? "" : engine.decodingParams();
+    bool useMemory = !modelId.empty();
+
+    // Byte-identical segments, like sound effects, "……" or repeated dialogue tags, go to the engine
+    // once under the key of their first copy. The lists below are parallel to remaining.
+    std::map<Key, TranslationResult> finished;
+    std::vector<TranslationSegment> remaining;
+    std::vector<std::vector<Key>> copies;
+    std::vector<uint64_t> sourceHashes;
+    std::vector<MemoryKey> memoryKeys;
+    std::unordered_map<std::string_view, size_t> firstCopy;
+    std::map<Key, size_t> representative;
+    resumed = lookups = hits = bytesSaved = unique = duplicates = 0;
+    for (const auto& segment : segments) {
+        Key key = {segment.chapterNum, segment.position};
+        uint64_t sourceHash = Hashing::fnv1a64(segment.text);
+        auto entry = journaled.find(key);
+        if (entry != journaled.end() && entry->second->sourceHash == sourceHash) {
+            finished[key] = entry->second->result;
+            if (onResult) onResult(entry->second->result);
+            ++resumed;
+            continue;
+        }
+
+        // A copy of a text that already missed the memory rides along with its first copy
+        auto first = firstCopy.find(segment.text);
+        if (first != firstCopy.end()) {
+            copies[first->second].push_back(key);
+            ++duplicates;
+            continue;
+        }
+
+        MemoryKey memoryKey;
+        if (useMemory) {
+            memoryKey = TranslationMemory::key(segment.text, modelId, decodingParams);
+            TranslationResult remembered = {segment.chapterNum, segment.position, ""};
+            ++lookups;
+            if (memory->lookup(memoryKey, remembered)) {
+                ++hits;
+                bytesSaved += segment.text.size();
+                if (onResult) onResult(remembered);
+                finished[key] = std::move(remembered);
+                continue;
+            }
+        }
+
+        firstCopy.emplace(segment.text, remaining.size());
+        representative.emplace(key, remaining.size());
+        copies.push_back({key});
+        sourceHashes.push_back(sourceHash);
+        memoryKeys.push_back(std::move(memoryKey));
+        remaining.push_back(segment);
+    }
+    unique = remaining.size();
+    if (resumed > 0) {
+        std::cout << "Resuming the job from " << path.string() << ", " << resumed << " of " << segments.size() << " segments were already translated." << "\n";
+    }
+
+    // Results reach the journal as the engine finishes them, a crash keeps all but the last unsynced batch
+    std::vector<TranslationResult> translated;
+    if (!remaining.empty()) {
+        try {
+            translated = engine.translateStreaming(remaining, [&](const TranslationResult& result) {
+                auto sent = representative.find({result.chapterNum, result.position});
+                if (sent == representative.end()) {
+                    if (onResult) onResult(result);
+                    return;
+                }
+
+                if (useMemory) {
+                    try {
+                        memory->insert(memoryKeys[sent->second], result);
+                    } catch (const std::exception& e) {
+                        std::cerr << "Translation memory not updated for the rest of the job, Details: " << e.what() << "\n";
+                        useMemory = false;
+                    }
+                }
+                for (const Key& key : copies[sent->second]) {
+                    TranslationResult copy = result;
+                    copy.chapterNum = key.first;
+                    copy.position = key.second;
+                    if (journal) {
+                        try {
+                            journal->append(copy, sourceHashes[sent->second]);
+                        } catch (const std::exception& e) {
+                            // A full disk shouldn't stop the translation, only the resume
+                            std::cerr << "Translation journal disabled, the job can't be resumed. Details: " << e.what() << "\n";
+                            journal.reset();
+                        }
+                    }
+                    if (onResult) onResult(copy);
+                }
+            });
+        } catch (...) {
+            if (journal) journal->sync();
+            if (memory) memory->flush();
+            throw;
+        }
+        if (journal) journal->sync();
+        if (memory) memory->flush();
+    }
+
+    size_t engineSegments = 0;
+    for (auto& result : translated) {
+        auto sent = representative.find({result.chapterNum, result.position});
+        if (sent == representative.end()) continue;
+        for (const Key& key : copies[sent->second]) {
+            TranslationResult& copy = finished[key];
+            copy = result;
+            copy.chapterNum = key.first;
+            copy.position = key.second;
+            ++engineSegments;
+        }
+    }
+
+    std::cout << "Job summary: " << segments.size() << " segments, " << resumed << " resumed from the journal, " << hits << " from the translation memory, " << engineSegments << " translated by the engine." << "\n";
+    if (lookups > 0) {
+        std::cout << "Translation memory hit rate " << 100.0 * hits / lookups << "% (" << hits << " of " << lookups << "), " << bytesSaved << " bytes not sent to the engine." << "\n";
+    }
+    if (unique > 0) {
+        std::cout << "Deduplicated " << unique + duplicates << " segments to " << unique << " unique ones, dedup ratio " << static_cast<double>(unique + duplicates) / unique << "." << "\n";
+    }
+
+    std::vector<TranslationResult> results;
+    results.reserve(finished.size());
+    for (const auto& segment : segments) {
+        auto result = finished.find({segment.chapterNum, segment.position});
+        if (result != finished.end()) {
+            results.push_back(std::move(result->second));
+            finished.erase(result);
+        }
+    }
+    return results;
+}
+
+void TranslationJob::finish() {
+    if (!journal) return;
+    journal.reset();
+
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    if (error) {
+        std::cerr << "Failed to delete translation journal " << path.string() << ", Details: " << error.message() << "\n";
+    }
+}
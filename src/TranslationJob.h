@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+#include "TranslationEngine.h"
+#include "TranslationJournal.h"
+#include "TranslationMemory.h"
+
+// One book's translation, resumable after a crash or a closed GUI. Every finished segment is
+// journaled under journals/<content hash of the document>.journal, and a job started again on
+// the same document takes the journaled segments whose text is unchanged instead of translating
+// them. The journal is opened by translate and deleted by finish once the translated document
+// has been written. With a translation memory, segments it already knows are taken from it and
+// the engine's new translations are added to it. Byte-identical segments are translated once.
+class TranslationJob {
+public:
+    explicit TranslationJob(const std::filesystem::path& documentPath, const std::filesystem::path& journalDir = "journals", std::shared_ptr<TranslationMemory> memory = nullptr);
+
+    // Like TranslationEngine::translateStreaming, journaled and remembered results are reported first
+    std::vector<TranslationResult> translate(TranslationEngine& engine, const std::vector<TranslationSegment>& segments, const TranslationEngine::ResultCallback& onResult = nullptr);
+
+    void finish();
+
+    const std::filesystem::path& journalPath() const { return path; }
+    size_t resumedSegments() const { return resumed; }
+
+    // Segments looked up in and taken from the translation memory, and the source bytes the engine didn't get
+    size_t memoryLookups() const { return lookups; }
+    size_t memoryHits() const { return hits; }
+    size_t memoryBytesSaved() const { return bytesSaved; }
+
+    // Segments sent to the engine and the byte-identical copies translated with them
+    size_t uniqueSegments() const { return unique; }
+    size_t duplicateSegments() const { return duplicates; }
+
+protected:
+    void openJournal();
+
+    std::filesystem::path documentPath;
+    std::filesystem::path journalDir;
+    std::filesystem::path path;
+    uint64_t documentHash = 0;
+    std::unique_ptr<TranslationJournal> journal;
+    std::shared_ptr<TranslationMemory> memory;
+    size_t resumed = 0;
+    size_t lookups = 0;
+    size_t hits = 0;
+    size_t bytesSaved = 0;
+    size_t unique = 0;
+    size_t duplicates = 0;
+};
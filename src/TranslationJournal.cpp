@@ -0,0 +1,140 @@
+#include "TranslationJournal.h"
+#include "Hashing.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static constexpr size_t headerSize = 16;
+static constexpr size_t recordHeaderSize = 8;
+static constexpr size_t payloadHeaderSize = 20;
+
+template <typename T>
+static void putValue(std::string& buffer, T value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static T getValue(const char* bytes) {
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+static uint32_t checksum(const char* data, size_t size) {
+    return static_cast<uint32_t>(Hashing::fnv1a64(data, size));
+}
+
+TranslationJournal::TranslationJournal(const std::filesystem::path& path, uint64_t documentHash, size_t syncEvery, std::chrono::milliseconds syncInterval)
+    : path(path), documentHash(documentHash), syncEvery(std::max<size_t>(1, syncEvery)), syncInterval(syncInterval), lastSync(std::chrono::steady_clock::now()) {
+    load();
+    bool fresh = !std::filesystem::exists(path) || std::filesystem::file_size(path) == 0;
+
+#ifdef _WIN32
+    file = _wfopen(path.c_str(), L"ab");
+#else
+    file = std::fopen(path.c_str(), "ab");
+#endif
+    if (!file) {
+        throw std::runtime_error("Failed to open translation journal: " + path.string());
+    }
+
+    // A new journal starts with its header, synced so the records never precede it on disk
+    if (fresh) {
+        std::string header("TJRN", 4);
+        putValue<uint32_t>(header, 1);
+        putValue<uint64_t>(header, documentHash);
+        std::fwrite(header.data(), 1, header.size(), file);
+        syncLocked();
+    }
+}
+
+TranslationJournal::~TranslationJournal() {
+    if (file) {
+        syncLocked();
+        std::fclose(file);
+    }
+}
+
+void TranslationJournal::load() {
+    std::ifstream input(path, std::ios::binary);
+    if (!input.is_open()) return;
+    std::string contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    input.close();
+
+    if (contents.size() < headerSize || contents.compare(0, 4, "TJRN") != 0 || getValue<uint32_t>(contents.data() + 4) != 1 || getValue<uint64_t>(contents.data() + 8) != documentHash) {
+        std::filesystem::resize_file(path, 0);
+        return;
+    }
+
+    // Everything after the last complete record was being written when the job stopped
+    size_t offset = headerSize;
+    while (contents.size() - offset >= recordHeaderSize) {
+        uint32_t size = getValue<uint32_t>(contents.data() + offset);
+        const char* payload = contents.data() + offset + recordHeaderSize;
+        if (size < payloadHeaderSize || contents.size() - offset - recordHeaderSize < size || getValue<uint32_t>(contents.data() + offset + 4) != checksum(payload, size)) {
+            break;
+        }
+
+        JournalEntry entry;
+        entry.result.chapterNum = getValue<int32_t>(payload);
+        entry.result.position = getValue<int32_t>(payload + 4);
+        entry.result.confidence = getValue<float>(payload + 8);
+        entry.sourceHash = getValue<uint64_t>(payload + 12);
+        entry.result.text.assign(payload + payloadHeaderSize, size - payloadHeaderSize);
+        recovered.push_back(std::move(entry));
+        offset += recordHeaderSize + size;
+    }
+    if (offset < contents.size()) {
+        std::filesystem::resize_file(path, offset);
+    }
+}
+
+void TranslationJournal::append(const TranslationResult& result, uint64_t sourceHash) {
+    std::string payload;
+    payload.reserve(payloadHeaderSize + result.text.size());
+    putValue<int32_t>(payload, result.chapterNum);
+    putValue<int32_t>(payload, result.position);
+    putValue<float>(payload, result.confidence);
+    putValue<uint64_t>(payload, sourceHash);
+    payload += result.text;
+
+    std::string record;
+    record.reserve(recordHeaderSize + payload.size());
+    putValue<uint32_t>(record, static_cast<uint32_t>(payload.size()));
+    putValue<uint32_t>(record, checksum(payload.data(), payload.size()));
+    record += payload;
+
+    std::lock_guard<std::mutex> lock(appendMutex);
+    if (std::fwrite(record.data(), 1, record.size(), file) != record.size()) {
+        throw std::runtime_error("Failed to write translation journal: " + path.string());
+    }
+    ++pending;
+    if (pending >= syncEvery || std::chrono::steady_clock::now() - lastSync >= syncInterval) {
+        syncLocked();
+    }
+}
+
+void TranslationJournal::sync() {
+    std::lock_guard<std::mutex> lock(appendMutex);
+    syncLocked();
+}
+
+void TranslationJournal::syncLocked() {
+    std::fflush(file);
+#ifdef _WIN32
+    _commit(_fileno(file));
+#else
+    fsync(fileno(file));
+#endif
+    pending = 0;
+    lastSync = std::chrono::steady_clock::now();
+}
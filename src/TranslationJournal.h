@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+#include "TranslationEngine.h"
+
+// A result read back from a journal, sourceHash identifies the segment text it translated
+struct JournalEntry {
+    TranslationResult result;
+    uint64_t sourceHash = 0;
+};
+
+// Append-only log of the finished segments of one document, so a crashed or cancelled job keeps
+// its work. Records are synced to disk in batches of syncEvery records or after syncInterval,
+// whichever comes first, so a crash loses at most one batch. A record cut off by the crash is
+// dropped when the journal is opened again.
+//
+// File layout: "TJRN", uint32 version 1, uint64 document hash, then per record uint32 payload
+// size, uint32 checksum of the payload, and the payload: int32 chapter, int32 position,
+// float confidence, uint64 source hash and the UTF-8 text.
+class TranslationJournal {
+public:
+    // Opens the journal at path, one written for another document hash is started over
+    TranslationJournal(const std::filesystem::path& path, uint64_t documentHash, size_t syncEvery = 32, std::chrono::milliseconds syncInterval = std::chrono::milliseconds(2000));
+    ~TranslationJournal();
+
+    TranslationJournal(const TranslationJournal&) = delete;
+    TranslationJournal& operator=(const TranslationJournal&) = delete;
+
+    // The results recorded by earlier runs of the same document
+    const std::vector<JournalEntry>& entries() const { return recovered; }
+
+    // Safe to call from the engine's result callback
+    void append(const TranslationResult& result, uint64_t sourceHash);
+
+    // Writes every appended record through to the disk
+    void sync();
+
+protected:
+    void load();
+    void syncLocked();
+
+    std::filesystem::path path;
+    uint64_t documentHash = 0;
+    size_t syncEvery = 32;
+    std::chrono::milliseconds syncInterval;
+
+    std::vector<JournalEntry> recovered;
+    std::FILE* file = nullptr;
+    std::mutex appendMutex;
+    size_t pending = 0;
+    std::chrono::steady_clock::time_point lastSync;
+};
@@ -0,0 +1,311 @@
+#include "TranslationMemory.h"
+#include "Hashing.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+template <typename T>
+static void putValue(std::string& buffer, T value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static T getValue(const unsigned char* bytes) {
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+static uint32_t checksum(const unsigned char* data, size_t size) {
+    return static_cast<uint32_t>(Hashing::fnv1a64(data, size));
+}
+
+static constexpr size_t recordHeaderSize = 8;
+static constexpr size_t payloadHeaderSize = 16;
+
+TranslationMemory::TranslationMemory(const std::filesystem::path& directory)
+    : dataPath(directory / "memory.data"), indexPath(directory / "memory.index") {
+    std::filesystem::create_directories(directory);
+    openData();
+    openIndex();
+
+#ifdef _WIN32
+    file = _wfopen(dataPath.c_str(), L"ab");
+#else
+    file = std::fopen(dataPath.c_str(), "ab");
+#endif
+    if (!file) {
+        throw std::runtime_error("Failed to open translation memory: " + dataPath.string());
+    }
+}
+
+TranslationMemory::~TranslationMemory() {
+    if (file) {
+        std::fclose(file);
+    }
+    if (inserted.empty()) return;
+
+    // The inserted entries come last and replace indexed ones with the same hash. The mappings
+    // are closed first, Windows can't replace a mapped file.
+    std::vector<std::pair<uint64_t, uint64_t>> entries = indexedEntries();
+    for (const auto& [hash, entry] : inserted) {
+        entries.emplace_back(hash, entry.offset);
+    }
+    index = MappedFile();
+    data = MappedFile();
+    try {
+        writeIndex(entries);
+    } catch (const std::exception& e) {
+        // The next run rebuilds the index from the data file
+        std::cerr << "Failed to write translation memory index, Details: " << e.what() << "\n";
+    }
+}
+
+std::shared_ptr<TranslationMemory> TranslationMemory::shared(const std::filesystem::path& directory) {
+    static std::mutex memoryMutex;
+    static std::shared_ptr<TranslationMemory> memory;
+    static bool opened = false;
+
+    std::lock_guard<std::mutex> lock(memoryMutex);
+    if (!opened) {
+        opened = true;
+        try {
+            memory = std::make_shared<TranslationMemory>(directory);
+            std::cout << "Translation memory has " << memory->size() << " entries." << "\n";
+        } catch (const std::exception& e) {
+            std::cerr << "Translation memory disabled, Details: " << e.what() << "\n";
+        }
+    }
+    return memory;
+}
+
+std::string TranslationMemory::normalize(const std::string& text) {
+    std::string normalized;
+    normalized.reserve(text.size());
+    bool space = false;
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        size_t width = 0;
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v') {
+            width = 1;
+        } else if (text.compare(i, 2, "\xC2\xA0") == 0) {
+            width = 2;
+        } else if (text.compare(i, 3, "\xE3\x80\x80") == 0) {
+            width = 3;
+        }
+
+        if (width > 0) {
+            space = !normalized.empty();
+            i += width;
+            continue;
+        }
+        if (space) {
+            normalized += ' ';
+            space = false;
+        }
+        normalized += text[i++];
+    }
+    return normalized;
+}
+
+MemoryKey TranslationMemory::key(const std::string& text, const std::string& modelId, const std::string& decodingParams) {
+    MemoryKey key;
+    key.source = normalize(text);
+
+    // The separators keep ("ab", "c") and ("a", "bc") apart
+    key.hash = Hashing::fnv1a64(modelId);
+    key.hash = Hashing::fnv1a64("", 1, key.hash);
+    key.hash = Hashing::fnv1a64(decodingParams, key.hash);
+    key.hash = Hashing::fnv1a64("", 1, key.hash);
+    key.hash = Hashing::fnv1a64(key.source, key.hash);
+    return key;
+}
+
+void TranslationMemory::openData() {
+    if (!std::filesystem::exists(dataPath) || std::filesystem::file_size(dataPath) == 0) {
+        std::string header("TMEM", 4);
+        putValue<uint32_t>(header, 1);
+        std::ofstream output(dataPath, std::ios::binary);
+        output.write(header.data(), header.size());
+        if (!output) {
+            throw std::runtime_error("Failed to create translation memory: " + dataPath.string());
+        }
+    }
+
+    data = MappedFile(dataPath);
+    if (data.size() < dataHeaderSize || std::memcmp(data.data(), "TMEM", 4) != 0 || getValue<uint32_t>(data.data() + 4) != 1) {
+        throw std::runtime_error("Not a translation memory: " + dataPath.string());
+    }
+    dataSize = data.size();
+}
+
+void TranslationMemory::openIndex() {
+    if (std::filesystem::exists(indexPath)) {
+        index = MappedFile(indexPath);
+        const unsigned char* header = index.data();
+        if (index.size() >= indexHeaderSize && std::memcmp(header, "TMIX", 4) == 0 && getValue<uint32_t>(header + 4) == 1 && getValue<uint64_t>(header + 8) == data.size()) {
+            uint64_t slots = getValue<uint64_t>(header + 16);
+            bool powerOfTwo = slots > 0 && (slots & (slots - 1)) == 0;
+            if (powerOfTwo && slots <= (index.size() - indexHeaderSize) / slotSize && index.size() == indexHeaderSize + slots * slotSize) {
+                capacity = slots;
+                indexed = static_cast<size_t>(getValue<uint64_t>(header + 24));
+                return;
+            }
+        }
+    }
+    rebuildIndex();
+}
+
+void TranslationMemory::rebuildIndex() {
+    index = MappedFile();
+
+    // Everything after the last complete entry was being written when the process stopped
+    std::vector<std::pair<uint64_t, uint64_t>> entries;
+    size_t offset = dataHeaderSize;
+    while (data.size() - offset >= recordHeaderSize) {
+        uint32_t size = getValue<uint32_t>(data.data() + offset);
+        const unsigned char* payload = data.data() + offset + recordHeaderSize;
+        if (size < payloadHeaderSize || data.size() - offset - recordHeaderSize < size || getValue<uint32_t>(data.data() + offset + 4) != checksum(payload, size)) {
+            break;
+        }
+        entries.emplace_back(getValue<uint64_t>(payload), offset);
+        offset += recordHeaderSize + size;
+    }
+    if (offset < data.size()) {
+        data = MappedFile();
+        std::filesystem::resize_file(dataPath, offset);
+        data = MappedFile(dataPath);
+        dataSize = data.size();
+    }
+
+    writeIndex(entries);
+    if (!entries.empty()) {
+        std::cout << "Rebuilt the translation memory index from " << entries.size() << " entries." << "\n";
+    }
+    openIndex();
+}
+
+void TranslationMemory::writeIndex(const std::vector<std::pair<uint64_t, uint64_t>>& entries) const {
+    // At most half full, so a lookup of a missing hash ends at an empty slot after a few probes
+    uint64_t slots = 16;
+    while (slots < 2 * entries.size()) {
+        slots *= 2;
+    }
+
+    // A later entry for the same hash replaces the earlier one
+    std::vector<uint64_t> table(2 * slots, 0);
+    uint64_t count = 0;
+    for (const auto& [hash, offset] : entries) {
+        uint64_t slot = hash & (slots - 1);
+        while (table[2 * slot + 1] != 0 && table[2 * slot] != hash) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        if (table[2 * slot + 1] == 0) ++count;
+        table[2 * slot] = hash;
+        table[2 * slot + 1] = offset;
+    }
+
+    std::string header("TMIX", 4);
+    putValue<uint32_t>(header, 1);
+    putValue<uint64_t>(header, dataSize);
+    putValue<uint64_t>(header, slots);
+    putValue<uint64_t>(header, count);
+
+    // Written next to the index and renamed over it, a reader never maps half an index
+    std::filesystem::path temporaryPath = indexPath;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+        output.write(header.data(), header.size());
+        output.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(uint64_t));
+        if (!output) {
+            throw std::runtime_error("Failed to write translation memory index: " + temporaryPath.string());
+        }
+    }
+    std::filesystem::rename(temporaryPath, indexPath);
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> TranslationMemory::indexedEntries() const {
+    std::vector<std::pair<uint64_t, uint64_t>> entries;
+    entries.reserve(indexed);
+    for (uint64_t slot = 0; slot < capacity; ++slot) {
+        const unsigned char* bytes = index.data() + indexHeaderSize + slot * slotSize;
+        uint64_t offset = getValue<uint64_t>(bytes + 8);
+        if (offset != 0) {
+            entries.emplace_back(getValue<uint64_t>(bytes), offset);
+        }
+    }
+    return entries;
+}
+
+bool TranslationMemory::readEntry(uint64_t offset, const MemoryKey& key, TranslationResult& result) const {
+    // The offsets come from a file, so every one is checked against the data file
+    if (offset < dataHeaderSize || offset > data.size() || data.size() - offset < recordHeaderSize) return false;
+    uint32_t size = getValue<uint32_t>(data.data() + offset);
+    const unsigned char* payload = data.data() + offset + recordHeaderSize;
+    if (size < payloadHeaderSize || data.size() - offset - recordHeaderSize < size) return false;
+
+    uint32_t sourceSize = getValue<uint32_t>(payload + 12);
+    if (getValue<uint64_t>(payload) != key.hash || sourceSize > size - payloadHeaderSize) return false;
+    const char* source = reinterpret_cast<const char*>(payload + payloadHeaderSize);
+    if (key.source.size() != sourceSize || key.source.compare(0, sourceSize, source, sourceSize) != 0) return false;
+
+    result.confidence = getValue<float>(payload + 8);
+    result.text.assign(source + sourceSize, size - payloadHeaderSize - sourceSize);
+    return true;
+}
+
+bool TranslationMemory::lookup(const MemoryKey& key, TranslationResult& result) const {
+    if (capacity > 0) {
+        const unsigned char* slots = index.data() + indexHeaderSize;
+        for (uint64_t probe = 0, slot = key.hash & (capacity - 1); probe < capacity; ++probe, slot = (slot + 1) & (capacity - 1)) {
+            uint64_t offset = getValue<uint64_t>(slots + slot * slotSize + 8);
+            if (offset == 0) break;
+            if (getValue<uint64_t>(slots + slot * slotSize) == key.hash && readEntry(offset, key, result)) {
+                return true;
+            }
+        }
+    }
+
+    std::shared_lock<std::shared_mutex> lock(insertedMutex);
+    auto entry = inserted.find(key.hash);
+    if (entry == inserted.end() || entry->second.source != key.source) return false;
+    result.text = entry->second.text;
+    result.confidence = entry->second.confidence;
+    return true;
+}
+
+void TranslationMemory::insert(const MemoryKey& key, const TranslationResult& result) {
+    std::string payload;
+    payload.reserve(payloadHeaderSize + key.source.size() + result.text.size());
+    putValue<uint64_t>(payload, key.hash);
+    putValue<float>(payload, result.confidence);
+    putValue<uint32_t>(payload, static_cast<uint32_t>(key.source.size()));
+    payload += key.source;
+    payload += result.text;
+
+    std::string record;
+    record.reserve(recordHeaderSize + payload.size());
+    putValue<uint32_t>(record, static_cast<uint32_t>(payload.size()));
+    putValue<uint32_t>(record, checksum(reinterpret_cast<const unsigned char*>(payload.data()), payload.size()));
+    record += payload;
+
+    std::unique_lock<std::shared_mutex> lock(insertedMutex);
+    if (std::fwrite(record.data(), 1, record.size(), file) != record.size()) {
+        throw std::runtime_error("Failed to write translation memory: " + dataPath.string());
+    }
+    inserted[key.hash] = {dataSize, key.source, result.text, result.confidence};
+    dataSize += record.size();
+}
+
+void TranslationMemory::flush() {
+    std::unique_lock<std::shared_mutex> lock(insertedMutex);
+    std::fflush(file);
+}
+
+size_t TranslationMemory::size() const {
+    std::shared_lock<std::shared_mutex> lock(insertedMutex);
+    return indexed + inserted.size();
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "MappedFile.h"
+#include "TranslationEngine.h"
+
+// A source text as the memory stores it, with the hash it is indexed under
+struct MemoryKey {
+    uint64_t hash = 0;
+    std::string source;
+};
+
+// Translations kept across books, so the names, headings and boilerplate a series repeats are
+// translated once. Entries are keyed by the normalized source text, the engine's model id and
+// its decoding parameters.
+//
+// memory.data is append-only: "TMEM", uint32 version 1, then per entry uint32 payload size,
+// uint32 checksum of the payload, and the payload: uint64 hash, float confidence, uint32 source
+// size, the source and the translation. memory.index is an open addressing table over it: "TMIX",
+// uint32 version 1, uint64 size of the data file it covers, uint64 capacity (a power of two),
+// uint64 entry count, then per slot uint64 hash and uint64 data offset, 0 for an empty slot.
+//
+// Both files are mapped once when the memory is opened and never change while it is open, so
+// lookups of earlier entries take no lock. Entries inserted since then are kept in memory as well
+// and the index is rewritten when the memory is closed. An index that doesn't cover the data file,
+// like after a crash, is rebuilt from the data file.
+class TranslationMemory {
+public:
+    explicit TranslationMemory(const std::filesystem::path& directory);
+    ~TranslationMemory();
+
+    TranslationMemory(const TranslationMemory&) = delete;
+    TranslationMemory& operator=(const TranslationMemory&) = delete;
+
+    // The memory of the translation-memory directory shared by every job of the process,
+    // nullptr when it can't be opened
+    static std::shared_ptr<TranslationMemory> shared(const std::filesystem::path& directory = "translation-memory");
+
+    // Whitespace runs become a single space and the ends are trimmed, the tokenizer does the same
+    static std::string normalize(const std::string& text);
+    static MemoryKey key(const std::string& text, const std::string& modelId, const std::string& decodingParams);
+
+    // Fills text and confidence of result when the memory has a translation of key's source.
+    // Safe to call from any number of threads, also while another one inserts.
+    bool lookup(const MemoryKey& key, TranslationResult& result) const;
+
+    void insert(const MemoryKey& key, const TranslationResult& result);
+
+    // Writes the inserted entries to the data file
+    void flush();
+
+    size_t size() const;
+
+protected:
+    static constexpr size_t dataHeaderSize = 8;
+    static constexpr size_t indexHeaderSize = 32;
+    static constexpr size_t slotSize = 16;
+
+    struct Entry {
+        uint64_t offset = 0;
+        std::string source;
+        std::string text;
+        float confidence = 0.0f;
+    };
+
+    void openData();
+    void openIndex();
+    void rebuildIndex();
+    void writeIndex(const std::vector<std::pair<uint64_t, uint64_t>>& entries) const;
+    std::vector<std::pair<uint64_t, uint64_t>> indexedEntries() const;
+    bool readEntry(uint64_t offset, const MemoryKey& key, TranslationResult& result) const;
+
+    std::filesystem::path dataPath;
+    std::filesystem::path indexPath;
+    MappedFile data;
+    MappedFile index;
+    uint64_t capacity = 0;
+    size_t indexed = 0;
+
+    // Entries inserted since the memory was opened, by hash
+    std::unordered_map<uint64_t, Entry> inserted;
+    mutable std::shared_mutex insertedMutex;
+    std::FILE* file = nullptr;
+    uint64_t dataSize = 0;
+};
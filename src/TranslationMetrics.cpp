@@ -0,0 +1,151 @@
+#include "TranslationMetrics.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_map>
+
+std::vector<std::string> TranslationMetrics::words(const std::string& text) {
+    std::vector<std::string> tokens;
+    std::string current;
+    for (unsigned char c : text) {
+        if (std::isspace(c) || std::ispunct(c)) {
+            if (!current.empty()) {
+                tokens.push_back(current);
+                current.clear();
+            }
+            if (std::ispunct(c)) {
+                tokens.emplace_back(1, static_cast<char>(c));
+            }
+        } else {
+            current += static_cast<char>(c);
+        }
+    }
+    if (!current.empty()) {
+        tokens.push_back(current);
+    }
+    return tokens;
+}
+
+std::vector<std::string> TranslationMetrics::characters(const std::string& text) {
+    // UTF-8 code points, so a curly quote counts as one character like in sacrebleu
+    std::vector<std::string> chars;
+    for (size_t i = 0; i < text.size();) {
+        unsigned char lead = static_cast<unsigned char>(text[i]);
+        size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 1;
+        length = std::min(length, text.size() - i);
+        if (!(length == 1 && std::isspace(lead))) {
+            chars.push_back(text.substr(i, length));
+        }
+        i += length;
+    }
+    return chars;
+}
+
+// Counts the n-grams of one order, the parts are joined with a unit separator
+static std::unordered_map<std::string, size_t> countNgrams(const std::vector<std::string>& tokens, size_t order) {
+    std::unordered_map<std::string, size_t> counts;
+    for (size_t start = 0; start + order <= tokens.size(); ++start) {
+        std::string key = tokens[start];
+        for (size_t i = 1; i < order; ++i) {
+            key += '\x1f';
+            key += tokens[start + i];
+        }
+        counts[key]++;
+    }
+    return counts;
+}
+
+// Clipped matches between a hypothesis and a reference, plus both n-gram totals
+static void addMatches(const std::vector<std::string>& hypothesis, const std::vector<std::string>& reference, size_t order, double& matches, double& hypothesisTotal, double& referenceTotal) {
+    std::unordered_map<std::string, size_t> hypothesisCounts = countNgrams(hypothesis, order);
+    std::unordered_map<std::string, size_t> referenceCounts = countNgrams(reference, order);
+    for (const auto& [ngram, count] : hypothesisCounts) {
+        auto entry = referenceCounts.find(ngram);
+        if (entry != referenceCounts.end()) {
+            matches += std::min(count, entry->second);
+        }
+    }
+    hypothesisTotal += hypothesis.size() >= order ? hypothesis.size() - order + 1 : 0;
+    referenceTotal += reference.size() >= order ? reference.size() - order + 1 : 0;
+}
+
+double TranslationMetrics::corpusBleu(const std::vector<std::string>& hypotheses, const std::vector<std::string>& references) {
+    if (hypotheses.size() != references.size()) {
+        throw std::invalid_argument("BLEU needs one reference per hypothesis");
+    }
+
+    const size_t maxOrder = 4;
+    std::vector<double> matches(maxOrder, 0.0);
+    std::vector<double> totals(maxOrder, 0.0);
+    double hypothesisLength = 0.0;
+    double referenceLength = 0.0;
+    for (size_t i = 0; i < hypotheses.size(); ++i) {
+        std::vector<std::string> hypothesis = words(hypotheses[i]);
+        std::vector<std::string> reference = words(references[i]);
+        hypothesisLength += hypothesis.size();
+        referenceLength += reference.size();
+        for (size_t order = 1; order <= maxOrder; ++order) {
+            double referenceTotal = 0.0;
+            addMatches(hypothesis, reference, order, matches[order - 1], totals[order - 1], referenceTotal);
+        }
+    }
+    if (hypothesisLength == 0.0) {
+        return 0.0;
+    }
+
+    // Every order without a match halves the precision it is smoothed to
+    double logPrecision = 0.0;
+    double smoothing = 1.0;
+    for (size_t order = 0; order < maxOrder; ++order) {
+        if (totals[order] == 0.0) {
+            return 0.0;
+        }
+        double precision = matches[order] / totals[order];
+        if (matches[order] == 0.0) {
+            smoothing *= 2.0;
+            precision = 1.0 / (smoothing * totals[order]);
+        }
+        logPrecision += std::log(precision) / maxOrder;
+    }
+
+    double brevity = hypothesisLength < referenceLength ? std::exp(1.0 - referenceLength / hypothesisLength) : 1.0;
+    return 100.0 * brevity * std::exp(logPrecision);
+}
+
+double TranslationMetrics::corpusChrf(const std::vector<std::string>& hypotheses, const std::vector<std::string>& references) {
+    if (hypotheses.size() != references.size()) {
+        throw std::invalid_argument("chrF needs one reference per hypothesis");
+    }
+
+    const size_t maxOrder = 6;
+    const double beta = 2.0;
+    std::vector<double> matches(maxOrder, 0.0);
+    std::vector<double> hypothesisTotals(maxOrder, 0.0);
+    std::vector<double> referenceTotals(maxOrder, 0.0);
+    for (size_t i = 0; i < hypotheses.size(); ++i) {
+        std::vector<std::string> hypothesis = characters(hypotheses[i]);
+        std::vector<std::string> reference = characters(references[i]);
+        for (size_t order = 1; order <= maxOrder; ++order) {
+            addMatches(hypothesis, reference, order, matches[order - 1], hypothesisTotals[order - 1], referenceTotals[order - 1]);
+        }
+    }
+
+    // Precision and recall are averaged over the orders both sides are long enough for
+    double precision = 0.0;
+    double recall = 0.0;
+    size_t orders = 0;
+    for (size_t order = 0; order < maxOrder; ++order) {
+        if (hypothesisTotals[order] == 0.0 || referenceTotals[order] == 0.0) continue;
+        precision += matches[order] / hypothesisTotals[order];
+        recall += matches[order] / referenceTotals[order];
+        ++orders;
+    }
+    if (orders == 0 || precision + recall == 0.0) {
+        return 0.0;
+    }
+    precision /= orders;
+    recall /= orders;
+    return 100.0 * (1.0 + beta * beta) * precision * recall / (beta * beta * precision + recall);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Corpus level scores with the sacrebleu defaults evaluateModel.ipynb reports, on a 0 to 100 scale.
+// Tokenization is a simplified 13a: punctuation is split from words, nothing else is normalized.
+class TranslationMetrics {
+public:
+    // BLEU-4 with the brevity penalty and sacrebleu's "exp" smoothing for orders without matches
+    static double corpusBleu(const std::vector<std::string>& hypotheses, const std::vector<std::string>& references);
+
+    // chrF with character 6-grams and beta 2, whitespace is ignored
+    static double corpusChrf(const std::vector<std::string>& hypotheses, const std::vector<std::string>& references);
+
+protected:
+    static std::vector<std::string> words(const std::string& text);
+    static std::vector<std::string> characters(const std::string& text);
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <nlohmann/json.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "TranslationEngine.h"
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Wire format between the translators and TranslationDaemon. Every frame is a little endian
+// uint32 payload length followed by a JSON object with a "type" field:
+//   client -> daemon: ping, translate {segments}, shutdown
+//   daemon -> client: pong {model, decodingParams}, result {chapterNum, position, text, confidence} per segment as it finishes, done {count}, error {message}
+class TranslationProtocol {
+public:
+    // Frames larger than this are treated as a corrupt stream
+    static constexpr uint32_t maxFrameSize = 256 * 1024 * 1024;
+
+    // A daemon answers a ping right away unless it is busy with another client or hung
+    static constexpr std::chrono::milliseconds pingTimeout{3000};
+
+    static std::filesystem::path defaultSocketPath() {
+        return runtimeDirectory() / "BookTranslator.sock";
+    }
+
+    // A directory only the current user can use, so no other user can bind the socket first or
+    // talk to the daemon. $XDG_RUNTIME_DIR when the session has one, else BookTranslator-<uid> in
+    // the temp directory. The temp directory is already per user on Windows.
+    static std::filesystem::path runtimeDirectory() {
+#if defined(_WIN32)
+        return std::filesystem::temp_directory_path();
+#else
+        const char* xdgRuntimeDir = std::getenv("XDG_RUNTIME_DIR");
+        if (xdgRuntimeDir && *xdgRuntimeDir && std::filesystem::is_directory(xdgRuntimeDir)) {
+            return xdgRuntimeDir;
+        }
+
+        std::filesystem::path directory = std::filesystem::temp_directory_path() / ("BookTranslator-" + std::to_string(geteuid()));
+        if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+            throw std::runtime_error("Failed to create " + directory.string() + ": " + std::strerror(errno));
+        }
+
+        // The temp directory is shared, someone else may have created the directory first
+        struct stat info;
+        if (lstat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != geteuid()) {
+            throw std::runtime_error("Not a private directory of the current user: " + directory.string());
+        }
+        if ((info.st_mode & 077) != 0 && chmod(directory.c_str(), 0700) != 0) {
+            throw std::runtime_error("Failed to restrict " + directory.string() + ": " + std::strerror(errno));
+        }
+        return directory;
+#endif
+    }
+
+    template <typename Stream>
+    static void writeFrame(Stream& stream, const nlohmann::json& message) {
+        std::string payload = message.dump();
+        if (payload.size() > maxFrameSize) {
+            throw std::runtime_error("Translation frame too large: " + std::to_string(payload.size()) + " bytes");
+        }
+
+        uint32_t length = static_cast<uint32_t>(payload.size());
+        unsigned char header[4] = {
+            static_cast<unsigned char>(length & 0xFF),
+            static_cast<unsigned char>((length >> 8) & 0xFF),
+            static_cast<unsigned char>((length >> 16) & 0xFF),
+            static_cast<unsigned char>((length >> 24) & 0xFF)
+        };
+
+        std::vector<boost::asio::const_buffer> buffers = {boost::asio::buffer(header), boost::asio::buffer(payload)};
+        boost::asio::write(stream, buffers);
+    }
+
+    template <typename Stream>
+    static nlohmann::json readFrame(Stream& stream) {
+        unsigned char header[4];
+        boost::asio::read(stream, boost::asio::buffer(header));
+
+        uint32_t length = static_cast<uint32_t>(header[0]) | (static_cast<uint32_t>(header[1]) << 8) |
+            (static_cast<uint32_t>(header[2]) << 16) | (static_cast<uint32_t>(header[3]) << 24);
+        if (length > maxFrameSize) {
+            throw std::runtime_error("Translation frame too large: " + std::to_string(length) + " bytes");
+        }
+
+        std::string payload(length, '\0');
+        boost::asio::read(stream, boost::asio::buffer(payload));
+        return nlohmann::json::parse(payload);
+    }
+
+    // Like readFrame, but closes the socket and throws once timeout passed without a whole frame.
+    // Runs ioContext, which must be the socket's and have no other work.
+    template <typename Socket>
+    static nlohmann::json readFrame(Socket& socket, boost::asio::io_context& ioContext, std::chrono::milliseconds timeout) {
+        unsigned char header[4];
+        std::string payload;
+        boost::system::error_code result;
+        bool finished = false;
+        bool timedOut = false;
+
+        // The handlers run one after the other on this thread, a read that finished first wins
+        boost::asio::steady_timer timer(ioContext, timeout);
+        timer.async_wait([&](const boost::system::error_code& ec) {
+            if (ec || finished) return;
+            timedOut = true;
+            boost::system::error_code ignored;
+            socket.close(ignored);
+        });
+
+        boost::asio::async_read(socket, boost::asio::buffer(header), [&](const boost::system::error_code& ec, size_t) {
+            if (ec) {
+                result = ec;
+                finished = true;
+                timer.cancel();
+                return;
+            }
+            uint32_t length = static_cast<uint32_t>(header[0]) | (static_cast<uint32_t>(header[1]) << 8) |
+                (static_cast<uint32_t>(header[2]) << 16) | (static_cast<uint32_t>(header[3]) << 24);
+            if (length > maxFrameSize) {
+                result = boost::asio::error::message_size;
+                finished = true;
+                timer.cancel();
+                return;
+            }
+            payload.resize(length);
+            boost::asio::async_read(socket, boost::asio::buffer(payload), [&](const boost::system::error_code& ec, size_t) {
+                result = ec;
+                finished = true;
+                timer.cancel();
+            });
+        });
+
+        ioContext.restart();
+        ioContext.run();
+
+        if (timedOut) {
+            throw std::runtime_error("No reply within " + std::to_string(timeout.count()) + " ms");
+        }
+        if (result == boost::asio::error::message_size) {
+            throw std::runtime_error("Translation frame too large");
+        }
+        if (result) {
+            throw boost::system::system_error(result);
+        }
+        return nlohmann::json::parse(payload);
+    }
+
+    static nlohmann::json translateRequest(const std::vector<TranslationSegment>& segments) {
+        nlohmann::json jsonSegments = nlohmann::json::array();
+        for (const auto& segment : segments) {
+            jsonSegments.push_back({{"chapterNum", segment.chapterNum}, {"position", segment.position}, {"text", segment.text}});
+        }
+        return {{"type", "translate"}, {"segments", jsonSegments}};
+    }
+
+    static std::vector<TranslationSegment> segmentsFromRequest(const nlohmann::json& request) {
+        std::vector<TranslationSegment> segments;
+        for (const auto& jsonSegment : request.at("segments")) {
+            segments.push_back({jsonSegment.at("chapterNum").get<int>(), jsonSegment.at("position").get<int>(), jsonSegment.at("text").get<std::string>()});
+        }
+        return segments;
+    }
+
+    static nlohmann::json resultMessage(const TranslationResult& result) {
+        return {{"type", "result"}, {"chapterNum", result.chapterNum}, {"position", result.position}, {"text", result.text}, {"confidence", result.confidence}};
+    }
+
+    static TranslationResult resultFromMessage(const nlohmann::json& message) {
+        return {message.at("chapterNum").get<int>(), message.at("position").get<int>(), message.at("text").get<std::string>(), message.value("confidence", 0.0f)};
+    }
+};
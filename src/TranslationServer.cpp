@@ -0,0 +1,115 @@
+#include "TranslationServer.h"
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+#include <algorithm>
+
+TranslationServer::TranslationServer(std::shared_ptr<TranslationEngine> engine, const std::filesystem::path& socketPath, std::chrono::minutes idleTimeout)
+    : engine(std::move(engine)), socketPath(socketPath), idleTimeout(idleTimeout), acceptor(ioContext), idleTimer(ioContext) {
+
+    // A socket file left behind by a crashed daemon would make bind fail
+    std::error_code ec;
+    std::filesystem::remove(socketPath, ec);
+
+    boost::asio::local::stream_protocol::endpoint endpoint(socketPath.string());
+    acceptor.open(endpoint.protocol());
+    acceptor.bind(endpoint);
+    acceptor.listen();
+
+    std::cout << "Translation daemon listening on " << socketPath.string() << "\n";
+}
+
+TranslationServer::~TranslationServer() {
+    boost::system::error_code ec;
+    acceptor.close(ec);
+
+    std::error_code removeError;
+    std::filesystem::remove(socketPath, removeError);
+}
+
+void TranslationServer::run() {
+    acceptNext();
+    restartIdleTimer();
+    ioContext.run();
+    std::cout << "Translation daemon stopped." << "\n";
+}
+
+void TranslationServer::restartIdleTimer() {
+    if (idleTimeout.count() <= 0) return;
+
+    idleTimer.expires_after(idleTimeout);
+    idleTimer.async_wait([this](const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::operation_aborted) return;
+        std::cout << "No client for " << idleTimeout.count() << " minutes, shutting down." << "\n";
+        ioContext.stop();
+    });
+}
+
+void TranslationServer::acceptNext() {
+    acceptor.async_accept([this](const boost::system::error_code& ec, boost::asio::local::stream_protocol::socket socket) {
+        if (ec) {
+            if (ec != boost::asio::error::operation_aborted) {
+                std::cerr << "Error accepting translation client, Details: " << ec.message() << "\n";
+                acceptNext();
+            }
+            return;
+        }
+
+        idleTimer.cancel();
+        bool keepRunning = handleConnection(socket);
+        if (!keepRunning) {
+            ioContext.stop();
+            return;
+        }
+
+        restartIdleTimer();
+        acceptNext();
+    });
+}
+
+bool TranslationServer::handleConnection(boost::asio::local::stream_protocol::socket& socket) {
+    try {
+        while (true) {
+            nlohmann::json request = TranslationProtocol::readFrame(socket);
+            std::string type = request.value("type", "");
+
+            if (type == "ping") {
+                TranslationProtocol::writeFrame(socket, {{"type", "pong"}, {"model", engine->modelId()}, {"decodingParams", engine->decodingParams()}});
+            } else if (type == "translate") {
+                handleTranslate(socket, request);
+            } else if (type == "shutdown") {
+                return false;
+            } else {
+                TranslationProtocol::writeFrame(socket, {{"type", "error"}, {"message", "Unknown request type: " + type}});
+            }
+        }
+    } catch (const boost::system::system_error& e) {
+        // The client closing its end is how a connection normally ends
+        if (e.code() != boost::asio::error::eof) {
+            std::cerr << "Translation client disconnected, Details: " << e.what() << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error handling translation client, Details: " << e.what() << "\n";
+    }
+    return true;
+}
+
+void TranslationServer::handleTranslate(boost::asio::local::stream_protocol::socket& socket, const nlohmann::json& request) {
+    std::vector<TranslationSegment> segments = TranslationProtocol::segmentsFromRequest(request);
+
+    // Each result is written the moment the engine finishes its segment, so the client sees progress on long books
+    size_t count = 0;
+    try {
+        engine->translateStreaming(segments, [&](const TranslationResult& result) {
+            TranslationProtocol::writeFrame(socket, TranslationProtocol::resultMessage(result));
+            ++count;
+        });
+    } catch (const std::exception& e) {
+        TranslationProtocol::writeFrame(socket, {{"type", "error"}, {"message", e.what()}});
+        return;
+    }
+
+    TranslationProtocol::writeFrame(socket, {{"type", "done"}, {"count", count}});
+}
+
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include "TranslationEngine.h"
+#include "TranslationProtocol.h"
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+// Serves a warm TranslationEngine on a Unix domain socket so back to back books skip the model load.
+// Clients are handled one at a time, the engine serializes its work anyway.
+class TranslationServer {
+public:
+    TranslationServer(std::shared_ptr<TranslationEngine> engine, const std::filesystem::path& socketPath = TranslationProtocol::defaultSocketPath(), std::chrono::minutes idleTimeout = std::chrono::minutes(30));
+    ~TranslationServer();
+
+    // Blocks until a client sends shutdown or no client connected for idleTimeout (0 waits forever)
+    void run();
+
+protected:
+    void acceptNext();
+    void restartIdleTimer();
+    bool handleConnection(boost::asio::local::stream_protocol::socket& socket);
+    void handleTranslate(boost::asio::local::stream_protocol::socket& socket, const nlohmann::json& request);
+
+    std::shared_ptr<TranslationEngine> engine;
+    std::filesystem::path socketPath;
+    std::chrono::minutes idleTimeout;
+
+    boost::asio::io_context ioContext;
+    boost::asio::local::stream_protocol::acceptor acceptor;
+    boost::asio::steady_timer idleTimer;
+};
+
+#endif
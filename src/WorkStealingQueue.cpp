@@ -0,0 +1,56 @@
+#include "WorkStealingQueue.h"
+
+#include <algorithm>
+
+WorkStealingQueue::WorkStealingQueue(const std::vector<double>& costs, size_t workerCount)
+    : costs(costs), queues(std::max<size_t>(1, workerCount)), queued(queues.size(), 0.0) {
+
+    std::vector<size_t> order(costs.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&costs](size_t a, size_t b) {
+        return costs[a] > costs[b];
+    });
+
+    // Longest processing time first: every item goes to the least loaded worker, so each
+    // queue also runs from its most to its least expensive item
+    for (size_t item : order) {
+        size_t worker = std::min_element(queued.begin(), queued.end()) - queued.begin();
+        queues[worker].push_back(item);
+        queued[worker] += costs[item];
+    }
+}
+
+bool WorkStealingQueue::next(size_t worker, size_t& item, bool& stolen) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!queues[worker].empty()) {
+        item = queues[worker].front();
+        queues[worker].pop_front();
+        queued[worker] -= costs[item];
+        stolen = false;
+        return true;
+    }
+
+    // The victim keeps its expensive front items, the thief takes the cheap end of its queue
+    size_t victim = queues.size();
+    for (size_t i = 0; i < queues.size(); ++i) {
+        if (!queues[i].empty() && (victim == queues.size() || queued[i] > queued[victim])) {
+            victim = i;
+        }
+    }
+    if (victim == queues.size()) {
+        return false;
+    }
+    item = queues[victim].back();
+    queues[victim].pop_back();
+    queued[victim] -= costs[item];
+    stolen = true;
+    return true;
+}
+
+double WorkStealingQueue::queuedCost(size_t worker) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queued[worker];
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Hands the encoder batches of one generate call to the workers. Batches are dealt out longest
+// first to the worker with the least estimated work, and a worker whose own queue is empty
+// steals the cheapest batch of the worker that has the most work left, so no worker is left
+// with a long tail while the others idle.
+class WorkStealingQueue {
+public:
+    // costs holds the estimated cost of every item, items are identified by their index
+    WorkStealingQueue(const std::vector<double>& costs, size_t workerCount);
+
+    // Claims the next item of the worker, false once every item is claimed. stolen tells
+    // whether the item came from another worker's queue.
+    bool next(size_t worker, size_t& item, bool& stolen);
+
+    // Estimated cost of the items still queued for the worker
+    double queuedCost(size_t worker) const;
+
+protected:
+    std::vector<double> costs;
+    std::vector<std::deque<size_t>> queues;
+    std::vector<double> queued;
+    mutable std::mutex mutex;
+};
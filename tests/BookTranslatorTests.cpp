@@ -1,8 +1,12 @@
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch_test_macros.hpp>
 #include "BookTranslatorTests.h"
+#include <cmath>
 #include <filesystem>
+#include <functional>
+#include <random>
 #include <fstream>
+#include <set>
 
 // ------ EpubTranslator ------
 
@@ -1404,33 +1408,35 @@ TEST_CASE("PDFTranslator: Convert PDF to Images") {
 
 TEST_CASE("PDFTranslator: Create PDF") {
     TestablePDFTranslator translator;
-    std::string inputTextFile = std::filesystem::absolute("./input_text.txt").string();
     std::string imagesDir = std::filesystem::absolute("../test_files").string();
     std::string outputPdf = std::filesystem::absolute("./output.pdf").string();
+    std::string outputText = std::filesystem::absolute("./output_pdf_text.txt").string();
     // Ensure any pre-existing files are removed
-    if (std::filesystem::exists(inputTextFile)) {
-        std::filesystem::remove(inputTextFile);
-    }
     if (std::filesystem::exists(outputPdf)) {
         std::filesystem::remove(outputPdf);
     }
 
-    // Create test input text file
-    std::ofstream inputFile(inputTextFile);
-    REQUIRE(inputFile.is_open());
-    inputFile << "1,This is a test sentence." << std::endl;
-    inputFile << "2,Another sentence to test wrapping." << std::endl;
-    inputFile.close();
+    std::vector<TranslationResult> translations = {
+        {0, 1, "This is a test sentence."},
+        {0, 2, "Another sentence to test wrapping."},
+    };
 
     // Run PDF creation
-    REQUIRE_NOTHROW(translator.createPDF(outputPdf, inputTextFile, imagesDir));
+    REQUIRE_NOTHROW(translator.createPDF(outputPdf, translations, imagesDir));
 
-    // Ensure output PDF is created
+    // Ensure output PDF is created and holds the text
     REQUIRE(std::filesystem::exists(outputPdf));
+    REQUIRE_NOTHROW(translator.extractTextFromPDF(outputPdf, outputText));
+    std::ifstream extracted(outputText);
+    std::string text((std::istreambuf_iterator<char>(extracted)), std::istreambuf_iterator<char>());
+    extracted.close();
+    text = translator.removeWhitespace(text);
+    REQUIRE(text.find("Thisisatestsentence.") != std::string::npos);
+    REQUIRE(text.find("Anothersentencetotestwrapping.") != std::string::npos);
 
     // Clean up
-    REQUIRE(std::filesystem::remove(inputTextFile));
     REQUIRE(std::filesystem::remove(outputPdf));
+    REQUIRE(std::filesystem::remove(outputText));
 }
 
 TEST_CASE("PDFTranslator: isImageAboveThreshold") {
@@ -1845,15 +1851,13 @@ TEST_CASE("PDFTranslator: createPDF") {
             fakePng << "FAKE_PNG_DATA";
         }
 
-        // Also create a small text file
-        auto inputFile = std::filesystem::temp_directory_path() / "valid_text_input.txt";
-        {
-            std::ofstream txt(inputFile.string());
-            txt << "Some sample text line 1.\nLine 2.";
-        }
+        std::vector<TranslationResult> translations = {
+            {0, 1, "Some sample text line 1."},
+            {0, 2, "Line 2."},
+        };
 
         // Should not throw
-        REQUIRE_NOTHROW( translator.createPDF(outputPdf, inputFile.string(), imagesDir.string()));
+        REQUIRE_NOTHROW( translator.createPDF(outputPdf, translations, imagesDir.string()));
 
         // Confirm PDF is non-empty
         {
@@ -1862,36 +1866,42 @@ TEST_CASE("PDFTranslator: createPDF") {
             REQUIRE(ifs.tellg() > 0);
         }
 
+        // Confirm the text made it into the PDF
+        auto outputText = std::filesystem::temp_directory_path() / "test_createPDF.txt";
+        REQUIRE_NOTHROW(translator.extractTextFromPDF(outputPdf, outputText.string()));
+        std::ifstream extracted(outputText);
+        std::string text((std::istreambuf_iterator<char>(extracted)), std::istreambuf_iterator<char>());
+        extracted.close();
+        text = translator.removeWhitespace(text);
+        REQUIRE(text.find("Somesampletextline1.") != std::string::npos);
+        REQUIRE(text.find("Line2.") != std::string::npos);
+
         // Cleanup
         std::filesystem::remove(outputPdf);
-        std::filesystem::remove(inputFile);
+        std::filesystem::remove(outputText);
+        std::filesystem::remove_all(imagesDir);
     }
 
-    SECTION("Negative Test - Nonexistent Text Input")
+    SECTION("Positive Test - text only")
     {
-        const std::string outputPdf = "test_createPDF_noInput.pdf";
-        
-        // Valid images directory with a dummy file
-        auto imagesDir = std::filesystem::temp_directory_path() / "test_images_valid_3";
+        const std::string outputPdf = "test_createPDF_results.pdf";
+        auto imagesDir = std::filesystem::temp_directory_path() / "test_images_empty";
         std::filesystem::create_directories(imagesDir);
-        {
-            std::ofstream fakeJpg((imagesDir / "another.jpg").string(), std::ios::binary);
-            fakeJpg << "FAKE_JPG_DATA";
-        }
 
-        // Use a bad (nonexistent) input file path
-        auto badInput = (std::filesystem::temp_directory_path() / "does_not_exist.txt").string();
+        std::vector<TranslationResult> translations = {{0, 1, "A page without images."}};
+        REQUIRE_NOTHROW(translator.createPDF(outputPdf, translations, imagesDir.string()));
+        REQUIRE(std::filesystem::exists(outputPdf));
 
-        // Logs an error internally, does not throw
-        REQUIRE_NOTHROW(
-            translator.createPDF(outputPdf, badInput, imagesDir.string())
-        );
-
-        // Confirm PDF was not created
-        REQUIRE_FALSE(std::filesystem::exists(outputPdf));
+        auto outputText = std::filesystem::temp_directory_path() / "test_createPDF_results.txt";
+        REQUIRE_NOTHROW(translator.extractTextFromPDF(outputPdf, outputText.string()));
+        std::ifstream extracted(outputText);
+        std::string text((std::istreambuf_iterator<char>(extracted)), std::istreambuf_iterator<char>());
+        extracted.close();
+        REQUIRE(translator.removeWhitespace(text).find("Apagewithoutimages.") != std::string::npos);
 
-        // Cleanup
         std::filesystem::remove(outputPdf);
+        std::filesystem::remove(outputText);
+        std::filesystem::remove_all(imagesDir);
     }
 }
 
@@ -1979,63 +1989,6 @@ TEST_CASE("extractTextNodes: Extracts <w:t> nodes from DOCX XML", "[extractTextN
     xmlFreeDoc(doc);
 }
 
-TEST_CASE("saveTextToFile: Saves extracted text to files", "[saveTextToFile]") {
-    TestableDocxTranslator translator;
-
-    std::string langcode = "jpn";
-
-    std::vector<TextNode> nodes = {
-        {"path1", "Hello"},
-        {"path2", "World"}
-    };
-
-    translator.saveTextToFile(nodes, "test_positions.txt", "test_texts.txt", langcode);
-
-    std::ifstream posFile("test_positions.txt");
-    std::ifstream textFile("test_texts.txt");
-
-    std::string posLine, textLine;
-    std::getline(posFile, posLine);
-    std::getline(textFile, textLine);
-
-    REQUIRE(posLine == "1,path1");
-    REQUIRE(textLine == "1,>>jpn<< Hello");
-
-    std::getline(posFile, posLine);
-    std::getline(textFile, textLine);
-
-    REQUIRE(posLine == "2,path2");
-    REQUIRE(textLine == "2,>>jpn<< World");
-
-    posFile.close();
-    textFile.close();
-    std::filesystem::remove("test_positions.txt");
-    std::filesystem::remove("test_texts.txt");
-}
-
-TEST_CASE("loadTranslations: Loads translations from files", "[loadTranslations]") {
-    TestableDocxTranslator translator;
-
-    // Prepare test files
-    std::ofstream posFile("test_positions.txt");
-    std::ofstream textFile("test_translations.txt");
-
-    posFile << "1,/root/child\n2,/root/child/subchild\n";
-    textFile << "1,Hello\n2,World\n";
-
-    posFile.close();
-    textFile.close();
-
-    auto translations = translator.loadTranslations("test_positions.txt", "test_translations.txt");
-
-    REQUIRE(translations.size() == 2);
-    REQUIRE(translations.count("/root/child") == 1);
-    REQUIRE(translations.count("/root/child/subchild") == 1);
-
-    std::filesystem::remove("test_positions.txt");
-    std::filesystem::remove("test_translations.txt");
-}
-
 TEST_CASE("updateNodeWithTranslation: Replaces text content in XML nodes", "[updateNodeWithTranslation]") {
     TestableDocxTranslator translator;
 
@@ -2195,3 +2148,1401 @@ TEST_CASE("exportDocx: Creates DOCX file from directory", "[exportDocx]") {
     std::filesystem::remove_all(unzippedDir);
     std::filesystem::remove_all(outputDocxDir);
 }
+
+
+// ------ MarianTokenizer ------
+
+TEST_CASE("MarianTokenizer: splitLanguageCode separates the >>lang<< prefix", "[MarianTokenizer]") {
+    TestableMarianTokenizer tokenizer("../onnx-model-dir");
+
+    auto [code, body] = tokenizer.splitLanguageCode(">>jpn<< こんにちは");
+    REQUIRE(code == ">>jpn<<");
+    REQUIRE(body == " こんにちは");
+
+    auto [noCode, text] = tokenizer.splitLanguageCode("No language code");
+    REQUIRE(noCode.empty());
+    REQUIRE(text == "No language code");
+
+    auto [unclosed, unclosedText] = tokenizer.splitLanguageCode(">>jpn text");
+    REQUIRE(unclosed.empty());
+    REQUIRE(unclosedText == ">>jpn text");
+}
+
+TEST_CASE("MarianTokenizer: encode adds the language token and EOS", "[MarianTokenizer]") {
+    TestableMarianTokenizer tokenizer("../onnx-model-dir");
+
+    std::vector<int64_t> ids = tokenizer.encode(">>jpn<< 吾輩は猫である。");
+    REQUIRE(ids.size() > 2);
+    REQUIRE(ids.front() == tokenizer.tokenToId(">>jpn<<"));
+    REQUIRE(ids.back() == MARIAN_EOS_ID);
+
+    // Without a prefix only the SentencePiece tokens and EOS are produced
+    std::vector<int64_t> plain = tokenizer.encode("吾輩は猫である。");
+    REQUIRE(plain.size() == ids.size() - 1);
+    REQUIRE(std::equal(plain.begin(), plain.end(), ids.begin() + 1));
+}
+
+TEST_CASE("MarianTokenizer: encode truncates long segments", "[MarianTokenizer]") {
+    TestableMarianTokenizer tokenizer("../onnx-model-dir");
+
+    std::string longText;
+    for (int i = 0; i < 2000; ++i) {
+        longText += "猫 ";
+    }
+
+    std::vector<int64_t> ids = tokenizer.encode(">>jpn<< " + longText);
+    REQUIRE(ids.size() == MarianTokenizer::maxSourceTokens + 1);
+    REQUIRE(ids.back() == MARIAN_EOS_ID);
+}
+
+TEST_CASE("MarianTokenizer: batches match single segment calls", "[MarianTokenizer]") {
+    TestableMarianTokenizer tokenizer("../onnx-model-dir");
+
+    // Large enough to be split across threads
+    std::vector<std::string> texts;
+    for (int i = 0; i < 1000; ++i) {
+        texts.push_back(">>jpn<< 第" + std::to_string(i) + "章　猫と犬");
+    }
+
+    std::vector<std::vector<int64_t>> batch = tokenizer.encodeBatch(texts);
+    REQUIRE(batch.size() == texts.size());
+    for (size_t i = 0; i < texts.size(); i += 97) {
+        REQUIRE(batch[i] == tokenizer.encode(texts[i]));
+    }
+
+    std::vector<std::string> decoded = tokenizer.decodeBatch(batch);
+    REQUIRE(decoded.size() == texts.size());
+    for (size_t i = 0; i < texts.size(); i += 97) {
+        REQUIRE(decoded[i] == tokenizer.decode(batch[i]));
+    }
+}
+
+TEST_CASE("MarianTokenizer: decode skips special tokens", "[MarianTokenizer]") {
+    TestableMarianTokenizer tokenizer("../onnx-model-dir");
+
+    int64_t the = tokenizer.tokenToId("\u2581the");
+    int64_t cat = tokenizer.tokenToId("\u2581cat");
+    REQUIRE(the != MARIAN_UNK_ID);
+    REQUIRE(cat != MARIAN_UNK_ID);
+
+    REQUIRE(tokenizer.decode({MARIAN_PAD_ID, the, cat, MARIAN_EOS_ID, MARIAN_PAD_ID}) == "the cat");
+    REQUIRE(tokenizer.decode({MARIAN_PAD_ID, MARIAN_EOS_ID}).empty());
+    REQUIRE(tokenizer.decode({}).empty());
+}
+
+TEST_CASE("MarianTokenizer: stripWhitespace trims both ends", "[MarianTokenizer]") {
+    TestableMarianTokenizer tokenizer("../onnx-model-dir");
+
+    REQUIRE(tokenizer.stripWhitespace("  Hello world \n") == "Hello world");
+    REQUIRE(tokenizer.stripWhitespace(" \t\r\n").empty());
+}
+
+// ------ OnnxTranslationEngine ------
+
+TEST_CASE("OnnxTranslationEngine: createBatches groups segments of similar length", "[OnnxTranslationEngine]") {
+    std::vector<std::vector<int64_t>> sourceIds;
+    for (size_t length : {30, 3, 12, 4, 29, 11, 5, 31}) {
+        sourceIds.push_back(std::vector<int64_t>(length, 7));
+    }
+
+    BatchingParams batching;
+    batching.batchSize = 3;
+    batching.maxBatchTokens = 1000;
+
+    std::vector<std::vector<size_t>> batches = TestableOnnxTranslationEngine::createBatches(sourceIds, batching);
+    REQUIRE(batches.size() == 3);
+    REQUIRE(batches[0] == std::vector<size_t>{1, 3, 6});
+    REQUIRE(batches[1] == std::vector<size_t>{5, 2, 4});
+    REQUIRE(batches[2] == std::vector<size_t>{0, 7});
+}
+
+TEST_CASE("OnnxTranslationEngine: createBatches respects the token budget", "[OnnxTranslationEngine]") {
+    std::vector<std::vector<int64_t>> sourceIds;
+    for (size_t length : {10, 10, 10, 10, 100}) {
+        sourceIds.push_back(std::vector<int64_t>(length, 7));
+    }
+
+    BatchingParams batching;
+    batching.batchSize = 16;
+    batching.maxBatchTokens = 30;
+
+    std::vector<std::vector<size_t>> batches = TestableOnnxTranslationEngine::createBatches(sourceIds, batching);
+
+    // Every segment is in exactly one batch, even the one longer than the budget on its own
+    std::vector<size_t> seen;
+    for (const auto& batch : batches) {
+        size_t longest = 0;
+        for (size_t index : batch) {
+            longest = std::max(longest, sourceIds[index].size());
+            seen.push_back(index);
+        }
+        REQUIRE((batch.size() == 1 || longest * batch.size() <= batching.maxBatchTokens));
+    }
+    std::sort(seen.begin(), seen.end());
+    REQUIRE(seen == std::vector<size_t>{0, 1, 2, 3, 4});
+    REQUIRE(batches.back() == std::vector<size_t>{4});
+}
+
+TEST_CASE("OnnxTranslationEngine: resolveGraphDir only uses a quantized model that passed its gate", "[OnnxTranslationEngine]") {
+    std::filesystem::path modelDir = "test_quantization_model";
+    std::filesystem::create_directories(modelDir / "int8");
+
+    QuantizationParams quantization;
+    REQUIRE(TestableOnnxTranslationEngine::resolveGraphDir(modelDir, quantization) == modelDir);
+
+    // Without a gate file the variant is never used
+    quantization.variant = "int8";
+    REQUIRE(TestableOnnxTranslationEngine::resolveGraphDir(modelDir, quantization) == modelDir);
+
+    std::ofstream(modelDir / "int8" / "quantization_gate.json") << R"({"baseline_bleu": 20.0, "quantized_bleu": 19.5, "passed": true})";
+    REQUIRE(TestableOnnxTranslationEngine::resolveGraphDir(modelDir, quantization) == modelDir / "int8");
+
+    // A tighter margin in translationConfig.json disables it again
+    quantization.maxBleuDrop = 0.25f;
+    REQUIRE(TestableOnnxTranslationEngine::resolveGraphDir(modelDir, quantization) == modelDir);
+
+    std::ofstream(modelDir / "int8" / "quantization_gate.json") << R"({"baseline_bleu": 20.0, "quantized_bleu": 19.9, "passed": false})";
+    REQUIRE(TestableOnnxTranslationEngine::resolveGraphDir(modelDir, quantization) == modelDir);
+
+    std::filesystem::remove_all(modelDir);
+}
+
+TEST_CASE("OnnxTranslationEngine: truncateDecoderCache drops rejected draft positions", "[OnnxTranslationEngine]") {
+    // Two heads of three positions with a head size of 2, stored as [rows, heads, length, headSize]
+    DecodeCohort cohort;
+    cohort.pastKeyValues["past_key_values.0.decoder.key"] = {{0, 1, 2, 3, 4, 5, 10, 11, 12, 13, 14, 15}, {1, 2, 3, 2}};
+    cohort.pastKeyValues["past_key_values.0.encoder.key"] = {{0, 1, 2, 3, 4, 5, 10, 11, 12, 13, 14, 15}, {1, 2, 3, 2}};
+
+    TestableOnnxTranslationEngine::truncateDecoderCache(cohort, 2);
+
+    const CacheTensor& decoderCache = cohort.pastKeyValues["past_key_values.0.decoder.key"];
+    REQUIRE(decoderCache.shape == std::vector<int64_t>{1, 2, 2, 2});
+    REQUIRE(decoderCache.data == std::vector<float>{0, 1, 2, 3, 10, 11, 12, 13});
+
+    // The cross attention cache covers the source and never shrinks
+    REQUIRE(cohort.pastKeyValues["past_key_values.0.encoder.key"].shape[2] == 3);
+}
+
+TEST_CASE("OnnxTranslationEngine: outputBudget follows the source length", "[OnnxTranslationEngine]") {
+    LengthBudgetParams lengthBudget;
+    lengthBudget.ratio = 1.5f;
+    lengthBudget.slack = 4;
+
+    REQUIRE(TestableOnnxTranslationEngine::outputBudget(4, lengthBudget, 512) == 10);
+    REQUIRE(TestableOnnxTranslationEngine::outputBudget(5, lengthBudget, 512) == 12);
+
+    // The global max_new_tokens still caps long segments
+    REQUIRE(TestableOnnxTranslationEngine::outputBudget(500, lengthBudget, 511) == 511);
+
+    lengthBudget.enabled = false;
+    REQUIRE(TestableOnnxTranslationEngine::outputBudget(4, lengthBudget, 511) == 511);
+}
+
+TEST_CASE("OnnxTranslationEngine: batchCost adds the source tokens and output budgets", "[OnnxTranslationEngine]") {
+    LengthBudgetParams lengthBudget;
+    lengthBudget.ratio = 2.0f;
+    lengthBudget.slack = 0;
+    std::vector<std::vector<int64_t>> sourceIds = {{1, 2, 0}, {1, 0}, {1, 2, 3, 4, 0}};
+
+    REQUIRE(TestableOnnxTranslationEngine::batchCost({0, 1}, sourceIds, lengthBudget, 512) == 9.0 + 6.0);
+    REQUIRE(TestableOnnxTranslationEngine::batchCost({2}, sourceIds, lengthBudget, 512) == 15.0);
+    REQUIRE(TestableOnnxTranslationEngine::batchCost({}, sourceIds, lengthBudget, 512) == 0.0);
+}
+
+TEST_CASE("OnnxTranslationEngine: gatherRows and compactRows keep the buffer", "[OnnxTranslationEngine]") {
+    std::vector<float> source = {0, 0, 1, 1, 2, 2, 3, 3};
+
+    // Beams can be gathered in any order and repeated
+    std::vector<float> gathered;
+    gathered.reserve(source.size());
+    const float* storage = gathered.data();
+    TestableOnnxTranslationEngine::gatherRows(source.data(), 2, {3, 1, 1}, gathered);
+    REQUIRE(gathered == std::vector<float>{3, 3, 1, 1, 1, 1});
+    REQUIRE(gathered.data() == storage);
+
+    // Pruning keeps the remaining rows in place
+    std::vector<int64_t> mask = {1, 1, 0, 1, 0, 0, 1, 0, 1, 1, 1, 1};
+    const int64_t* maskStorage = mask.data();
+    TestableOnnxTranslationEngine::compactRows(mask, 3, {1, 3});
+    REQUIRE(mask == std::vector<int64_t>{1, 0, 0, 1, 1, 1});
+    REQUIRE(mask.data() == maskStorage);
+}
+
+TEST_CASE("OnnxTranslationEngine: splitEncoderCores gives the encoder the last cores", "[OnnxTranslationEngine]") {
+    std::vector<int> cores = {0, 1, 2, 3};
+    REQUIRE(TestableOnnxTranslationEngine::splitEncoderCores(cores, 1) == std::vector<int>{3});
+    REQUIRE(cores == std::vector<int>{0, 1, 2});
+
+    // Without a count, or with too few cores to split, both stages share them
+    REQUIRE(TestableOnnxTranslationEngine::splitEncoderCores(cores, 0) == std::vector<int>{0, 1, 2});
+    REQUIRE(TestableOnnxTranslationEngine::splitEncoderCores(cores, 3) == std::vector<int>{0, 1, 2});
+    REQUIRE(cores == std::vector<int>{0, 1, 2});
+}
+
+// ------ DecodeScheduler ------
+
+TEST_CASE("DecodeScheduler: refill fills free slots in FIFO order", "[DecodeScheduler]") {
+    DecodeScheduler scheduler(3);
+    for (size_t segment = 0; segment < 5; ++segment) {
+        scheduler.enqueue(segment);
+    }
+
+    auto assigned = scheduler.refill();
+    REQUIRE(assigned == std::vector<std::pair<size_t, size_t>>{{0, 0}, {1, 1}, {2, 2}});
+    REQUIRE(scheduler.freeSlotCount() == 0);
+    REQUIRE(scheduler.pendingCount() == 2);
+    REQUIRE(scheduler.refill().empty());
+
+    // A released slot is refilled with the next pending segment while the others keep decoding
+    scheduler.release(1);
+    REQUIRE(scheduler.activeSlots() == std::vector<size_t>{0, 2});
+    assigned = scheduler.refill();
+    REQUIRE(assigned == std::vector<std::pair<size_t, size_t>>{{1, 3}});
+    REQUIRE(scheduler.segmentInSlot(1) == 3);
+    REQUIRE(scheduler.activeSlots() == std::vector<size_t>{0, 1, 2});
+}
+
+TEST_CASE("DecodeScheduler: becomes idle once every segment is released", "[DecodeScheduler]") {
+    DecodeScheduler scheduler(2);
+    scheduler.enqueue(7);
+    REQUIRE_FALSE(scheduler.idle());
+
+    scheduler.refill();
+    REQUIRE(scheduler.activeSlots() == std::vector<size_t>{0});
+    REQUIRE(scheduler.freeSlotCount() == 1);
+
+    scheduler.release(0);
+    REQUIRE(scheduler.idle());
+    REQUIRE_THROWS_AS(scheduler.release(0), std::logic_error);
+}
+
+TEST_CASE("DecodeScheduler: slotsForMemory adapts to the memory budget", "[DecodeScheduler]") {
+    REQUIRE(DecodeScheduler::slotsForMemory(1000, 100, 16) == 10);
+    REQUIRE(DecodeScheduler::slotsForMemory(100000, 100, 16) == 16);
+    REQUIRE(DecodeScheduler::slotsForMemory(50, 100, 16) == 1);
+
+    // Unknown memory falls back to the configured maximum
+    REQUIRE(DecodeScheduler::slotsForMemory(0, 100, 16) == 16);
+}
+
+// ------ TranslationDaemon ------
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+TEST_CASE("TranslationProtocol: frames round trip over a socket pair", "[TranslationDaemon]") {
+    boost::asio::io_context ioContext;
+    boost::asio::local::stream_protocol::socket client(ioContext);
+    boost::asio::local::stream_protocol::socket server(ioContext);
+    boost::asio::local::connect_pair(client, server);
+
+    std::vector<TranslationSegment> segments = {{1, 2, ">>jpn<< 猫"}, {3, 4, ">>jpn<< 犬"}};
+    TranslationProtocol::writeFrame(client, TranslationProtocol::translateRequest(segments));
+
+    nlohmann::json request = TranslationProtocol::readFrame(server);
+    REQUIRE(request["type"] == "translate");
+
+    std::vector<TranslationSegment> received = TranslationProtocol::segmentsFromRequest(request);
+    REQUIRE(received.size() == 2);
+    REQUIRE(received[1].chapterNum == 3);
+    REQUIRE(received[1].position == 4);
+    REQUIRE(received[1].text == ">>jpn<< 犬");
+}
+
+TEST_CASE("TranslationProtocol: results carry their confidence", "[TranslationDaemon]") {
+    TranslationResult result = TranslationProtocol::resultFromMessage(TranslationProtocol::resultMessage({2, 5, "Cat.", -0.25f}));
+    REQUIRE(result.chapterNum == 2);
+    REQUIRE(result.position == 5);
+    REQUIRE(result.text == "Cat.");
+    REQUIRE(result.confidence == -0.25f);
+
+    // Daemons from before the confidence field report 0
+    REQUIRE(TranslationProtocol::resultFromMessage({{"type", "result"}, {"chapterNum", 1}, {"position", 1}, {"text", "Dog."}}).confidence == 0.0f);
+}
+
+TEST_CASE("TranslationProtocol: a frame that doesn't arrive times out", "[TranslationDaemon]") {
+    boost::asio::io_context ioContext;
+    boost::asio::local::stream_protocol::socket client(ioContext);
+    boost::asio::local::stream_protocol::socket server(ioContext);
+    boost::asio::local::connect_pair(client, server);
+
+    TranslationProtocol::writeFrame(server, {{"type", "pong"}});
+    REQUIRE(TranslationProtocol::readFrame(client, ioContext, std::chrono::milliseconds(1000))["type"] == "pong");
+
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE_THROWS_AS(TranslationProtocol::readFrame(client, ioContext, std::chrono::milliseconds(100)), std::runtime_error);
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+}
+
+#if !defined(_WIN32)
+TEST_CASE("TranslationProtocol: the socket lives in a directory of the current user", "[TranslationDaemon]") {
+    // Without a session runtime directory the socket goes to a private directory in the temp directory
+    const char* xdgRuntimeDir = std::getenv("XDG_RUNTIME_DIR");
+    std::string savedRuntimeDir = xdgRuntimeDir ? xdgRuntimeDir : "";
+    unsetenv("XDG_RUNTIME_DIR");
+    std::filesystem::path socketPath = TranslationProtocol::defaultSocketPath();
+    if (xdgRuntimeDir) {
+        setenv("XDG_RUNTIME_DIR", savedRuntimeDir.c_str(), 1);
+    }
+
+    REQUIRE(socketPath.parent_path() != std::filesystem::temp_directory_path());
+    struct stat info;
+    REQUIRE(stat(socketPath.parent_path().c_str(), &info) == 0);
+    REQUIRE(info.st_uid == geteuid());
+    REQUIRE((info.st_mode & 077) == 0);
+}
+#endif
+
+TEST_CASE("DaemonTranslationEngine: a daemon that doesn't answer isn't running", "[TranslationDaemon]") {
+    std::filesystem::path socketPath = std::filesystem::temp_directory_path() / "BookTranslatorHungTest.sock";
+    std::filesystem::remove(socketPath);
+
+    // Accepts connections but never reads them, like a hung daemon
+    boost::asio::io_context ioContext;
+    boost::asio::local::stream_protocol::acceptor acceptor(ioContext, boost::asio::local::stream_protocol::endpoint(socketPath.string()));
+
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE_FALSE(DaemonTranslationEngine::isRunning(socketPath, std::chrono::milliseconds(100)));
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    REQUIRE(DaemonTranslationEngine::isListening(socketPath));
+
+    acceptor.close();
+    std::filesystem::remove(socketPath);
+    REQUIRE_FALSE(DaemonTranslationEngine::isListening(socketPath));
+}
+
+TEST_CASE("TranslationServer: serves translations to DaemonTranslationEngine", "[TranslationDaemon]") {
+    std::filesystem::path socketPath = std::filesystem::temp_directory_path() / "BookTranslatorTest.sock";
+    auto engine = std::make_shared<FakeTranslationEngine>();
+
+    REQUIRE_FALSE(DaemonTranslationEngine::isRunning(socketPath));
+
+    TranslationServer server(engine, socketPath);
+    std::thread serverThread([&server]() { server.run(); });
+
+    REQUIRE(DaemonTranslationEngine::isRunning(socketPath));
+
+    DaemonTranslationEngine client(socketPath);
+    std::vector<TranslationSegment> segments = {{0, 1, "one"}, {0, 2, "two"}, {1, 1, "three"}};
+    std::vector<std::string> streamed;
+    std::vector<TranslationResult> results = client.translateStreaming(segments, [&](const TranslationResult& result) { streamed.push_back(result.text); });
+
+    // The results stream in the order the engine finished them and are returned in input order
+    REQUIRE(streamed == std::vector<std::string>{"THREE", "TWO", "ONE"});
+    REQUIRE(results.size() == 3);
+    REQUIRE(results[0].text == "ONE");
+    REQUIRE(results[2].chapterNum == 1);
+    REQUIRE(results[2].text == "THREE");
+
+    // The second book reuses the same warm engine
+    REQUIRE(client.translate({{0, 1, "again"}}).front().text == "AGAIN");
+    REQUIRE(engine->calls == 2);
+
+    DaemonTranslationEngine::shutdown(socketPath);
+    serverThread.join();
+}
+
+#endif
+
+// ------ BeamSearch ------
+
+// Feeds one step of log probabilities that depend on each beam's tokens
+static std::vector<size_t> advanceWith(BeamSearch& search, int64_t vocabSize, const std::function<std::vector<float>(const std::vector<int64_t>&)>& distribution) {
+    std::vector<float> logits;
+    for (size_t beam = 0; beam < search.beamCount(); ++beam) {
+        std::vector<float> probabilities = distribution(search.beam(beam));
+        for (int64_t token = 0; token < vocabSize; ++token) {
+            logits.push_back(std::log(probabilities[token]));
+        }
+    }
+    return search.advance(logits.data());
+}
+
+static GenerationParams plainParams(int numBeams) {
+    GenerationParams params;
+    params.numBeams = numBeams;
+    params.noRepeatNgramSize = 0;
+    params.repetitionPenalty = 1.0f;
+    params.maxNewTokens = 10;
+    return params;
+}
+
+// Token 2 looks best at the first step but token 3 leads to the more likely sentence
+static std::vector<float> gardenPath(const std::vector<int64_t>& tokens) {
+    if (tokens.size() == 1) return {0.001f, 0.001f, 0.598f, 0.4f};
+    if (tokens.back() == 3) return {0.9f, 0.001f, 0.049f, 0.05f};
+    return {0.2f, 0.001f, 0.4f, 0.399f};
+}
+
+TEST_CASE("BeamSearch: a single beam decodes greedily", "[BeamSearch]") {
+    BeamSearch search(plainParams(1), 4);
+    search.start();
+
+    advanceWith(search, 4, gardenPath);
+    REQUIRE(search.beam(0) == std::vector<int64_t>{MARIAN_PAD_ID, 2});
+    REQUIRE_FALSE(search.isDone());
+}
+
+TEST_CASE("BeamSearch: beams find the more likely sentence", "[BeamSearch]") {
+    BeamSearch search(plainParams(2), 4);
+    search.start();
+
+    std::vector<size_t> sources = advanceWith(search, 4, gardenPath);
+    REQUIRE(sources == std::vector<size_t>{0, 0});
+    REQUIRE(search.beam(0).back() == 2);
+    REQUIRE(search.beam(1).back() == 3);
+
+    for (int step = 0; step < 5 && !search.isDone(); ++step) {
+        advanceWith(search, 4, gardenPath);
+    }
+
+    REQUIRE(search.isDone());
+    REQUIRE(search.best() == std::vector<int64_t>{MARIAN_PAD_ID, 3, MARIAN_EOS_ID});
+}
+
+TEST_CASE("BeamSearch: bestScore averages the log probabilities of the best output", "[BeamSearch]") {
+    BeamSearch greedy(plainParams(1), 4);
+    greedy.start();
+    REQUIRE(greedy.bestScore() == 0.0f);
+
+    // A running beam is scored by the tokens it has so far
+    advanceWith(greedy, 4, gardenPath);
+    REQUIRE(std::abs(greedy.bestScore() - std::log(0.598f)) < 1e-5f);
+
+    BeamSearch beams(plainParams(2), 4);
+    beams.start();
+    while (!beams.isDone()) {
+        advanceWith(beams, 4, gardenPath);
+    }
+    REQUIRE(std::abs(beams.bestScore() - (std::log(0.4f) + std::log(0.9f)) / 2.0f) < 1e-5f);
+}
+
+TEST_CASE("BeamSearch: the length limit forces EOS", "[BeamSearch]") {
+    GenerationParams params = plainParams(2);
+    params.maxNewTokens = 2;
+    BeamSearch search(params, 4);
+    search.start();
+
+    auto neverEnds = [](const std::vector<int64_t>&) { return std::vector<float>{0.0001f, 0.0001f, 0.5f, 0.4998f}; };
+    advanceWith(search, 4, neverEnds);
+    REQUIRE_FALSE(search.isDone());
+    advanceWith(search, 4, neverEnds);
+    REQUIRE(search.isDone());
+
+    std::vector<int64_t> best = search.best();
+    REQUIRE(best.size() == 3);
+    REQUIRE(best.back() == MARIAN_EOS_ID);
+}
+
+TEST_CASE("BeamSearch: applyNoRepeatNgram bans repeated trigrams", "[BeamSearch]") {
+    GenerationParams params = plainParams(1);
+    params.noRepeatNgramSize = 3;
+    TestableBeamSearch search(params, 8);
+
+    std::vector<float> scores(8, 0.0f);
+    search.applyNoRepeatNgram(scores.data(), {MARIAN_PAD_ID, 4, 5, 6, 4, 5});
+    REQUIRE(std::isinf(scores[6]));
+    REQUIRE(scores[7] == 0.0f);
+}
+
+TEST_CASE("BeamSearch: applyRepetitionPenalty scales seen tokens", "[BeamSearch]") {
+    GenerationParams params = plainParams(1);
+    params.repetitionPenalty = 0.5f;
+    TestableBeamSearch search(params, 4);
+
+    std::vector<float> scores = {-2.0f, 1.0f, -1.0f, -1.0f};
+    search.applyRepetitionPenalty(scores.data(), {0, 1});
+    REQUIRE(scores[0] == -1.0f);
+    REQUIRE(scores[1] == 2.0f);
+    REQUIRE(scores[2] == -1.0f);
+}
+
+TEST_CASE("BeamSearch: the SIMD kernels pick the same hypotheses as the scalar reference", "[BeamSearch]") {
+    // The Marian vocabulary ends in a partial vector, a few favoured tokens make n-grams repeat
+    const int64_t vocabSize = MARIAN_PAD_ID + 1;
+    GenerationParams params;
+    params.numBeams = 4;
+    params.noRepeatNgramSize = 3;
+    params.repetitionPenalty = 1.3f;
+    params.maxNewTokens = 40;
+
+    TestableBeamSearch fast(params, vocabSize);
+    TestableBeamSearch reference(params, vocabSize);
+    reference.useReference();
+    fast.start();
+    reference.start();
+
+    std::mt19937 random(7);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    while (!reference.isDone()) {
+        std::vector<float> logits(params.numBeams * vocabSize);
+        for (size_t i = 0; i < logits.size(); ++i) {
+            int64_t token = static_cast<int64_t>(i % vocabSize);
+            logits[i] = noise(random) + (token >= 2 && token < 8 ? 6.0f : 0.0f) - (token == MARIAN_EOS_ID ? 8.0f : 0.0f);
+        }
+        std::vector<float> referenceLogits = logits;
+
+        REQUIRE(fast.advance(logits.data()) == reference.advance(referenceLogits.data()));
+        REQUIRE(logits == referenceLogits);
+        REQUIRE(fast.isDone() == reference.isDone());
+        for (size_t beam = 0; beam < reference.beamCount(); ++beam) {
+            REQUIRE(fast.beam(beam) == reference.beam(beam));
+        }
+    }
+    REQUIRE(fast.best() == reference.best());
+    REQUIRE(fast.bestScore() == reference.bestScore());
+}
+
+// ------ GraphCache ------
+
+TEST_CASE("Hashing: fnv1a64 matches the reference values", "[GraphCache]") {
+    REQUIRE(Hashing::fnv1a64("") == 0xcbf29ce484222325ULL);
+    REQUIRE(Hashing::fnv1a64("a") == 0xaf63dc4c8601ec8cULL);
+    REQUIRE(Hashing::toHex(0xaf63dc4c8601ec8cULL) == "af63dc4c8601ec8c");
+}
+
+TEST_CASE("GraphCache: cacheKey follows the model contents", "[GraphCache]") {
+    std::filesystem::path cacheDir = "test_graph_cache";
+    std::filesystem::path modelPath = "test_graph_cache_model.onnx";
+    std::filesystem::remove_all(cacheDir);
+
+    std::ofstream(modelPath, std::ios::binary) << "first model";
+    GraphCache cache(cacheDir);
+    std::string firstKey = cache.cacheKey(modelPath);
+
+    REQUIRE(firstKey.rfind(Hashing::toHex(Hashing::fnv1a64("first model")), 0) == 0);
+    REQUIRE(firstKey.find(CpuFeatures::featureString()) != std::string::npos);
+    REQUIRE(cache.cacheKey(modelPath) == firstKey);
+    REQUIRE(cache.cachedGraphPath(modelPath) == cacheDir / firstKey / "test_graph_cache_model.ort");
+
+    // A re-exported model gets a new entry instead of the stale graph
+    std::ofstream(modelPath, std::ios::binary) << "second, longer model";
+    REQUIRE(cache.cacheKey(modelPath) != firstKey);
+
+    std::filesystem::remove(modelPath);
+    std::filesystem::remove_all(cacheDir);
+}
+
+// ------ CpuTopology ------
+
+TEST_CASE("CpuTopology: autoLayout fills in the values left at 0", "[CpuTopology]") {
+    size_t sessionCount = 0;
+    size_t threadsPerSession = 0;
+    CpuTopology::autoLayout(32, sessionCount, threadsPerSession);
+    REQUIRE(sessionCount == 8);
+    REQUIRE(threadsPerSession == 4);
+
+    sessionCount = 0;
+    threadsPerSession = 0;
+    CpuTopology::autoLayout(2, sessionCount, threadsPerSession);
+    REQUIRE(sessionCount == 1);
+    REQUIRE(threadsPerSession == 2);
+
+    // A configured value is kept and the other one spreads over the remaining cores
+    sessionCount = 2;
+    threadsPerSession = 0;
+    CpuTopology::autoLayout(16, sessionCount, threadsPerSession);
+    REQUIRE(sessionCount == 2);
+    REQUIRE(threadsPerSession == 8);
+
+    sessionCount = 0;
+    threadsPerSession = 6;
+    CpuTopology::autoLayout(16, sessionCount, threadsPerSession);
+    REQUIRE(sessionCount == 2);
+    REQUIRE(threadsPerSession == 6);
+}
+
+TEST_CASE("CpuTopology: partition hands out disjoint core sets", "[CpuTopology]") {
+    std::vector<int> cores = {0, 2, 4, 6, 8, 10, 12, 14};
+    std::vector<std::vector<int>> sets = CpuTopology::partition(cores, 2, 4);
+    REQUIRE(sets == std::vector<std::vector<int>>{{0, 2, 4, 6}, {8, 10, 12, 14}});
+
+    // Oversubscribing wraps around instead of leaving a session without cores
+    sets = CpuTopology::partition({0, 1}, 3, 1);
+    REQUIRE(sets == std::vector<std::vector<int>>{{0}, {1}, {0}});
+}
+
+TEST_CASE("OnnxTranslationEngine: sessionCores resolves the configured layout", "[CpuTopology]") {
+    SessionPoolParams sessionPool;
+    std::vector<std::vector<int>> sets = TestableOnnxTranslationEngine::sessionCores({0, 1, 2, 3, 4, 5, 6, 7}, sessionPool);
+    REQUIRE(sessionPool.count == 2);
+    REQUIRE(sessionPool.threadsPerSession == 4);
+    REQUIRE(sets.size() == 2);
+    REQUIRE(sets[1] == std::vector<int>{4, 5, 6, 7});
+
+    REQUIRE_FALSE(CpuTopology::physicalCores().empty());
+}
+
+// ------ LexicalShortlist ------
+
+TEST_CASE("LexicalShortlist: candidates merge the table entries of every source", "[LexicalShortlist]") {
+    std::filesystem::path tablePath = "test_lexical_shortlist.bin";
+    {
+        // Same layout buildShortlist.py writes: magic, version, frequent ids, then per source token its targets
+        std::ofstream file(tablePath, std::ios::binary);
+        auto write = [&file](auto value) { file.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+        file.write("LXSL", 4);
+        write(uint32_t(1));
+        write(uint32_t(2));
+        write(int32_t(5));
+        write(int32_t(9));
+        write(uint32_t(2));
+        write(int32_t(100));
+        write(uint32_t(2));
+        write(int32_t(7));
+        write(int32_t(9));
+        write(int32_t(200));
+        write(uint32_t(1));
+        write(int32_t(3));
+    }
+
+    LexicalShortlist shortlist(tablePath);
+    std::vector<int64_t> first = {100, 42};
+    std::vector<int64_t> second = {200};
+    REQUIRE(shortlist.candidates({&first}) == std::vector<int64_t>{MARIAN_EOS_ID, 5, 7, 9});
+    REQUIRE(shortlist.candidates({&first, &second}) == std::vector<int64_t>{MARIAN_EOS_ID, 3, 5, 7, 9});
+
+    std::filesystem::remove(tablePath);
+    REQUIRE_THROWS_AS(LexicalShortlist(tablePath), std::runtime_error);
+}
+
+TEST_CASE("OutputProjection: candidate logits match the full projection", "[LexicalShortlist]") {
+    // Four tokens over a hidden size of 10, so the dot product also runs the tail loop
+    const int64_t hiddenSize = 10;
+    std::vector<float> weights(4 * hiddenSize);
+    for (size_t i = 0; i < weights.size(); ++i) {
+        weights[i] = static_cast<float>(i % 7) - 3.0f;
+    }
+    OutputProjection projection(weights, {0.5f, -1.0f, 0.0f, 2.0f}, hiddenSize);
+
+    std::vector<float> hidden(2 * hiddenSize);
+    for (size_t i = 0; i < hidden.size(); ++i) {
+        hidden[i] = 0.1f * static_cast<float>(i);
+    }
+
+    std::vector<float> full(2 * 4);
+    projection.project(hidden.data(), 2, {}, full.data());
+    std::vector<float> shortlisted(2 * 4);
+    projection.project(hidden.data(), 2, {1, 3}, shortlisted.data());
+
+    for (size_t row = 0; row < 2; ++row) {
+        REQUIRE(std::isinf(shortlisted[row * 4 + 0]));
+        REQUIRE(std::isinf(shortlisted[row * 4 + 2]));
+        REQUIRE(shortlisted[row * 4 + 1] == full[row * 4 + 1]);
+        REQUIRE(shortlisted[row * 4 + 3] == full[row * 4 + 3]);
+
+        float expected = 2.0f;
+        for (int64_t k = 0; k < hiddenSize; ++k) {
+            expected += hidden[row * hiddenSize + k] * weights[3 * hiddenSize + k];
+        }
+        REQUIRE(std::abs(full[row * 4 + 3] - expected) < 1e-4f);
+    }
+}
+
+// ------ DegenerationDetector ------
+
+TEST_CASE("DegenerationDetector: catches a repeated tail pattern", "[DegenerationDetector]") {
+    DegenerationParams params;
+    params.window = 0;
+    DegenerationDetector detector(params);
+
+    // Period 2 repeated three times at the end
+    REQUIRE(detector.isDegenerate({MARIAN_PAD_ID, 7, 8, 5, 6, 5, 6, 5, 6}));
+    REQUIRE_FALSE(detector.isDegenerate({MARIAN_PAD_ID, 7, 8, 5, 6, 5, 6}));
+
+    // The loop has to reach the newest token
+    REQUIRE_FALSE(detector.isDegenerate({MARIAN_PAD_ID, 5, 5, 5, 9, 10}));
+    REQUIRE(detector.isDegenerate({MARIAN_PAD_ID, 9, 10, 4, 4, 4}));
+
+    // The start token never counts towards a loop
+    REQUIRE_FALSE(detector.isDegenerate({4, 4, 4}));
+}
+
+TEST_CASE("DegenerationDetector: catches near-loops through low diversity", "[DegenerationDetector]") {
+    DegenerationParams params;
+    params.maxPeriod = 0;
+    params.window = 8;
+    params.minDistinctRatio = 0.5f;
+    DegenerationDetector detector(params);
+
+    // Three distinct tokens in the last eight is below half of the window
+    REQUIRE(detector.isDegenerate({MARIAN_PAD_ID, 1, 2, 3, 4, 5, 6, 7, 3, 4, 3, 5, 4, 3, 5, 4}));
+    REQUIRE_FALSE(detector.isDegenerate({MARIAN_PAD_ID, 10, 11, 12, 13, 14, 15, 16, 17}));
+
+    // Too short to judge
+    REQUIRE_FALSE(detector.isDegenerate({MARIAN_PAD_ID, 3, 3, 3}));
+
+    params.enabled = false;
+    REQUIRE_FALSE(DegenerationDetector(params).isDegenerate({MARIAN_PAD_ID, 3, 3, 3, 3, 3, 3, 3, 3}));
+}
+
+// ------ SegmentPacker ------
+
+TEST_CASE("SegmentPacker: packs consecutive short segments of one chapter", "[SegmentPacker]") {
+    PackingParams params;
+    params.enabled = true;
+    params.maxSegmentTokens = 10;
+    params.maxPackedTokens = 20;
+    params.maxSegments = 3;
+    SegmentPacker packer(params);
+
+    std::vector<TranslationSegment> segments = {
+        {1, 0, ">>jpn<< はい"},
+        {1, 1, ">>jpn<< いいえ"},
+        {1, 2, ">>jpn<< 長い段落"},
+        {1, 3, ">>jpn<< ドン"},
+        {2, 0, ">>jpn<< 次"},
+        {2, 1, ">>jpn<< ◆"},
+        {2, 2, ">>jpn<< 一"},
+        {2, 3, ">>jpn<< 二"},
+        {2, 4, ">>jpn<< 三"},
+        {2, 5, ">>jpn<< 四"},
+    };
+    std::vector<size_t> sourceTokens = {4, 5, 12, 4, 4, 4, 3, 3, 3, 3};
+
+    std::vector<PackedSegment> packed = packer.pack(segments, sourceTokens);
+    REQUIRE(packed.size() == 7);
+
+    // Only the first member keeps the language prefix
+    REQUIRE(packed[0].members == std::vector<size_t>{0, 1});
+    REQUIRE(packed[0].text == ">>jpn<< はい ◆ いいえ");
+
+    // Long segments, chapter changes and the separator itself end a group
+    REQUIRE(packed[1].members == std::vector<size_t>{2});
+    REQUIRE(packed[1].text == ">>jpn<< 長い段落");
+    REQUIRE(packed[2].members == std::vector<size_t>{3});
+    REQUIRE(packed[3].members == std::vector<size_t>{4});
+    REQUIRE(packed[4].members == std::vector<size_t>{5});
+
+    // maxSegments splits a run of short segments
+    REQUIRE(packed[5].members == std::vector<size_t>{6, 7, 8});
+    REQUIRE(packed[6].members == std::vector<size_t>{9});
+
+    params.enabled = false;
+    REQUIRE(SegmentPacker(params).pack(segments, sourceTokens).size() == segments.size());
+}
+
+TEST_CASE("SegmentPacker: unpack validates the separator count", "[SegmentPacker]") {
+    SegmentPacker packer(PackingParams{});
+    std::vector<std::string> parts;
+
+    REQUIRE(packer.unpack("Yes. ◆ No. ◆  Bang!", 3, parts));
+    REQUIRE(parts == std::vector<std::string>{"Yes.", "No.", "Bang!"});
+
+    // A dropped, merged or added separator sends the members back to be translated alone
+    REQUIRE_FALSE(packer.unpack("Yes. No. ◆ Bang!", 3, parts));
+    REQUIRE_FALSE(packer.unpack("Yes. ◆ ◆ Bang!", 3, parts));
+    REQUIRE_FALSE(packer.unpack("Yes. ◆ No. ◆ Bang! ◆ Boom!", 3, parts));
+
+    // A single segment is never split
+    REQUIRE(packer.unpack("A ◆ B", 1, parts));
+    REQUIRE(parts == std::vector<std::string>{"A ◆ B"});
+}
+
+// ------ WorkStealingQueue ------
+
+TEST_CASE("WorkStealingQueue: deals the items out longest first", "[WorkStealingQueue]") {
+    WorkStealingQueue queue({3.0, 10.0, 4.0, 6.0, 1.0}, 2);
+
+    // 10 and 3 go to worker 0, 6, 4 and 1 to worker 1, each always being the least loaded
+    REQUIRE(queue.queuedCost(0) == 13.0);
+    REQUIRE(queue.queuedCost(1) == 11.0);
+
+    size_t item = 0;
+    bool stolen = true;
+    REQUIRE(queue.next(0, item, stolen));
+    REQUIRE(item == 1);
+    REQUIRE_FALSE(stolen);
+    REQUIRE(queue.next(1, item, stolen));
+    REQUIRE(item == 3);
+    REQUIRE(queue.next(1, item, stolen));
+    REQUIRE(item == 2);
+    REQUIRE(queue.next(1, item, stolen));
+    REQUIRE(item == 4);
+    REQUIRE_FALSE(stolen);
+    REQUIRE(queue.queuedCost(0) == 3.0);
+}
+
+TEST_CASE("WorkStealingQueue: idle workers steal until every item is claimed", "[WorkStealingQueue]") {
+    WorkStealingQueue queue({8.0, 1.0, 1.0, 1.0}, 2);
+
+    size_t item = 0;
+    bool stolen = false;
+    REQUIRE(queue.next(0, item, stolen));
+    REQUIRE(item == 0);
+
+    // Worker 0 owns nothing else, so it takes the cheapest item at the back of worker 1's queue
+    REQUIRE(queue.next(0, item, stolen));
+    REQUIRE(stolen);
+    REQUIRE(item == 3);
+
+    std::set<size_t> claimed = {0, 3};
+    while (queue.next(1, item, stolen)) {
+        claimed.insert(item);
+    }
+    REQUIRE(claimed == std::set<size_t>{0, 1, 2, 3});
+    REQUIRE_FALSE(queue.next(0, item, stolen));
+}
+
+// ------ TranslationMetrics ------
+
+TEST_CASE("TranslationMetrics: corpusBleu", "[TranslationMetrics]") {
+    std::vector<std::string> references = {"The cat sat on the mat.", "It was raining again."};
+    REQUIRE(std::abs(TranslationMetrics::corpusBleu(references, references) - 100.0) < 1e-9);
+
+    // Every precision is 1, only the brevity penalty exp(1 - 8 / 4) applies
+    REQUIRE(std::abs(TranslationMetrics::corpusBleu({"a b c d"}, {"a b c d e f g h"}) - 100.0 * std::exp(-1.0)) < 1e-9);
+
+    // Smoothing keeps a translation without matches above 0, but well below a partial match
+    double unrelated = TranslationMetrics::corpusBleu({"nothing in common here"}, {"the cat sat down"});
+    REQUIRE(unrelated > 0.0);
+    REQUIRE(unrelated < TranslationMetrics::corpusBleu({"the cat sat up"}, {"the cat sat down"}));
+
+    REQUIRE(TranslationMetrics::corpusBleu({""}, {"the cat"}) == 0.0);
+    REQUIRE_THROWS(TranslationMetrics::corpusBleu({"a"}, {}));
+}
+
+TEST_CASE("TranslationMetrics: corpusChrf", "[TranslationMetrics]") {
+    REQUIRE(std::abs(TranslationMetrics::corpusChrf({"The cat sat."}, {"The  cat sat."}) - 100.0) < 1e-9);
+    REQUIRE(TranslationMetrics::corpusChrf({"xyz"}, {"abc"}) == 0.0);
+
+    // Unigrams match 2 of 2 and 2 of 3, bigrams 1 of 1 and 1 of 2, longer orders don't count
+    double precision = 1.0;
+    double recall = (2.0 / 3.0 + 1.0 / 2.0) / 2.0;
+    REQUIRE(std::abs(TranslationMetrics::corpusChrf({"ab"}, {"abc"}) - 100.0 * 5.0 * precision * recall / (4.0 * precision + recall)) < 1e-9);
+}
+
+// ------ BoundedQueue ------
+
+TEST_CASE("BoundedQueue: hands items over in order and drains after close", "[BoundedQueue]") {
+    BoundedQueue<int> queue(2);
+    int item = 0;
+    REQUIRE_FALSE(queue.tryPop(item));
+
+    REQUIRE(queue.push(1));
+    REQUIRE(queue.push(2));
+    REQUIRE(queue.tryPop(item));
+    REQUIRE(item == 1);
+
+    // Closing stops the producer, the consumer still gets what was queued
+    queue.close();
+    REQUIRE_FALSE(queue.push(3));
+    REQUIRE(queue.pop(item));
+    REQUIRE(item == 2);
+    REQUIRE_FALSE(queue.pop(item));
+}
+
+TEST_CASE("BoundedQueue: a full queue blocks the producer until the consumer catches up", "[BoundedQueue]") {
+    BoundedQueue<int> queue(1);
+    std::thread producer([&queue]() {
+        for (int i = 0; i < 100; ++i) {
+            queue.push(i);
+        }
+        queue.close();
+    });
+
+    std::vector<int> received;
+    int item = 0;
+    while (queue.pop(item)) {
+        received.push_back(item);
+    }
+    producer.join();
+
+    REQUIRE(received.size() == 100);
+    REQUIRE(received.front() == 0);
+    REQUIRE(received.back() == 99);
+    REQUIRE(std::is_sorted(received.begin(), received.end()));
+}
+
+// ------ TensorArena ------
+
+TEST_CASE("TensorArena: scratch buffers only grow", "[TensorArena]") {
+    TensorArena arena;
+    float* logits = arena.floats("logits", 100);
+    REQUIRE(arena.allocations() == 1);
+
+    // Smaller and equal requests reuse the buffer, a larger one grows it once
+    REQUIRE(arena.floats("logits", 40) == logits);
+    REQUIRE(arena.floats("logits", 100) == logits);
+    REQUIRE(arena.allocations() == 1);
+    arena.floats("logits", 200);
+    REQUIRE(arena.allocations() == 2);
+
+    // Every name has its own buffer
+    arena.int64s("input_ids", 8);
+    arena.int64s("input_ids", 8);
+    REQUIRE(arena.allocations() == 3);
+}
+
+TEST_CASE("TensorArena: released buffers are handed out again", "[TensorArena]") {
+    TensorArena arena;
+    std::vector<float> cache = arena.acquireFloats(64);
+    REQUIRE(cache.empty());
+    REQUIRE(cache.capacity() >= 64);
+    cache.assign(64, 1.0f);
+    const float* storage = cache.data();
+    REQUIRE(arena.allocations() == 1);
+
+    arena.release(cache);
+    REQUIRE(cache.capacity() == 0);
+
+    // A fitting request gets the pooled buffer back without allocating
+    std::vector<float> reused = arena.acquireFloats(32);
+    REQUIRE(reused.empty());
+    REQUIRE(reused.data() == storage);
+    REQUIRE(arena.allocations() == 1);
+
+    // The pool is empty again, so the next request allocates
+    std::vector<int64_t> mask = arena.acquireInt64s(16);
+    REQUIRE(mask.capacity() >= 16);
+    REQUIRE(arena.allocations() == 2);
+}
+
+// ------ LogitsKernels ------
+
+TEST_CASE("LogitsKernels: expApprox stays close to std::exp", "[LogitsKernels]") {
+    for (float x = -80.0f; x <= 0.0f; x += 0.37f) {
+        REQUIRE(std::abs(LogitsKernels::expApprox(x) - std::exp(x)) <= 1e-6f * std::exp(x));
+    }
+    REQUIRE(LogitsKernels::expApprox(0.0f) == 1.0f);
+    REQUIRE(LogitsKernels::expApprox(-std::numeric_limits<float>::infinity()) == 0.0f);
+}
+
+TEST_CASE("LogitsKernels: logSoftmax normalizes the scores", "[LogitsKernels]") {
+    LogitsKernels kernels(false);
+    std::vector<float> scores = {1.0f, 2.0f, 3.0f, -std::numeric_limits<float>::infinity()};
+    kernels.logSoftmax(scores.data(), scores.size());
+
+    double total = 0.0;
+    for (float score : scores) {
+        total += std::exp(score);
+    }
+    REQUIRE(std::abs(total - 1.0) < 1e-6);
+    REQUIRE(std::isinf(scores[3]));
+    REQUIRE(std::abs(scores[2] - scores[1] - 1.0f) < 1e-6f);
+}
+
+TEST_CASE("LogitsKernels: AVX2 and scalar results are bit-identical", "[LogitsKernels]") {
+    // Nothing to compare on a CPU without AVX2, the scalar kernels are used there
+    if (!CpuFeatures::hasAvx2()) return;
+
+    LogitsKernels scalar(false);
+    LogitsKernels avx2(true);
+    std::mt19937 random(11);
+    std::normal_distribution<float> noise(0.0f, 4.0f);
+    for (size_t count : {1, 7, 8, 9, 64, 1003, 64172}) {
+        std::vector<float> scores(count);
+        for (float& score : scores) {
+            score = noise(random);
+        }
+        // Banned tokens and ties, which the top-k has to order the same way
+        scores[count / 2] = -std::numeric_limits<float>::infinity();
+        if (count > 4) scores[count - 1] = scores[count - 3] = scores[1];
+
+        std::vector<float> scalarScores = scores;
+        std::vector<float> avx2Scores = scores;
+        scalar.logSoftmax(scalarScores.data(), count);
+        avx2.logSoftmax(avx2Scores.data(), count);
+        REQUIRE(scalarScores == avx2Scores);
+
+        scalar.addScalar(scalarScores.data(), count, -1.25f);
+        avx2.addScalar(avx2Scores.data(), count, -1.25f);
+        REQUIRE(scalarScores == avx2Scores);
+
+        std::vector<std::pair<float, size_t>> scalarBest;
+        std::vector<std::pair<float, size_t>> avx2Best;
+        for (size_t k : {1, 3, 8}) {
+            scalar.topK(scalarScores.data(), count, k, scalarBest);
+            avx2.topK(avx2Scores.data(), count, k, avx2Best);
+            REQUIRE(scalarBest == avx2Best);
+            REQUIRE(scalarBest.size() == std::min(k, count));
+        }
+    }
+}
+
+TEST_CASE("LogitsKernels: topK returns the best scores first", "[LogitsKernels]") {
+    LogitsKernels kernels(false);
+    std::vector<float> scores = {0.5f, 3.0f, -1.0f, 2.0f, 3.0f, 1.0f};
+    std::vector<std::pair<float, size_t>> best;
+    kernels.topK(scores.data(), scores.size(), 3, best);
+
+    REQUIRE(best.size() == 3);
+    REQUIRE(best[0].first == 3.0f);
+    REQUIRE(best[1].first == 3.0f);
+    REQUIRE(best[2] == std::pair<float, size_t>{2.0f, 3});
+}
+
+TEST_CASE("NgramBlocker: bans the same tokens as the linear scan", "[LogitsKernels]") {
+    GenerationParams params;
+    params.numBeams = 1;
+    std::mt19937 random(3);
+    std::uniform_int_distribution<int64_t> token(0, 5);
+    for (int n : {1, 2, 3, 4}) {
+        params.noRepeatNgramSize = n;
+        TestableBeamSearch search(params, 6);
+        NgramBlocker blocker(n);
+
+        std::vector<int64_t> tokens = {MARIAN_PAD_ID % 6};
+        blocker.extend(tokens);
+        for (int step = 0; step < 200; ++step) {
+            std::vector<float> scanned(6, 0.0f);
+            std::vector<float> hashed(6, 0.0f);
+            search.applyNoRepeatNgram(scanned.data(), tokens);
+            blocker.apply(hashed.data(), tokens);
+            REQUIRE(scanned == hashed);
+
+            tokens.push_back(token(random));
+            blocker.extend(tokens);
+        }
+        REQUIRE(blocker.size() == tokens.size() - n + 1);
+    }
+}
+
+// ------ SegmentFile ------
+
+TEST_CASE("SegmentFile: round trips text the CSV files could not hold", "[SegmentFile]") {
+    std::filesystem::path path = "test_segments.bin";
+    std::vector<SegmentRecord> records = {
+        {0, 1, 2, "jpn", ">>jpn<< 猫は、犬と\n遊んだ。"},
+        {7, -1, 0, "zho_Hans_extra", ""},
+        {9, 3, 4, "", "one, two, three"}
+    };
+    SegmentFile::write(path, records);
+
+    {
+        SegmentFile segments(path);
+        REQUIRE(segments.size() == 3);
+        REQUIRE(segments.id(1) == 7);
+        REQUIRE(segments.chapterNum(1) == -1);
+        REQUIRE(segments.position(2) == 4);
+        REQUIRE(segments.text(0) == ">>jpn<< 猫は、犬と\n遊んだ。");
+        REQUIRE(segments.text(1).empty());
+        REQUIRE(segments.text(2) == "one, two, three");
+
+        // Language codes keep their first 8 bytes
+        REQUIRE(segments.language(0) == "jpn");
+        REQUIRE(segments.language(1) == "zho_Hans");
+        REQUIRE(segments.language(2).empty());
+
+        std::vector<SegmentRecord> read = segments.records();
+        REQUIRE(read[2].id == 9);
+        REQUIRE(read[2].chapterNum == 3);
+        REQUIRE(read[2].text == records[2].text);
+    }
+
+    SegmentFile::write(path, {});
+    REQUIRE(SegmentFile(path).size() == 0);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("SegmentFile: rejects files that are not complete segment files", "[SegmentFile]") {
+    std::filesystem::path path = "test_segments.bin";
+    REQUIRE_THROWS_AS(SegmentFile("test_segments_missing.bin"), std::runtime_error);
+
+    std::ofstream(path, std::ios::binary) << "0,1,2,text\n";
+    REQUIRE_THROWS_AS(SegmentFile(path), std::runtime_error);
+
+    std::ofstream(path, std::ios::binary).flush();
+    REQUIRE_THROWS_AS(SegmentFile(path), std::runtime_error);
+
+    // Cut off inside the last payload
+    SegmentFile::write(path, {{0, 0, 1, "jpn", "first"}, {1, 0, 2, "jpn", "second"}});
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    REQUIRE_THROWS_AS(SegmentFile(path), std::runtime_error);
+
+    // Cut off inside the records
+    std::filesystem::resize_file(path, SegmentFile::headerSize + SegmentFile::recordSize);
+    REQUIRE_THROWS_AS(SegmentFile(path), std::runtime_error);
+
+    std::filesystem::remove(path);
+}
+
+// ------ TranslationJob ------
+
+TEST_CASE("TranslationJournal: keeps the complete records of an interrupted run", "[TranslationJob]") {
+    std::filesystem::path path = "test_translation.journal";
+    std::filesystem::remove(path);
+
+    {
+        TranslationJournal journal(path, 42, 2);
+        REQUIRE(journal.entries().empty());
+        journal.append({1, 2, "The cat played.", -0.75f}, 11);
+        journal.append({1, 3, "", 0.0f}, 12);
+        journal.append({2, 0, "猫, 犬\nand a bird", -0.5f}, 13);
+    }
+    uintmax_t completeSize = std::filesystem::file_size(path);
+
+    // Half a record header and payload, as if the process died during the write
+    std::ofstream(path, std::ios::binary | std::ios::app).write("\x20\x00\x00\x00\x01\x02\x03", 7);
+
+    {
+        TranslationJournal journal(path, 42);
+        const auto& entries = journal.entries();
+        REQUIRE(entries.size() == 3);
+        REQUIRE(entries[0].result.chapterNum == 1);
+        REQUIRE(entries[0].result.position == 2);
+        REQUIRE(entries[0].result.text == "The cat played.");
+        REQUIRE(entries[0].result.confidence == -0.75f);
+        REQUIRE(entries[0].sourceHash == 11);
+        REQUIRE(entries[1].result.text.empty());
+        REQUIRE(entries[2].result.text == "猫, 犬\nand a bird");
+        REQUIRE(entries[2].sourceHash == 13);
+    }
+    REQUIRE(std::filesystem::file_size(path) == completeSize);
+
+    // The journal of an edited document starts over
+    {
+        TranslationJournal journal(path, 43);
+        REQUIRE(journal.entries().empty());
+    }
+    REQUIRE(TranslationJournal(path, 43).entries().empty());
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("TranslationJob: a restarted job only translates the segments it did not finish", "[TranslationJob]") {
+    std::filesystem::path documentPath = "test_job_book.txt";
+    std::filesystem::path journalDir = "test_journals";
+    std::filesystem::remove_all(journalDir);
+    std::ofstream(documentPath) << "猫は遊んだ。犬は寝た。";
+
+    std::vector<TranslationSegment> segments = {{0, 0, "one"}, {0, 1, "two"}, {1, 0, "three"}, {1, 1, "four"}};
+
+    // Killed after the engine finished the last two segments
+    FakeTranslationEngine crashed;
+    crashed.failAfter = 2;
+    TranslationJob first(documentPath, journalDir);
+    REQUIRE_THROWS_AS(first.translate(crashed, segments), std::runtime_error);
+    REQUIRE(std::filesystem::exists(first.journalPath()));
+
+    FakeTranslationEngine engine;
+    std::vector<std::string> reported;
+    TranslationJob second(documentPath, journalDir);
+    auto results = second.translate(engine, segments, [&](const TranslationResult& result) { reported.push_back(result.text); });
+    REQUIRE(second.resumedSegments() == 2);
+    REQUIRE(engine.translatedSegments == 2);
+    REQUIRE(reported == std::vector<std::string>{"THREE", "FOUR", "TWO", "ONE"});
+    REQUIRE(results.size() == 4);
+    REQUIRE(results[0].text == "ONE");
+    REQUIRE(results[3].text == "FOUR");
+
+    // A segment whose text changed is translated again
+    segments[3].text = "five";
+    FakeTranslationEngine edited;
+    TranslationJob third(documentPath, journalDir);
+    results = third.translate(edited, segments);
+    REQUIRE(third.resumedSegments() == 3);
+    REQUIRE(edited.translatedSegments == 1);
+    REQUIRE(results[3].text == "FIVE");
+
+    third.finish();
+    REQUIRE_FALSE(std::filesystem::exists(third.journalPath()));
+
+    std::filesystem::remove_all(journalDir);
+    std::filesystem::remove(documentPath);
+}
+
+// ------ TranslationMemory ------
+
+TEST_CASE("TranslationMemory: finds a translation of the same text, model and settings after reopening", "[TranslationMemory]") {
+    std::filesystem::path directory = "test_translation_memory";
+    std::filesystem::remove_all(directory);
+
+    MemoryKey name = TranslationMemory::key(">>jpn<< 　ハルヒ\n", "opus-mt", "{\"num_beams\":4}");
+    REQUIRE(name.source == ">>jpn<< ハルヒ");
+    REQUIRE(TranslationMemory::key(">>jpn<<   ハルヒ", "opus-mt", "{\"num_beams\":4}").hash == name.hash);
+    REQUIRE(TranslationMemory::key(">>jpn<< ハルヒ", "opus-mt", "{\"num_beams\":1}").hash != name.hash);
+    REQUIRE(TranslationMemory::key(">>jpn<< ハルヒ", "opus-mt-big", "{\"num_beams\":4}").hash != name.hash);
+
+    TranslationResult result = {0, 0, ""};
+    {
+        TranslationMemory memory(directory);
+        REQUIRE(memory.size() == 0);
+        REQUIRE_FALSE(memory.lookup(name, result));
+
+        memory.insert(name, {0, 0, "Haruhi", -0.25f});
+        memory.insert(TranslationMemory::key(">>jpn<< 第一章", "opus-mt", "{\"num_beams\":4}"), {0, 1, "Chapter 1", -0.5f});
+        REQUIRE(memory.size() == 2);
+        REQUIRE(memory.lookup(name, result));
+        REQUIRE(result.text == "Haruhi");
+    }
+
+    {
+        TranslationMemory memory(directory);
+        REQUIRE(memory.size() == 2);
+        result = {3, 4, ""};
+        REQUIRE(memory.lookup(TranslationMemory::key(">>jpn<< ハルヒ", "opus-mt", "{\"num_beams\":4}"), result));
+        REQUIRE(result.text == "Haruhi");
+        REQUIRE(result.confidence == -0.25f);
+        REQUIRE(result.position == 4);
+        REQUIRE(memory.lookup(TranslationMemory::key(">>jpn<< 第一章", "opus-mt", "{\"num_beams\":4}"), result));
+        REQUIRE(result.text == "Chapter 1");
+        REQUIRE_FALSE(memory.lookup(TranslationMemory::key(">>jpn<< ハルヒ", "opus-mt", "{}"), result));
+
+        // The same hash with another source is a collision, not a hit
+        MemoryKey collision = name;
+        collision.source = ">>jpn<< キョン";
+        REQUIRE_FALSE(memory.lookup(collision, result));
+
+        memory.insert(TranslationMemory::key(">>jpn<< 第二章", "opus-mt", "{\"num_beams\":4}"), {0, 2, "Chapter 2", -0.5f});
+    }
+
+    REQUIRE(TranslationMemory(directory).size() == 3);
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("TranslationMemory: appends to the data file while it is mapped", "[TranslationMemory]") {
+    std::filesystem::path directory = "test_translation_memory";
+    std::filesystem::remove_all(directory);
+    MemoryKey mapped = TranslationMemory::key(">>jpn<< 一", "opus-mt", "");
+    MemoryKey appended = TranslationMemory::key(">>jpn<< 二", "opus-mt", "");
+    {
+        TranslationMemory memory(directory);
+        memory.insert(mapped, {0, 0, "one"});
+    }
+
+    // The memory holds the mapping and the append handle of memory.data, a reader maps it once more
+    {
+        TranslationMemory memory(directory);
+        memory.insert(appended, {0, 1, "two"});
+        memory.flush();
+        MappedFile reader(directory / "memory.data");
+        REQUIRE(reader.size() > 0);
+
+        TranslationResult result = {0, 0, ""};
+        REQUIRE(memory.lookup(mapped, result));
+        REQUIRE(result.text == "one");
+        REQUIRE(memory.lookup(appended, result));
+        REQUIRE(result.text == "two");
+        REQUIRE(std::string(reinterpret_cast<const char*>(reader.data()) + reader.size() - 3, 3) == "two");
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("TranslationMemory: rebuilds the index after a crash", "[TranslationMemory]") {
+    std::filesystem::path directory = "test_translation_memory";
+    std::filesystem::remove_all(directory);
+    MemoryKey first = TranslationMemory::key(">>jpn<< 一", "opus-mt", "");
+    MemoryKey second = TranslationMemory::key(">>jpn<< 二", "opus-mt", "");
+
+    {
+        TranslationMemory memory(directory);
+        memory.insert(first, {0, 0, "one"});
+    }
+    uintmax_t completeSize = std::filesystem::file_size(directory / "memory.data");
+
+    // A crash leaves entries the index doesn't cover and a torn one after them
+    {
+        TranslationMemory memory(directory);
+        memory.insert(second, {0, 1, "two"});
+        memory.flush();
+        std::filesystem::copy_file(directory / "memory.data", directory / "memory.crashed");
+    }
+    std::filesystem::copy_file(directory / "memory.crashed", directory / "memory.data", std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::resize_file(directory / "memory.index", 0);
+    std::ofstream(directory / "memory.data", std::ios::binary | std::ios::app).write("\x40\x00\x00\x00\x01", 5);
+
+    TranslationResult result = {0, 0, ""};
+    {
+        TranslationMemory memory(directory);
+        REQUIRE(memory.size() == 2);
+        REQUIRE(memory.lookup(first, result));
+        REQUIRE(result.text == "one");
+        REQUIRE(memory.lookup(second, result));
+        REQUIRE(result.text == "two");
+    }
+    REQUIRE(std::filesystem::file_size(directory / "memory.data") > completeSize);
+    REQUIRE(std::filesystem::file_size(directory / "memory.data") == std::filesystem::file_size(directory / "memory.crashed"));
+
+    std::ofstream(directory / "memory.data", std::ios::binary | std::ios::trunc) << "0,1,2,text\n";
+    REQUIRE_THROWS_AS(TranslationMemory(directory), std::runtime_error);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("TranslationJob: takes the segments the translation memory knows from it", "[TranslationMemory]") {
+    std::filesystem::path directory = "test_translation_memory";
+    std::filesystem::path journalDir = "test_journals";
+    std::filesystem::remove_all(directory);
+    std::filesystem::remove_all(journalDir);
+    std::ofstream("test_job_volume1.txt") << "volume 1";
+    std::ofstream("test_job_volume2.txt") << "volume 2";
+
+    // The jobs share the memory like the translators of one process
+    {
+        auto memory = std::make_shared<TranslationMemory>(directory);
+        FakeTranslationEngine engine;
+        TranslationJob volume1("test_job_volume1.txt", journalDir, memory);
+        volume1.translate(engine, {{0, 0, "haruhi"}, {0, 1, "chapter one"}, {1, 0, "kyon"}});
+        REQUIRE(volume1.memoryHits() == 0);
+        REQUIRE(volume1.memoryLookups() == 3);
+
+        std::vector<TranslationSegment> segments = {{0, 0, "chapter  one"}, {0, 1, "haruhi"}, {0, 2, "itsuki"}};
+        FakeTranslationEngine nextEngine;
+        TranslationJob volume2("test_job_volume2.txt", journalDir, memory);
+        auto results = volume2.translate(nextEngine, segments);
+        REQUIRE(nextEngine.translatedSegments == 1);
+        REQUIRE(volume2.memoryHits() == 2);
+        REQUIRE(volume2.memoryBytesSaved() == std::string("chapter  one").size() + std::string("haruhi").size());
+        REQUIRE(results.size() == 3);
+        REQUIRE(results[0].text == "CHAPTER ONE");
+        REQUIRE(results[0].position == 0);
+        REQUIRE(results[1].text == "HARUHI");
+        REQUIRE(results[2].text == "ITSUKI");
+
+        // Another model translates everything itself
+        FakeTranslationEngine otherModel;
+        otherModel.model = "other-model";
+        TranslationJob other("test_job_volume2.txt", journalDir / "other", memory);
+        other.translate(otherModel, segments);
+        REQUIRE(otherModel.translatedSegments == 3);
+        REQUIRE(other.memoryHits() == 0);
+    }
+
+    REQUIRE(TranslationMemory(directory).size() == 7);
+    std::filesystem::remove_all(directory);
+    std::filesystem::remove_all(journalDir);
+    std::filesystem::remove("test_job_volume1.txt");
+    std::filesystem::remove("test_job_volume2.txt");
+}
+
+TEST_CASE("TranslationJob: translates byte-identical segments once", "[TranslationJob]") {
+    std::filesystem::path documentPath = "test_job_book.txt";
+    std::filesystem::path journalDir = "test_journals";
+    std::filesystem::remove_all(journalDir);
+    std::ofstream(documentPath) << "……ドン！……";
+
+    std::vector<TranslationSegment> segments = {{0, 0, "……"}, {0, 1, "bang!"}, {0, 2, "……"}, {1, 0, "……"}, {1, 1, "bang!"}, {1, 2, "…… "}};
+
+    // Killed after the engine finished "…… " and "bang!", both copies of "bang!" are journaled.
+    // The trailing space makes "…… " a different segment, only exact copies are collapsed.
+    FakeTranslationEngine crashed;
+    crashed.failAfter = 2;
+    TranslationJob first(documentPath, journalDir);
+    REQUIRE_THROWS_AS(first.translate(crashed, segments), std::runtime_error);
+    REQUIRE(crashed.translatedSegments == 3);
+
+    FakeTranslationEngine engine;
+    std::vector<std::pair<int, int>> reported;
+    TranslationJob second(documentPath, journalDir);
+    auto results = second.translate(engine, segments, [&](const TranslationResult& result) { reported.emplace_back(result.chapterNum, result.position); });
+    REQUIRE(second.resumedSegments() == 3);
+    REQUIRE(engine.translatedSegments == 1);
+    REQUIRE(second.uniqueSegments() == 1);
+    REQUIRE(second.duplicateSegments() == 2);
+    REQUIRE(reported.size() == 6);
+
+    REQUIRE(results.size() == 6);
+    for (size_t i = 0; i < segments.size(); ++i) {
+        REQUIRE(results[i].chapterNum == segments[i].chapterNum);
+        REQUIRE(results[i].position == segments[i].position);
+    }
+    REQUIRE(results[1].text == "BANG!");
+    REQUIRE(results[3].text == "……");
+    REQUIRE(results[4].text == "BANG!");
+
+    second.finish();
+    std::filesystem::remove_all(journalDir);
+    std::filesystem::remove(documentPath);
+}
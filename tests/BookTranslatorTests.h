@@ -2,6 +2,13 @@
 #include "PDFTranslator.h"
 #include "DocxTranslator.h"
 #include "GUI.h"
+#include "MarianTokenizer.h"
+#include "OnnxTranslationEngine.h"
+#include "TranslationServer.h"
+#include "DaemonTranslationEngine.h"
+#include "TranslationMetrics.h"
+#include "SegmentFile.h"
+#include <limits>
 #include <sys/stat.h>
 
 
@@ -84,12 +91,73 @@ class TestableDocxTranslator : public DocxTranslator {
         using DocxTranslator::getNodePath;
         using DocxTranslator::extractTextNodesRecursive;
         using DocxTranslator::extractTextNodes;
-        using DocxTranslator::saveTextToFile;
-        using DocxTranslator::loadTranslations;
         using DocxTranslator::updateNodeWithTranslation;
         using DocxTranslator::traverseAndReinsert;
         using DocxTranslator::reinsertTranslations;
         using DocxTranslator::exportDocx;
         using DocxTranslator::escapeForDocx;
         using DocxTranslator::escapeTranslations;
-};
\ No newline at end of file
+};
+
+class TestableMarianTokenizer : public MarianTokenizer {
+    public:
+        using MarianTokenizer::MarianTokenizer;
+        using MarianTokenizer::splitLanguageCode;
+        using MarianTokenizer::stripWhitespace;
+};
+
+class TestableOnnxTranslationEngine : public OnnxTranslationEngine {
+public:
+    using OnnxTranslationEngine::createBatches;
+    using OnnxTranslationEngine::resolveGraphDir;
+    using OnnxTranslationEngine::sessionCores;
+    using OnnxTranslationEngine::truncateDecoderCache;
+    using OnnxTranslationEngine::outputBudget;
+    using OnnxTranslationEngine::batchCost;
+    using OnnxTranslationEngine::gatherRows;
+    using OnnxTranslationEngine::compactRows;
+    using OnnxTranslationEngine::splitEncoderCores;
+};
+
+class TestableBeamSearch : public BeamSearch {
+public:
+    using BeamSearch::BeamSearch;
+    using BeamSearch::applyNoRepeatNgram;
+    using BeamSearch::applyRepetitionPenalty;
+    using BeamSearch::useReference;
+};
+
+// Uppercases the text so the daemon tests do not need the model
+class FakeTranslationEngine : public TranslationEngine {
+public:
+    std::vector<TranslationResult> translate(const std::vector<TranslationSegment>& segments) override {
+        std::vector<TranslationResult> results;
+        for (const auto& segment : segments) {
+            std::string text = segment.text;
+            std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+            results.push_back({segment.chapterNum, segment.position, text});
+        }
+        ++calls;
+        translatedSegments += segments.size();
+        return results;
+    }
+
+    // Reports the results last to first, like segments that finish out of order, and fails
+    // after failAfter of them like a job that is killed
+    std::vector<TranslationResult> translateStreaming(const std::vector<TranslationSegment>& segments, const ResultCallback& onResult) override {
+        std::vector<TranslationResult> results = translate(segments);
+        size_t reported = 0;
+        for (auto result = results.rbegin(); result != results.rend(); ++result) {
+            if (reported++ == failAfter) throw std::runtime_error("Translation interrupted");
+            if (onResult) onResult(*result);
+        }
+        return results;
+    }
+
+    std::string modelId() const override { return model; }
+
+    int calls = 0;
+    size_t translatedSegments = 0;
+    std::string model = "fake-model";
+    size_t failAfter = std::numeric_limits<size_t>::max();
+};
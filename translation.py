@@ -6,7 +6,9 @@ from transformers import AutoTokenizer
 from optimum.onnxruntime import ORTModelForSeq2SeqLM
 import torch
 import json
+import math
 import os
+import struct
 import onnxruntime as ort
 
 # Force UTF-8 for stdout and stderr to prevent encoding issues
@@ -14,7 +16,7 @@ sys.stdout = io.TextIOWrapper(sys.stdout.buffer, encoding="utf-8")
 sys.stderr = io.TextIOWrapper(sys.stderr.buffer, encoding="utf-8")
 
 # Global parameters
-global Model_name, params
+global Model_name, params, batching, quantization, length_budget
 global tokenizer, model
 
 onnx_model_path = 'onnx-model-dir'
@@ -27,7 +29,13 @@ sess_options.execution_mode = ort.ExecutionMode.ORT_SEQUENTIAL
 
 def load_translation_config():
     """Load translation configuration from JSON file."""
-    global Model_name, params
+    global Model_name, params, batching, quantization, length_budget
+
+    # batch_size caps the segments per generate call, max_batch_tokens caps the padded source tokens
+    batching = {"batch_size": 16, "max_batch_tokens": 2048}
+    quantization = {"variant": "fp32", "max_bleu_drop": 1.0}
+    # Output tokens allowed per source token, fitted by fitLengthBudget.py
+    length_budget = {"enabled": True, "ratio": 2.0, "slack": 16}
 
     if os.path.exists('translationConfig.json'):
         with open('translationConfig.json') as f:
@@ -35,6 +43,9 @@ def load_translation_config():
             data = json.load(f)
             Model_name = data.get('Model_name', "Helsinki-NLP/opus-mt-mul-en")
             params = data.get('params', {})
+            batching.update(data.get('batching', {}))
+            quantization.update(data.get('quantization', {}))
+            length_budget.update(data.get('length_budget', {}))
     else:
         print("No translation config found. Using default values.", flush=True)
         Model_name = "Helsinki-NLP/opus-mt-mul-en"
@@ -47,17 +58,83 @@ def load_translation_config():
             "temperature": 0
         }
 
+def resolve_model_path():
+    """Use the quantized variant only if quantizeModel.py recorded a BLEU drop within the margin."""
+    variant = quantization.get("variant", "fp32")
+    if variant in ("", "fp32"):
+        return onnx_model_path
+
+    gate_path = os.path.join(onnx_model_path, variant, "quantization_gate.json")
+    if not os.path.exists(gate_path):
+        print(f"No quantization_gate.json for {variant}, run quantizeModel.py first. Using the fp32 model.", flush=True)
+        return onnx_model_path
+
+    with open(gate_path) as f:
+        gate = json.load(f)
+    bleu_drop = gate.get("baseline_bleu", 0) - gate.get("quantized_bleu", 0)
+    if not gate.get("passed", False) or bleu_drop > quantization.get("max_bleu_drop", 1.0):
+        print(f"The {variant} model lost {bleu_drop:.2f} BLEU, more than allowed. Using the fp32 model.", flush=True)
+        return onnx_model_path
+
+    print(f"Using the {variant} model (BLEU drop {bleu_drop:.2f})", flush=True)
+    return os.path.join(onnx_model_path, variant)
+
 # Load model and tokenizer once
 print("Loading model...", flush=True)
 load_translation_config()  # Load config before initializing model/tokenizer
 tokenizer = AutoTokenizer.from_pretrained(Model_name)
-model = ORTModelForSeq2SeqLM.from_pretrained(onnx_model_path, sess_options=sess_options, providers=providers)
+model = ORTModelForSeq2SeqLM.from_pretrained(resolve_model_path(), sess_options=sess_options, providers=providers)
 print("Model loaded successfully.", flush=True)
 
+# Binary segment file shared with src/SegmentFile.h: a 16 byte header, 32 byte records
+# (id, chapter, position, language[8], reserved, payload offset) and length prefixed UTF-8 texts
+SEGMENT_MAGIC = b"SEGS"
+SEGMENT_HEADER = struct.Struct("<4sIII")
+SEGMENT_RECORD = struct.Struct("<Iii8sIQ")
+
+def is_segment_file(path):
+    with open(path, "rb") as f:
+        return f.read(len(SEGMENT_MAGIC)) == SEGMENT_MAGIC
+
+def read_segment_file(path):
+    """Return the (id, chapter, position, language, text) tuples of a segment file."""
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version, count, record_size = SEGMENT_HEADER.unpack_from(data, 0)
+    if magic != SEGMENT_MAGIC or version != 1 or record_size != SEGMENT_RECORD.size:
+        raise ValueError(f"Unsupported segment file: {path}")
+
+    segments = []
+    for i in range(count):
+        segment_id, chapter, position, language, _, offset = SEGMENT_RECORD.unpack_from(data, SEGMENT_HEADER.size + i * SEGMENT_RECORD.size)
+        (length,) = struct.unpack_from("<I", data, offset)
+        text = data[offset + 4:offset + 4 + length].decode("utf-8")
+        segments.append((segment_id, chapter, position, language.rstrip(b"\0").decode("ascii"), text))
+    return segments
+
+def write_segment_file(path, segments):
+    """Write (id, chapter, position, language, text) tuples as a segment file."""
+    payloads = [text.encode("utf-8") for *_, text in segments]
+    offset = SEGMENT_HEADER.size + len(segments) * SEGMENT_RECORD.size
+    parts = [SEGMENT_HEADER.pack(SEGMENT_MAGIC, 1, len(segments), SEGMENT_RECORD.size)]
+    for (segment_id, chapter, position, language, _), payload in zip(segments, payloads):
+        parts.append(SEGMENT_RECORD.pack(segment_id, chapter, position, language.encode("ascii")[:8], 0, offset))
+        offset += 4 + len(payload)
+    for payload in payloads:
+        parts.append(struct.pack("<I", len(payload)))
+        parts.append(payload)
+    with open(path, "wb") as f:
+        f.write(b"".join(parts))
+
 def create_tasks(input_file_path="rawTags.txt", chapter_num_mode=0):
     """Create translation tasks from input file."""
     tasks = []
     try:
+        if is_segment_file(input_file_path):
+            for _, chapter, position, _, text in read_segment_file(input_file_path):
+                tasks.append((chapter, position, text) if chapter_num_mode == 0 else (position, text))
+            return tasks
+
         with open(input_file_path, "r", encoding="utf-8") as infile:
             lines = infile.readlines()
 
@@ -75,49 +152,119 @@ def create_tasks(input_file_path="rawTags.txt", chapter_num_mode=0):
         print(f"Error occurred: {e}", flush=True)
         return []
 
-def process_task(task, chapter_num_mode):
-    """Process a single task and return translation results."""
-    try:
+def split_task(task, chapter_num_mode):
+    """Return the (key, text) of a task, where key is what gets written back with the translation."""
+    if chapter_num_mode == 0:
+        chapterNum, position, text = task
+        return (chapterNum, position), text
+    position, text = task
+    return (position,), text
+
+def create_batches(tasks, chapter_num_mode):
+    """Group tasks of similar token length so padding stays small."""
+    batch_size = max(1, int(batching.get("batch_size", 16)))
+    max_batch_tokens = max(1, int(batching.get("max_batch_tokens", 2048)))
+
+    texts = [split_task(task, chapter_num_mode)[1] for task in tasks]
+    lengths = [len(ids) for ids in tokenizer(texts, truncation=True)["input_ids"]] if texts else []
+    order = sorted(range(len(tasks)), key=lambda i: lengths[i])
+
+    batches = []
+    current = []
+    current_max = 0
+    for index in order:
+        longest = max(current_max, lengths[index])
+        # Every row is padded to the longest one, so the budget is rows * longest
+        if current and (len(current) >= batch_size or longest * (len(current) + 1) > max_batch_tokens):
+            batches.append(current)
+            current = []
+            longest = lengths[index]
+        current.append(index)
+        current_max = longest
 
-        if chapter_num_mode == 0:
-            chapterNum, position, text = task
-        elif chapter_num_mode == 1:
-            position, text = task
+    if current:
+        batches.append(current)
+    return batches
 
-        # Perform model inference
-        with torch.no_grad():
-            encoded_data = tokenizer(text, return_tensors="pt")
-            generated = model.generate(
-                **encoded_data,
-                **params  # Dynamically unpack parameters from JSON
-            )
-            translated_text = tokenizer.decode(generated[0], skip_special_tokens=True)
+def budgeted_params(longest_source):
+    """The generation params with max_new_tokens capped by the budget of the longest source in the batch."""
+    if not length_budget.get("enabled", True):
+        return params
 
+    limit = params.get("max_new_tokens", params.get("max_length", 512))
+    budget = int(math.ceil(length_budget.get("ratio", 2.0) * longest_source + length_budget.get("slack", 16)))
+    budgeted = {key: value for key, value in params.items() if key != "max_length"}
+    budgeted["max_new_tokens"] = max(1, min(limit, budget))
+    return budgeted
+
+def print_result(key, translated_text):
+    """Print the result as one line of JSON in the daemon's result format, so callers can parse
+    each result as soon as its batch is decoded instead of waiting for translatedTags.txt."""
+    chapter_num, position = (int(key[0]), int(key[1])) if len(key) == 2 else (0, int(key[0]))
+    record = {"type": "result", "chapterNum": chapter_num, "position": position, "text": translated_text}
+    print(json.dumps(record, ensure_ascii=False), flush=True)
+
+def process_batch(tasks, chapter_num_mode):
+    """Translate a batch of tasks in one padded generate call and return (key, text) pairs."""
+    keys, texts = zip(*(split_task(task, chapter_num_mode) for task in tasks))
+
+    # Perform model inference
+    with torch.no_grad():
+        encoded_data = tokenizer(list(texts), return_tensors="pt", padding=True, truncation=True)
+        generated = model.generate(
+            **encoded_data,
+            **budgeted_params(encoded_data["attention_mask"].sum(dim=1).max().item())
+        )
+        translated_texts = tokenizer.batch_decode(generated, skip_special_tokens=True)
+
+    results = []
+    for key, translated_text in zip(keys, translated_texts):
         # Ensure UTF-8 safety
         translated_text = translated_text.encode('utf-8', errors='replace').decode('utf-8')
 
-        if chapter_num_mode == 0:
-            print(f"Translated chapter {chapterNum} at position {position}: {translated_text}", flush=True)
-            return chapterNum, position, translated_text
-        elif chapter_num_mode == 1:
-            print(f"Translated {position}: {translated_text}", flush=True)
-            return position, translated_text
-    except Exception as e:
-        print(f"Error processing task: {task}, Details: {e}", flush=True)
-        return None
+        print_result(key, translated_text)
+        results.append((*key, translated_text))
+    return results
 
 def run_model(input_file_path="rawTags.txt", chapter_num_mode=0):
-    """Run model inference sequentially."""
+    """Run model inference on length bucketed batches."""
     tasks = create_tasks(input_file_path, chapter_num_mode)
-    tasks = tasks[:100]  # Limit to 100 tasks for testing
 
-    print(f"Processing {len(tasks)} tasks.", flush=True)
-    
-    results = []
-    for task in tasks:
-        result = process_task(task, chapter_num_mode)
-        if result is not None:
-            results.append(result)
+    # Byte-identical texts are translated once and their result is written for every copy
+    first_copy = {}
+    unique_tasks = []
+    copies = []
+    for index, task in enumerate(tasks):
+        text = split_task(task, chapter_num_mode)[1]
+        if text not in first_copy:
+            first_copy[text] = len(unique_tasks)
+            unique_tasks.append(task)
+            copies.append([])
+        copies[first_copy[text]].append(index)
+    if unique_tasks:
+        print(f"Deduplicated {len(tasks)} tasks to {len(unique_tasks)} unique ones, dedup ratio {len(tasks) / len(unique_tasks):.2f}.", flush=True)
+
+    batches = create_batches(unique_tasks, chapter_num_mode)
+
+    print(f"Processing {len(unique_tasks)} tasks in {len(batches)} batches.", flush=True)
+
+    results = [None] * len(tasks)
+    for batch in batches:
+        try:
+            batch_results = process_batch([unique_tasks[i] for i in batch], chapter_num_mode)
+        except Exception as e:
+            print(f"Error processing batch of {len(batch)} tasks, Details: {e}", flush=True)
+            continue
+        for unique_index, result in zip(batch, batch_results):
+            for index in copies[unique_index]:
+                if index != copies[unique_index][0]:
+                    key = split_task(tasks[index], chapter_num_mode)[0]
+                    result = (*key, result[-1])
+                    print_result(key, result[-1])
+                results[index] = result
+
+    # Results keep the input order regardless of how the batches were formed
+    results = [result for result in results if result is not None]
 
     print(f"Processed {len(results)} results.", flush=True)
     return results
@@ -128,6 +275,17 @@ def main(input_file_path="rawTags.txt", chapter_num_mode=0):
 
     results = run_model(input_file_path, chapter_num_mode)
 
+    # A segment file gets its results back as one, commas and newlines in the text survive
+    if is_segment_file(input_file_path):
+        output_file = "translatedSegments.bin"
+        segments = []
+        for result in results:
+            chapterNum, position = (result[0], result[1]) if chapter_num_mode == 0 else (0, result[0])
+            segments.append((len(segments), int(chapterNum), int(position), "eng", result[-1]))
+        write_segment_file(output_file, segments)
+        print(f"Results written to {output_file}.", flush=True)
+        return 0
+
     # Write results to file
     output_file = "translatedTags.txt"
     with open(output_file, "w", encoding="utf-8") as file:
@@ -159,6 +317,7 @@ if __name__ == "__main__":
     # Print loaded parameters
     print(f"Model name: {Model_name}", flush=True)
     print("Translation parameters:", json.dumps(params, indent=4), flush=True)
+    print("Batching:", json.dumps(batching, indent=4), flush=True)
     print(providers, flush=True)
     print(sess_options, flush=True)
     # Run the main function